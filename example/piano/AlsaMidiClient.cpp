@@ -42,6 +42,17 @@ snd_seq_event_t* readEvent(snd_seq_t* seq) {
 	return ev;
 }
 
+std::vector<int> AlsaMidiClient::fds() const {
+	std::vector<pollfd> pfds(snd_seq_poll_descriptors_count(mSequencer, POLLIN));
+	pfds.resize(snd_seq_poll_descriptors(mSequencer, pfds.data(), pfds.size(), POLLIN));
+
+	std::vector<int> result;
+	for(auto& pfd : pfds) {
+		result.push_back(pfd.fd);
+	}
+	return result;
+}
+
 void AlsaMidiClient::pollMidiEvents() {
 	while(snd_seq_event_t* ev = readEvent(mSequencer)) {
 		switch(ev->type) {
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 extern "C" {
 #include <alsa/asoundlib.h>
 }
@@ -12,6 +14,8 @@ public:
 	AlsaMidiClient();
 	~AlsaMidiClient();
 	void pollMidiEvents();
+	/// Readable when events arrive, for waiting instead of polling
+	std::vector<int> fds() const;
 
 protected:
 	virtual void noteOn (unsigned note) = 0;
@@ -50,6 +50,7 @@ class Sheet : public SheetWidget, public AlsaMidiClient {
 		if(iter == mKeyboardNotes.end() || *iter != note) {
 			mKeyboardNotes.insert(iter, note);
 		}
+		requestRedraw();
 	}
 	void noteOff(unsigned note) override {
 		// Remove note from set of notes
@@ -57,6 +58,7 @@ class Sheet : public SheetWidget, public AlsaMidiClient {
 		if(iter == mKeyboardNotes.end() || *iter == note) {
 			mKeyboardNotes.erase(iter);
 		}
+		requestRedraw();
 	}
 };
 
@@ -66,8 +68,9 @@ int main(int argc, char const* argv[]) {
 	sheet.align(AlignFill);
 	window.add(sheet);
 	window.open("Piano", 800, 600, Window::FlagAntialias);
-	while(window.update()) {
-		sheet.pollMidiEvents();
-		window.draw();
+	// Sleeps until a key is played, instead of polling every frame
+	for(int fd : sheet.fds()) {
+		window.watch(fd, [&sheet](int) { sheet.pollMidiEvents(); });
 	}
+	window.keepOpen();
 }
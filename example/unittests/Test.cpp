@@ -1,10 +1,49 @@
 #include "Test.hpp"
 
 #include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <vector>
+
+#include <unistd.h>
 
 static
 const char* _test_hint = "";
 
+/// Removes the files of test_path() at exit
+static
+struct TestFiles {
+	std::vector<std::string> paths;
+
+	~TestFiles() {
+		std::error_code ec;
+		for(auto& path : paths) std::filesystem::remove_all(path, ec);
+	}
+} _test_files;
+
+std::string test_path(const char* name) {
+	const char* tmp = getenv("TMPDIR");
+	std::string path = std::string(tmp && *tmp ? tmp : "/tmp") +
+		"/wwidget-test-" + std::to_string(getpid()) + "-" + std::to_string(_test_files.paths.size()) + "-" + name;
+	_test_files.paths.push_back(path);
+	return path;
+}
+
+void test_write_file(std::string const& path, void const* data, size_t size) {
+	if(FILE* f = fopen(path.c_str(), "wb")) {
+		fwrite(data, 1, size, f);
+		fclose(f);
+	}
+}
+
+void test_write_ppm(std::string const& path, unsigned w, unsigned h, std::function<uint8_t(size_t i)> const& byte) {
+	std::string file = "P6\n" + std::to_string(w) + " " + std::to_string(h) + "\n255\n";
+	size_t header = file.size();
+	file.resize(header + size_t(w) * h * 3);
+	for(size_t i = header; i < file.size(); i++) file[i] = (char) byte(i - header);
+	test_write_file(path, file.data(), file.size());
+}
+
 void test_hint(const char* msg) {
 	_test_hint = msg;
 }
@@ -19,11 +58,47 @@ bool _test_result(bool success, const char* content, const char* file, int line)
 }
 
 void testParsing();
+void testSearch();
+void testSelector();
+void testGraveyard();
+void testUniqueTask();
+void testThreadpool();
+void testTaskQueue();
+void testDeferredTasks();
+void testFuture();
+void testCoroutine();
+void testFdWatcher();
+void testImageLoading();
+void testPixels();
+void testBitmap();
+void testThumbnails();
+void testMips();
+void testImageCache();
+void testAtlas();
+void testAnimatedBitmap();
 void printSizes();
 
 int main(int argc, char const** argv) {
 	printSizes();
 	testParsing();
+	testSearch();
+	testSelector();
+	testGraveyard();
+	testUniqueTask();
+	testThreadpool();
+	testTaskQueue();
+	testDeferredTasks();
+	testFuture();
+	testCoroutine();
+	testFdWatcher();
+	testImageLoading();
+	testPixels();
+	testBitmap();
+	testThumbnails();
+	testMips();
+	testImageCache();
+	testAtlas();
+	testAnimatedBitmap();
 	return 0;
 }
 
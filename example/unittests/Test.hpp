@@ -1,8 +1,20 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
 void test_hint(const char* msg);
 bool _test_result(bool success, const char* content, const char* file, int line);
 
+/// A path in $TMPDIR (or /tmp) which is unique to this run of the tests, ending with name. Whatever is there gets removed when the tests end.
+std::string test_path(const char* name);
+/// Writes size bytes of data to path
+void test_write_file(std::string const& path, void const* data, size_t size);
+/// Writes a binary ppm of w * h RGB pixels to path. byte(i) gives the i-th byte of the pixels.
+void test_write_ppm(std::string const& path, unsigned w, unsigned h, std::function<uint8_t(size_t i)> const& byte);
+
 #define expect(a) _test_result((a), #a, __FILE__, __LINE__)
 #define expect_eq(a, b) _test_result((a) == (b), #a " == " #b, __FILE__, __LINE__)
 #define expect_similar(a, b) _test_result((a) - (b) < 1e-7, #a " ≈ " #b, __FILE__, __LINE__)
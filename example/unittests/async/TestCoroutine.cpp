@@ -0,0 +1,114 @@
+#include "../Test.hpp"
+
+#include <wwidget/async/Coroutine.hpp>
+
+#ifdef WWIDGET_COROUTINES
+
+#include <wwidget/BasicContext.hpp>
+#include <wwidget/Bitmap.hpp>
+#include <wwidget/Runtime.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace wwidget;
+
+template<class C>
+static bool updateUntil(BasicContext& ctx, C&& condition) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while(!condition()) {
+		if(std::chrono::steady_clock::now() > deadline) return false;
+		ctx.update();
+		std::this_thread::yield();
+	}
+	return true;
+}
+
+namespace {
+
+struct Guard {
+	bool& destroyed;
+	~Guard() { destroyed = true; }
+};
+
+Task<int> square(Threadpool& pool, int x) {
+	co_await resume_on_pool(pool);
+	co_return x * x;
+}
+
+Task<> pipeline(BasicContext& ctx, int& result, bool& onUi) {
+	int a = co_await square(ctx.threadpool(), 3);
+	int b = co_await run_on_pool(ctx.threadpool(), [a]() { return a + 1; });
+	co_await resume_on_ui(ctx);
+	onUi   = true;
+	result = b;
+}
+
+Task<> waitForever(BasicContext& ctx, bool& reached, bool& destroyed) {
+	Guard guard{destroyed};
+	co_await resume_on_ui(ctx);
+	co_await resume_on_ui(ctx);
+	reached = true;
+}
+
+Task<> loadImage(BasicContext& ctx, std::string url, std::shared_ptr<Bitmap>& to) {
+	to = co_await loadImageAsync(ctx, url);
+}
+
+} // namespace
+
+void testCoroutine() {
+	BasicContext ctx(std::make_shared<Runtime>(2));
+
+	test_hint("frame pool");
+	{
+		void* a = detail::FramePool::allocate(100);
+		detail::FramePool::deallocate(a, 100);
+		void* b = detail::FramePool::allocate(120);
+		expect_eq(a, b);
+		detail::FramePool::deallocate(b, 120);
+	}
+
+	test_hint("pipeline");
+	{
+		Owner owner;
+		int  result = 0;
+		bool onUi   = false;
+		spawn(ctx, &owner, pipeline(ctx, result, onUi));
+		expect(updateUntil(ctx, [&]() { return result != 0; }));
+		expect_eq(result, 10);
+		expect(onUi);
+		ctx.update();
+		expect(!owner.hasOwnerships()); // Finished coroutines let go of their owner
+	}
+
+	test_hint("owner cancels");
+	{
+		bool reached = false, destroyed = false;
+		{
+			Owner owner;
+			spawn(ctx, &owner, waitForever(ctx, reached, destroyed));
+			expect(!destroyed);
+		}
+		ctx.update();
+		expect(destroyed);
+		expect(!reached);
+	}
+
+	test_hint("loadImageAsync");
+	{
+		std::string path = test_path("coroutine.ppm");
+		test_write_ppm(path, 1, 1, [](size_t i) { return uint8_t(i + 1); });
+		std::shared_ptr<Bitmap> bitmap;
+		spawn(ctx, nullptr, loadImage(ctx, path, bitmap));
+		expect(updateUntil(ctx, [&]() { return bitmap != nullptr; }));
+		expect_eq(bitmap->width(), 1);
+	}
+}
+
+#else
+
+void testCoroutine() {}
+
+#endif
@@ -0,0 +1,130 @@
+#include "../Test.hpp"
+
+#include <wwidget/BasicContext.hpp>
+#include <wwidget/Runtime.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace wwidget;
+
+namespace {
+
+struct CountingContext : public BasicContext {
+	std::atomic<int> wakeups{0};
+
+	CountingContext() : BasicContext(std::make_shared<Runtime>(1)) {}
+
+	void wakeup() override { wakeups++; }
+};
+
+} // namespace
+
+void testDeferredTasks() {
+	test_hint("priorities");
+	{
+		BasicContext ctx(std::make_shared<Runtime>(1));
+		std::string order;
+		ctx.defer([&]() { order += 'i'; }, PRIORITY_IDLE);
+		ctx.defer([&]() { order += 'n'; });
+		ctx.defer([&]() { order += 'I'; }, PRIORITY_INPUT);
+		ctx.update();
+		expect_eq(order, std::string("Ini"));
+	}
+
+	test_hint("budget and carry-over");
+	{
+		BasicContext ctx(std::make_shared<Runtime>(1));
+		ctx.taskBudget(std::chrono::microseconds(0));
+
+		std::string order;
+		for(int i = 0; i < 3; i++) {
+			ctx.defer([&order, i]() { order += char('0' + i); });
+		}
+		ctx.defer([&]() { order += 'i'; }, PRIORITY_IDLE);
+
+		// Without budget, one normal task per update goes through, idle tasks wait until they're done
+		expect(ctx.update());
+		expect_eq(order, std::string("0"));
+		expect_eq(ctx.taskStats(PRIORITY_NORMAL).waiting, 2u);
+		expect_eq(ctx.taskStats(PRIORITY_IDLE).waiting, 1u);
+
+		// Input tasks don't care about the budget and overtake the backlog
+		ctx.defer([&]() { order += 'I'; }, PRIORITY_INPUT);
+		ctx.defer([&]() { order += 'J'; }, PRIORITY_INPUT);
+		ctx.update();
+		expect_eq(order, std::string("0IJ1"));
+
+		ctx.taskBudget(std::chrono::seconds(1));
+		ctx.update();
+		expect_eq(order, std::string("0IJ12i"));
+
+		auto& normal = ctx.taskStats(PRIORITY_NORMAL);
+		expect_eq(normal.executed, 3u);
+		expect_eq(normal.postponed, 3u);
+		expect_eq(normal.postponedUpdates, 2u);
+		expect_eq(normal.waiting, 0u);
+		expect_eq(ctx.taskStats(PRIORITY_INPUT).executed, 2u);
+		expect_eq(ctx.taskStats(PRIORITY_IDLE).postponed, 2u);
+		expect(!ctx.update());
+	}
+
+	test_hint("frame requests");
+	{
+		CountingContext ctx;
+		expect(ctx.needsFrame()); // The first frame
+		ctx.update();
+		expect(!ctx.needsFrame());
+
+		// Tasks from other threads wake up the event loop once
+		std::thread([&]() {
+			ctx.defer([]() {});
+			ctx.defer([]() {});
+		}).join();
+		expect(ctx.needsFrame());
+		expect_eq(ctx.wakeups.load(), 1);
+		ctx.update();
+		expect(!ctx.needsFrame());
+
+		ctx.startAnimation();
+		ctx.update();
+		expect(ctx.needsFrame());
+		ctx.stopAnimation();
+		expect(!ctx.needsFrame());
+
+		Widget root;
+		ctx.rootWidget(&root);
+		expect(ctx.needsFrame()); // Not laid out yet
+		ctx.update();
+		root.requestRedraw();
+		expect(ctx.needsFrame());
+	}
+	test_hint("timers");
+	{
+		BasicContext ctx(std::make_shared<Runtime>(1));
+		ctx.update();
+		expect(ctx.nextTimer() == std::chrono::steady_clock::time_point::max());
+
+		auto start = ctx.now();
+		std::string order;
+		ctx.deferUntil(start + std::chrono::hours(1), [&]() { order += 'l'; });
+		ctx.deferUntil(start, [&]() { order += 'a'; });
+		ctx.deferUntil(start, [&]() {
+			order += 'b';
+			// Added while the timers run: Waits for the next update, even though it's due
+			ctx.deferUntil(start, [&]() { order += 'c'; });
+		});
+		expect(ctx.nextTimer() == start);
+		expect(ctx.needsFrame());
+
+		ctx.update();
+		expect_eq(order, std::string("ab"));
+		expect(ctx.now() >= start);
+		ctx.update();
+		expect_eq(order, std::string("abc"));
+		expect(ctx.nextTimer() == start + std::chrono::hours(1));
+		expect(!ctx.needsFrame());
+	}
+}
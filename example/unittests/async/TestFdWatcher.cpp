@@ -0,0 +1,79 @@
+#include "../Test.hpp"
+
+#include <wwidget/Error.hpp>
+#include <wwidget/FdWatcher.hpp>
+
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+	#include <unistd.h>
+#endif
+
+using namespace wwidget;
+using namespace std::chrono_literals;
+
+void testFdWatcher() {
+#ifdef __linux__
+	FdWatcher watcher;
+	int pipe1[2], pipe2[2];
+	expect(pipe(pipe1) == 0 && pipe(pipe2) == 0);
+
+	test_hint("readable fd");
+	{
+		int  calls  = 0;
+		char result = 0;
+		auto watch = watcher.watch(pipe1[0], [&](int events) {
+			calls++;
+			if(events & FD_READABLE) read(pipe1[0], &result, 1);
+		});
+		expect_eq(watcher.wait(0ms), 0u);
+		expect(write(pipe1[1], "x", 1) == 1);
+		expect_eq(watcher.wait(1000ms), 1u);
+		expect_eq(calls, 1);
+		expect_eq(result, 'x');
+
+		expect_exception(exceptions::InvalidOperation, [&]() { watcher.watch(pipe1[0], [](int) {}); });
+
+		watch->cancel();
+		expect(!watch->active());
+		expect(watcher.empty());
+		expect(write(pipe1[1], "y", 1) == 1);
+		expect_eq(watcher.wait(0ms), 0u);
+		expect_eq(calls, 1);
+		read(pipe1[0], &result, 1);
+	}
+
+	test_hint("owner and self cancellation");
+	{
+		int calls = 0;
+		{
+			Owner owner;
+			watcher.watch(pipe1[0], [&](int) { calls++; }, FD_READABLE, &owner);
+		}
+		expect(watcher.empty());
+
+		std::shared_ptr<FdWatch> watch;
+		watch = watcher.watch(pipe2[0], [&](int) { calls++; watch->cancel(); });
+		expect(write(pipe2[1], "z", 1) == 1);
+		expect_eq(watcher.wait(1000ms), 1u);
+		expect_eq(watcher.wait(0ms), 0u); // Still readable, but not watched anymore
+		expect_eq(calls, 1);
+	}
+
+	test_hint("interrupt");
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::thread interrupter([&]() {
+			std::this_thread::sleep_for(10ms);
+			watcher.interrupt();
+		});
+		expect_eq(watcher.wait(-1ms), 0u);
+		interrupter.join();
+		expect(std::chrono::steady_clock::now() - start < 5s);
+	}
+
+	close(pipe1[0]); close(pipe1[1]);
+	close(pipe2[0]); close(pipe2[1]);
+#endif
+}
@@ -0,0 +1,126 @@
+#include "../Test.hpp"
+
+#include <wwidget/BasicContext.hpp>
+#include <wwidget/Runtime.hpp>
+#include <wwidget/async/Future.hpp>
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace wwidget;
+
+template<class C>
+static bool updateUntil(BasicContext& ctx, C&& condition) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while(!condition()) {
+		if(std::chrono::steady_clock::now() > deadline) return false;
+		ctx.update();
+		std::this_thread::yield();
+	}
+	return true;
+}
+
+void testFuture() {
+	BasicContext ctx(std::make_shared<Runtime>(2));
+	Threadpool&  pool = ctx.threadpool();
+	auto         uiThread = std::this_thread::get_id();
+
+	test_hint("pipeline");
+	{
+		std::thread::id first, second, ui;
+		std::string result;
+		pool.stop(); // The whole pipeline exists before the first step runs
+		run_on_pool(pool, [&]() { first = std::this_thread::get_id(); return 20; })
+			.then_on_pool(pool, [&](int x) { second = std::this_thread::get_id(); return std::to_string(x + 1); })
+			.then_on_ui(ctx, [&](std::string s) { ui = std::this_thread::get_id(); result = s; });
+		pool.start(2);
+		expect(updateUntil(ctx, [&]() { return !result.empty(); }));
+		expect_eq(result, std::string("21"));
+		expect_eq(first, second); // No hop between pool steps
+		expect_eq(ui, uiThread);
+	}
+
+	test_hint("promise and errors");
+	{
+		Promise<int> promise;
+		bool thenCalled = false;
+		std::string error;
+		promise.future()
+			.then_on_pool(pool, [](int) -> int { throw std::runtime_error("broken"); })
+			.then_on_ui(ctx, [&](int) { thenCalled = true; })
+			.catch_on_ui(ctx, [&](std::exception_ptr e) {
+				try { std::rethrow_exception(e); }
+				catch(std::runtime_error& err) { error = err.what(); }
+			});
+		promise.set_value(1);
+		expect(updateUntil(ctx, [&]() { return !error.empty(); }));
+		expect_eq(error, std::string("broken"));
+		expect(!thenCalled);
+	}
+
+	test_hint("owner cancels");
+	{
+		Promise<int> promise;
+		Owner owner;
+		bool called = false;
+		auto last = promise.future().then_on_ui(ctx, [&](int) { called = true; }, &owner);
+		expect(!promise.cancelled());
+		owner.clearOwnerships();
+		expect(promise.cancelled()); // Reaches the producer
+		promise.set_value(1);
+		for(int i = 0; i < 5; i++) ctx.update();
+		expect(!called);
+		expect(last.ready());
+	}
+
+	test_hint("cancel with an owner");
+	{
+		// The step is still linked to the owner, only the ui thread may unlink it. Even if the last reference is on another thread.
+		Promise<int> promise;
+		Owner owner;
+		bool called = false;
+		{
+			auto last = promise.future().then_on_ui(ctx, [&](int) { called = true; }, &owner);
+			last.cancel();
+			expect(promise.cancelled());
+		}
+		std::thread([&]() { promise.set_value(1); }).join();
+		expect(owner.hasOwnerships());
+		ctx.update();
+		expect(!owner.hasOwnerships());
+		expect(!called);
+	}
+
+	test_hint("broken promise");
+	{
+		bool called = false;
+		Future<void> last;
+		{
+			Promise<int> promise;
+			last = promise.future().then_on_ui(ctx, [&](int) { called = true; });
+		}
+		expect(last.ready());
+		ctx.update();
+		expect(!called);
+	}
+
+	test_hint("when_all");
+	{
+		std::vector<Future<int>> parts;
+		for(int i = 0; i < 8; i++) {
+			parts.push_back(run_on_pool(pool, [i]() { return i * i; }));
+		}
+		int sum = -1;
+		when_all(std::move(parts)).then_on_ui(ctx, [&](std::vector<int> squares) {
+			sum = 0;
+			for(int i = 0; i < (int)squares.size(); i++) sum += squares[i] * (squares[i] == i * i);
+		});
+		expect(updateUntil(ctx, [&]() { return sum >= 0; }));
+		expect_eq(sum, 140);
+
+		auto ready = when_all(std::vector<Future<int>>{ make_ready_future(1), make_ready_future(2) });
+		expect(ready.ready());
+	}
+}
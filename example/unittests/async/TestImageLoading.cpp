@@ -0,0 +1,209 @@
+#include "../Test.hpp"
+
+#include <wwidget/BasicContext.hpp>
+#include <wwidget/Bitmap.hpp>
+#include <wwidget/Runtime.hpp>
+#include <wwidget/async/Threadpool.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace wwidget;
+
+/// The same path with n "./" in front of the file name, so it isn't coalesced with the others
+static std::string spelling(std::string const& path, int n) {
+	size_t slash = path.rfind('/') + 1;
+	std::string result = path.substr(0, slash);
+	for(int i = 0; i < n; i++) result += "./";
+	return result + path.substr(slash);
+}
+
+template<class C>
+static bool updateUntil(BasicContext& ctx, C&& condition) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while(!condition()) {
+		if(std::chrono::steady_clock::now() > deadline) return false;
+		ctx.update();
+		std::this_thread::yield();
+	}
+	return true;
+}
+
+void testImageLoading() {
+	std::string url = test_path("image.ppm");
+	test_write_ppm(url, 2, 2, [](size_t i) { return uint8_t(i * 20); });
+	std::string urls[] = { url, spelling(url, 1), spelling(url, 2) };
+
+	test_hint("viewportDistance");
+	{
+		Widget root;
+		root.size(100, 100);
+		Widget* visible = root.add<Widget>();
+		visible->size(10, 10)->offset(50, 50);
+		Widget* below = root.add<Widget>();
+		below->size(10, 10)->offset(0, 300);
+		Widget* nested = below->add<Widget>();
+		nested->size(10, 10)->offset(0, 0);
+
+		expect_eq(visible->viewportDistance(), 0.f);
+		expect_eq(below->viewportDistance(), 200.f);
+		expect_eq(nested->viewportDistance(), 200.f);
+	}
+
+	test_hint("priorities");
+	{
+		BasicContext ctx(std::make_shared<Runtime>());
+		ctx.threadpool().stop(); // Queue everything before anything starts
+
+		Widget root;
+		root.size(100, 100);
+		Widget* far     = root.add<Widget>(); far->size(10, 10)->offset(0, 600);
+		Widget* visible = root.add<Widget>(); visible->size(10, 10)->offset(0, 0);
+		Widget* near    = root.add<Widget>(); near->size(10, 10)->offset(0, 150);
+
+		std::vector<Widget*> order;
+		Widget* viewers[] = {far, visible, near};
+		for(int i = 0; i < 3; i++) {
+			Widget* w = viewers[i];
+			auto request = ctx.loadImage([&order, w](std::shared_ptr<Bitmap> b) {
+				expect(b && b->width() == 2);
+				order.push_back(w);
+			}, urls[i], nullptr, w);
+			expect(request != nullptr);
+		}
+
+		ctx.threadpool().start(1);
+		expect(updateUntil(ctx, [&]() { return order.size() == 3; }));
+		expect(order == std::vector<Widget*>({visible, near, far}));
+	}
+
+	test_hint("cancellation");
+	{
+		BasicContext ctx(std::make_shared<Runtime>());
+		ctx.threadpool().stop();
+
+		int called = 0;
+		Owner owner;
+		ctx.loadImage([&](auto) { called += 1; }, url, &owner);
+		auto request = ctx.loadImage([&](auto) { called += 10; }, url);
+		ctx.loadImage([&](auto) { called += 100; }, url);
+
+		owner.clearOwnerships();
+		request->cancel();
+
+		ctx.threadpool().start(1);
+		expect(updateUntil(ctx, [&]() { return called != 0; }));
+		// Give cancelled loads a chance to (wrongly) finish
+		for(int i = 0; i < 10; i++) {
+			ctx.update();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		expect_eq(called, 100);
+	}
+
+	test_hint("coalescing");
+	{
+		BasicContext ctx(std::make_shared<Runtime>());
+		ctx.threadpool().stop();
+
+		std::shared_ptr<Bitmap> a, b, c;
+		auto first = ctx.loadImage([&](auto bitmap) { a = bitmap; }, url);
+		ctx.loadImage([&](auto bitmap) { b = bitmap; }, url);
+		ctx.loadImage([&](auto bitmap) { c = bitmap; }, url);
+		first->cancel(); // The others still wait for the decode
+
+		ctx.threadpool().start(1);
+		expect(updateUntil(ctx, [&]() { return b && c; }));
+		expect(!a);
+		expect_eq(b, c);
+	}
+
+	test_hint("widget loads");
+	{
+		BasicContext ctx(std::make_shared<Runtime>());
+		ctx.threadpool().stop();
+		Widget root;
+		ctx.rootWidget(&root);
+
+		Owner kept, dropped;
+		std::shared_ptr<Bitmap> loaded, cancelled;
+		root.loadImage(&kept, loaded, url);
+		root.loadImage(&dropped, cancelled, urls[1]);
+		dropped.clearOwnerships();
+
+		ctx.threadpool().start(1);
+		expect(updateUntil(ctx, [&]() { return loaded != nullptr; }));
+		expect(loaded && loaded->width() == 2);
+		for(int i = 0; i < 10; i++) {
+			ctx.update();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		expect(!cancelled);
+	}
+
+	test_hint("decode budget");
+	{
+		// Many urls for the same file, so the workers would decode several at once. Big enough that the decodes overlap.
+		std::string big = test_path("big.ppm");
+		test_write_ppm(big, 1024, 1024, [](size_t i) { return uint8_t(i % 251); });
+		std::vector<std::string> many;
+		for(int i = 0; i < 16; i++) {
+			many.push_back(spelling(big, i));
+		}
+		size_t single = Bitmap::decodedSize(big);
+		expect(single > 0);
+
+		for(size_t budget : { size_t(1), 2 * single }) {
+			BasicContext ctx(std::make_shared<Runtime>());
+			ctx.threadpool().stop();
+			ctx.runtime().decodeBudget(budget);
+
+			int loaded = 0;
+			for(auto& u : many) {
+				ctx.loadImage([&](auto bitmap) { loaded += bitmap != nullptr; }, u);
+			}
+			ctx.threadpool().start(4);
+			expect(updateUntil(ctx, [&]() { return loaded == (int)many.size(); }));
+
+			// A single image is always let through, however big
+			expect(ctx.runtime().peakDecodeBytes() >= single);
+			expect(ctx.runtime().peakDecodeBytes() <= std::max(budget, single));
+		}
+	}
+
+	test_hint("shared runtime");
+	{
+		auto isolated = std::make_shared<Runtime>(1);
+		isolated->threadpool().stop();
+
+		BasicContext a(isolated), b(isolated), c;
+		expect_eq(&a.runtime(), &b.runtime());
+		expect(&a.runtime() != &c.runtime());
+		expect_eq(&c.runtime(), Runtime::shared().get());
+
+		// One decode for both contexts, each gets the result through its own queue
+		std::shared_ptr<Bitmap> fromA, fromB;
+		a.loadImage([&](auto bitmap) { fromA = bitmap; }, url);
+		b.loadImage([&](auto bitmap) { fromB = bitmap; }, url);
+		isolated->threadpool().start(1);
+		expect(updateUntil(a, [&]() { return fromA != nullptr; }));
+		expect(updateUntil(b, [&]() { return fromB != nullptr; }));
+		expect_eq(fromA, fromB);
+
+		// A context which goes away doesn't get results anymore
+		isolated->threadpool().stop();
+		bool called = false;
+		{
+			BasicContext gone(isolated);
+			gone.loadImage([&](auto) { called = true; }, urls[1]);
+		}
+		isolated->threadpool().start(1);
+		for(int i = 0; i < 10; i++) {
+			a.update();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		expect(!called);
+	}
+}
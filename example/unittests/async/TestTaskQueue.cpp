@@ -0,0 +1,105 @@
+#include "../Test.hpp"
+
+#include <wwidget/async/Queue.hpp>
+
+#include <thread>
+#include <vector>
+
+using namespace wwidget;
+
+void testTaskQueue() {
+	test_hint("overflow keeps order");
+	{
+		TaskQueue queue(4);
+		std::vector<int> order;
+		for(int i = 0; i < 20; i++) {
+			queue.add([&order, i]() { order.push_back(i); });
+		}
+		expect_eq(queue.executeSingleConsumer(), 20u);
+		bool ordered = order.size() == 20;
+		for(size_t i = 0; ordered && i < order.size(); i++) ordered = order[i] == (int)i;
+		expect(ordered);
+
+		// Usable again after overflowing
+		queue.add([&order]() { order.push_back(20); });
+		expect_eq(queue.executeSingleConsumer(), 1u);
+		expect_eq(order.back(), 20);
+	}
+
+	test_hint("wakeup hook");
+	{
+		TaskQueue queue;
+		int wakeups = 0;
+		queue.wakeupHook([&]() { wakeups++; });
+		queue.add([]() {});
+		queue.add([]() {});
+		expect_eq(wakeups, 1);
+		queue.executeSingleConsumer();
+		queue.add([]() {});
+		expect_eq(wakeups, 2);
+	}
+
+	test_hint("multiple producers");
+	{
+		TaskQueue queue(64);
+		constexpr int Producers = 4, PerProducer = 2000;
+		std::vector<int> last(Producers, -1);
+		bool ordered = true;
+
+		std::vector<std::thread> producers;
+		for(int p = 0; p < Producers; p++) {
+			producers.emplace_back([&, p]() {
+				for(int i = 0; i < PerProducer; i++) {
+					queue.add([&, p, i]() {
+						ordered = ordered && last[p] == i - 1;
+						last[p] = i;
+					});
+				}
+			});
+		}
+
+		size_t executed = 0;
+		while(executed < Producers * PerProducer) {
+			executed += queue.executeSingleConsumer();
+			std::this_thread::yield();
+		}
+		for(auto& t : producers) t.join();
+		executed += queue.executeSingleConsumer();
+
+		expect_eq(executed, (size_t)Producers * PerProducer);
+		expect(ordered);
+	}
+
+	test_hint("producers on a full ring");
+	{
+		// The ring is full all the time, so tasks of the same thread end up in the ring and in the overflow list.
+		// The interesting interleaving is rare, hence the rounds.
+		constexpr int Producers = 2, PerProducer = 5000;
+		bool ordered = true;
+		size_t executed = 0;
+		for(int round = 0; round < 200; round++) {
+			TaskQueue queue(2);
+			std::vector<int> last(Producers, -1);
+
+			std::vector<std::thread> producers;
+			for(int p = 0; p < Producers; p++) {
+				producers.emplace_back([&, p]() {
+					for(int i = 0; i < PerProducer; i++) {
+						queue.add([&, p, i]() {
+							ordered = ordered && last[p] == i - 1;
+							last[p] = i;
+						});
+					}
+				});
+			}
+
+			size_t target = executed + Producers * PerProducer;
+			while(executed < target) {
+				executed += queue.executeSingleConsumer();
+			}
+			for(auto& t : producers) t.join();
+		}
+		expect_eq(executed, (size_t)200 * Producers * PerProducer);
+		expect(ordered);
+	}
+}
@@ -0,0 +1,96 @@
+#include "../Test.hpp"
+
+#include <wwidget/async/Threadpool.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+using namespace wwidget;
+
+template<class C>
+static bool waitFor(C&& condition) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while(!condition()) {
+		if(std::chrono::steady_clock::now() > deadline) return false;
+		std::this_thread::yield();
+	}
+	return true;
+}
+
+void testThreadpool() {
+	test_hint("many tasks");
+	{
+		Threadpool pool(4);
+		std::atomic<int> sum{0};
+		for(int i = 1; i <= 1000; i++) {
+			pool.add([&sum, i]() { sum += i; });
+		}
+		expect(waitFor([&]() { return sum == 500500; }));
+	}
+
+	test_hint("tasks adding tasks");
+	{
+		Threadpool pool(3);
+		std::atomic<int> count{0};
+		for(int i = 0; i < 10; i++) {
+			pool.add([&]() {
+				for(int j = 0; j < 100; j++) {
+					pool.add([&]() { count++; }, j % 2 ? LANE_BULK : LANE_LATENCY);
+				}
+			});
+		}
+		expect(waitFor([&]() { return count == 1000; }));
+	}
+
+	test_hint("latency workers");
+	{
+		// The bulk worker is blocked, the latency worker still runs latency tasks
+		Threadpool pool(2, 1);
+		std::atomic<bool> release{false}, blocked{false}, latencyDone{false};
+		pool.add([&]() { blocked = true; while(!release) std::this_thread::yield(); });
+		expect(waitFor([&]() { return blocked.load(); }));
+		pool.add([&]() { latencyDone = true; }, LANE_LATENCY);
+		expect(waitFor([&]() { return latencyDone.load(); }));
+		release = true;
+	}
+
+	test_hint("try_pop");
+	{
+		// Without workers, somebody has to help out
+		Threadpool pool;
+		int value = 0;
+		pool.add([&]() { value = 1; });
+		pool.add([&]() { value = 2; }, LANE_LATENCY);
+		auto task = pool.try_pop();
+		expect((bool)task);
+		if(task) task();
+		expect_eq(value, 2);
+		expect((bool)pool.try_pop());
+		expect(!pool.try_pop());
+	}
+
+	test_hint("reused nodes");
+	{
+		// Nodes go back to the free lists, what the tasks captured doesn't stay around with them
+		Threadpool pool;
+		auto captured = std::make_shared<int>(0);
+		std::atomic<int> count{0};
+		for(int i = 0; i < 100; i++) {
+			pool.add([&count, captured]() { count++; });
+		}
+		pool.start(2);
+		expect(waitFor([&]() { return count == 100; }));
+		expect(waitFor([&]() { return captured.use_count() == 1; }));
+
+		// Again, now from the free lists
+		for(int round = 0; round < 10; round++) {
+			for(int i = 0; i < 100; i++) {
+				pool.add([&count, captured]() { count++; }, i % 2 ? LANE_BULK : LANE_LATENCY);
+			}
+		}
+		expect(waitFor([&]() { return count == 1100; }));
+		expect(waitFor([&]() { return captured.use_count() == 1; }));
+	}
+}
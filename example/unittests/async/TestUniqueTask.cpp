@@ -0,0 +1,83 @@
+#include "../Test.hpp"
+
+#include <wwidget/async/UniqueTask.hpp>
+#include <wwidget/async/Queue.hpp>
+
+#include <array>
+#include <memory>
+#include <string>
+
+using namespace wwidget;
+
+static int gAlive = 0;
+
+struct Tracked {
+	Tracked() { ++gAlive; }
+	Tracked(Tracked const&) { ++gAlive; }
+	~Tracked() { --gAlive; }
+};
+
+void testUniqueTask() {
+	test_hint("empty");
+	{
+		unique_task task;
+		expect(!task);
+		expect(!unique_task(std::function<void()>()));
+		expect(!unique_task((void(*)())nullptr));
+		expect(sizeof(unique_task) == 64);
+	}
+
+	test_hint("move-only captures");
+	{
+		int result = 0;
+		auto value = std::make_unique<int>(42);
+		unique_task task = [&result, value = std::move(value)]() { result = *value; };
+		expect((bool)task);
+
+		unique_task moved = std::move(task);
+		expect(!task);
+		moved();
+		expect_eq(result, 42);
+	}
+
+	test_hint("arguments and results");
+	{
+		unique_function<std::string(std::string, int)> fn = [](std::string s, int n) {
+			std::string result;
+			for(int i = 0; i < n; i++) result += s;
+			return result;
+		};
+		expect_eq(fn("ab", 3), "ababab");
+	}
+
+	test_hint("destruction");
+	{
+		gAlive = 0;
+		{
+			// Fits inline
+			unique_task small = [t = Tracked()]() {};
+			// Doesn't fit inline
+			unique_task big = [t = Tracked(), padding = std::array<char, 128>()]() {};
+			expect_eq(gAlive, 2);
+
+			unique_task a = std::move(small);
+			unique_task b = std::move(big);
+			expect_eq(gAlive, 2);
+
+			a = std::move(b);
+			expect_eq(gAlive, 1);
+		}
+		expect_eq(gAlive, 0);
+	}
+
+	test_hint("TaskQueue");
+	{
+		TaskQueue queue;
+		int sum = 0;
+		for(int i = 1; i <= 10; i++) {
+			queue.add([&sum, i, p = std::make_unique<int>(i)]() { sum += *p; });
+		}
+		expect_eq(queue.executeSingleConsumer(), 10u);
+		expect_eq(sum, 55);
+	}
+}
@@ -0,0 +1,292 @@
+#include "../Test.hpp"
+
+#include <wwidget/AnimatedBitmap.hpp>
+#include <wwidget/Bitmap.hpp>
+
+#include <wwidget/async/Threadpool.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace wwidget;
+using namespace std::chrono_literals;
+
+namespace {
+
+const uint8_t Palette[4][3] = { { 0, 0, 0 }, { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 } };
+
+struct GifFrame {
+	unsigned x, y, w, h;
+	std::vector<uint8_t> indices; //!< In image order, interlacing is done by the encoder
+	unsigned centiseconds = 0;
+	unsigned disposal     = 1;
+	int      transparent  = -1;
+	bool     interlaced   = false;
+};
+
+/// Packs codes LSB first into sub-blocks
+struct CodeWriter {
+	std::vector<uint8_t> bytes;
+	uint32_t bits  = 0;
+	unsigned count = 0;
+
+	void put(unsigned code, unsigned size) {
+		bits  |= code << count;
+		count += size;
+		while(count >= 8) {
+			bytes.push_back(bits & 0xFF);
+			bits  >>= 8;
+			count  -= 8;
+		}
+	}
+	void flush() {
+		if(count > 0) bytes.push_back(bits & 0xFF);
+		bits = count = 0;
+	}
+};
+
+/// LZW like common encoders do it: A clear code first, wider codes once the table passed a power of two
+void lzw(std::vector<uint8_t>& out, std::vector<uint8_t> const& indices, unsigned minSize) {
+	CodeWriter writer;
+	unsigned clear = 1u << minSize, codeSize = minSize + 1, next = clear + 2;
+	std::map<std::pair<unsigned, uint8_t>, unsigned> table;
+	writer.put(clear, codeSize);
+	int current = -1;
+	for(uint8_t index : indices) {
+		if(current < 0) { current = index; continue; }
+		auto iter = table.find({ (unsigned) current, index });
+		if(iter != table.end()) { current = (int) iter->second; continue; }
+		writer.put((unsigned) current, codeSize);
+		unsigned code = next++;
+		table[{ (unsigned) current, index }] = code;
+		if(code >= (1u << codeSize)) codeSize++;
+		if(code == 4095) {
+			writer.put(clear, codeSize);
+			table.clear();
+			codeSize = minSize + 1;
+			next     = clear + 2;
+		}
+		current = index;
+	}
+	writer.put((unsigned) current, codeSize);
+	writer.put(clear + 1, codeSize);
+	writer.flush();
+
+	out.push_back((uint8_t) minSize);
+	for(size_t i = 0; i < writer.bytes.size(); i += 255) {
+		size_t n = std::min<size_t>(255, writer.bytes.size() - i);
+		out.push_back((uint8_t) n);
+		out.insert(out.end(), writer.bytes.begin() + i, writer.bytes.begin() + i + n);
+	}
+	out.push_back(0);
+}
+
+std::vector<uint8_t> encodeGif(unsigned width, unsigned height, std::vector<GifFrame> const& frames) {
+	std::vector<uint8_t> out = { 'G', 'I', 'F', '8', '9', 'a' };
+	auto word = [&](unsigned v) { out.push_back(v & 0xFF); out.push_back(v >> 8); };
+	word(width);
+	word(height);
+	out.push_back(0x80 | 0x01); // A global palette of 4 colors
+	out.push_back(0);
+	out.push_back(0);
+	for(auto& color : Palette) out.insert(out.end(), color, color + 3);
+
+	// Loops forever, the decoder has to skip it
+	const char netscape[] = "NETSCAPE2.0";
+	out.insert(out.end(), { 0x21, 0xFF, 11 });
+	out.insert(out.end(), netscape, netscape + 11);
+	out.insert(out.end(), { 3, 1, 0, 0, 0 });
+
+	for(auto& frame : frames) {
+		out.insert(out.end(), { 0x21, 0xF9, 4 });
+		out.push_back((uint8_t) ((frame.disposal << 2) | (frame.transparent >= 0 ? 1 : 0)));
+		word(frame.centiseconds);
+		out.push_back((uint8_t) (frame.transparent >= 0 ? frame.transparent : 0));
+		out.push_back(0);
+
+		out.push_back(0x2C);
+		word(frame.x); word(frame.y); word(frame.w); word(frame.h);
+		out.push_back(frame.interlaced ? 0x40 : 0);
+
+		std::vector<uint8_t> data;
+		if(frame.interlaced) {
+			const unsigned starts[4] = { 0, 4, 2, 1 }, steps[4] = { 8, 8, 4, 2 };
+			for(unsigned pass = 0; pass < 4; pass++) {
+				for(unsigned y = starts[pass]; y < frame.h; y += steps[pass]) {
+					data.insert(data.end(), frame.indices.begin() + y * frame.w, frame.indices.begin() + (y + 1) * frame.w);
+				}
+			}
+		}
+		else {
+			data = frame.indices;
+		}
+		lzw(out, data, 2);
+	}
+	out.push_back(0x3B);
+	return out;
+}
+
+std::shared_ptr<uint8_t[]> copy(std::vector<uint8_t> const& data) {
+	std::shared_ptr<uint8_t[]> result(new uint8_t[data.size()]);
+	memcpy(result.get(), data.data(), data.size());
+	return result;
+}
+
+/// Gives the workers time to fill the ring
+void waitForFrames(AnimatedBitmap& animation, size_t count) {
+	auto timeout = std::chrono::steady_clock::now() + 5s;
+	while(animation.buffered() < count && std::chrono::steady_clock::now() < timeout) {
+		std::this_thread::sleep_for(1ms);
+	}
+}
+
+bool samePixel(Bitmap const& bitmap, unsigned x, unsigned y, uint8_t const (&color)[3], uint8_t alpha = 255) {
+	uint8_t const* p = bitmap.data() + (size_t(y) * bitmap.width() + x) * 4;
+	return p[0] == color[0] && p[1] == color[1] && p[2] == color[2] && p[3] == alpha;
+}
+
+} // namespace
+
+void testAnimatedBitmap() {
+	Threadpool pool(2);
+
+	const unsigned W = 8, H = 6;
+	std::vector<GifFrame> frames(3);
+	frames[0] = GifFrame{ 0, 0, W, H, {}, 5, 1, -1, true };
+	for(unsigned i = 0; i < W * H; i++) frames[0].indices.push_back((uint8_t) ((i * 7 + i / W) % 4));
+	frames[1] = GifFrame{ 2, 1, 3, 2, std::vector<uint8_t>(6, 3), 0, 2 };
+	frames[2] = GifFrame{ 5, 3, 2, 2, { 0, 1, 1, 0 }, 2, 1, 0 };
+	auto gif = encodeGif(W, H, frames);
+
+	// stb decodes the first frame, the rest is ours
+	Bitmap reference;
+	reference.load(gif.data(), gif.size(), Bitmap::RGBA);
+	auto matchesFirstFrame = [&](Bitmap const& bitmap) {
+		return bitmap.width() == W && bitmap.height() == H && reference.width() == W && reference.height() == H &&
+			memcmp(bitmap.data(), reference.data(), W * H * 4) == 0;
+	};
+
+	test_hint("frames");
+	{
+		AnimatedBitmap animation;
+		animation.open(copy(gif), gif.size(), pool, 2);
+		expect_eq(animation.capacity(), 2u);
+		auto& bitmap = *animation.bitmap();
+		expect_eq(bitmap.width(), W);
+		expect(bitmap.live());
+
+		// The ring doesn't grow, no matter how far behind the animation is
+		waitForFrames(animation, 2);
+		std::this_thread::sleep_for(20ms);
+		expect_eq(animation.buffered(), 2u);
+
+		auto start = std::chrono::steady_clock::now();
+		expect(animation.advance(start));
+		expect(matchesFirstFrame(bitmap));
+		expect(animation.due() == start + 50ms);
+		expect(!animation.advance(start + 10ms));
+
+		// Only what the frame covers is copied
+		unsigned x, y, w, h;
+		bitmap.takeDirty(x, y, w, h);
+		waitForFrames(animation, 2);
+		expect(animation.advance(start + 50ms));
+		expect(bitmap.takeDirty(x, y, w, h));
+		expect(x == 2 && y == 1 && w == 3 && h == 2);
+		expect(samePixel(bitmap, 2, 1, Palette[3]));
+		expect(animation.due() == start + 150ms); // No delay means 100ms
+
+		// The last frame went back to transparent, the transparent pixels of this one show what's behind
+		waitForFrames(animation, 2);
+		std::vector<uint8_t> before(bitmap.data(), bitmap.data() + W * H * 4);
+		expect(animation.advance(start + 150ms));
+		expect(samePixel(bitmap, 2, 1, Palette[0], 0));
+		expect(samePixel(bitmap, 6, 3, Palette[1]));
+		expect(memcmp(bitmap.data() + (3 * W + 5) * 4, before.data() + (3 * W + 5) * 4, 4) == 0);
+		expect(animation.due() == start + 170ms);
+
+		// Loops
+		waitForFrames(animation, 2);
+		expect(animation.advance(start + 170ms));
+		expect(matchesFirstFrame(bitmap));
+
+		// Far behind: Skips what's buffered, then waits for the workers instead of skipping more
+		waitForFrames(animation, 2);
+		auto late = start + 10s;
+		expect(animation.advance(late));
+		expect(animation.due() == late + AnimatedBitmap::PollInterval);
+		expect(animation.buffered() <= 2u);
+	}
+
+	test_hint("stills end");
+	{
+		std::vector<GifFrame> still(1, frames[0]);
+		auto data = encodeGif(W, H, still);
+		AnimatedBitmap animation;
+		animation.open(copy(data), data.size(), pool);
+		waitForFrames(animation, 1);
+
+		auto now = std::chrono::steady_clock::now();
+		expect(animation.advance(now));
+		expect(matchesFirstFrame(*animation.bitmap()));
+		auto timeout = now + 5s;
+		while(animation.due() != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() < timeout) {
+			now += 100ms;
+			expect(!animation.advance(now));
+			std::this_thread::sleep_for(1ms);
+		}
+		expect(animation.due() == std::chrono::steady_clock::time_point::max());
+	}
+
+	test_hint("frames off the screen");
+	{
+		// Partly off the screen, interlaced; far off the screen; bigger than the screen with only a few pixels of data
+		std::vector<GifFrame> off(3);
+		off[0] = GifFrame{ 6, 4, 4, 4, std::vector<uint8_t>(16, 2), 0, 1, -1, true };
+		off[1] = GifFrame{ 100, 100, 3, 3, std::vector<uint8_t>(9, 3) };
+		off[2] = GifFrame{ 0, 0, 65535, 65535, { 1, 1, 1, 1 } };
+		auto data = encodeGif(W, H, off);
+		AnimatedBitmap animation;
+		animation.open(copy(data), data.size(), pool, 3);
+		auto& bitmap = *animation.bitmap();
+		waitForFrames(animation, 3);
+		expect_eq(animation.buffered(), 3u);
+
+		auto now = std::chrono::steady_clock::now();
+		unsigned x, y, w, h;
+		bitmap.takeDirty(x, y, w, h);
+		expect(animation.advance(now));
+		expect(bitmap.takeDirty(x, y, w, h));
+		expect(x == 6 && y == 4 && w == 2 && h == 2);
+		expect(samePixel(bitmap, 7, 5, Palette[2]));
+		expect(samePixel(bitmap, 5, 5, Palette[0], 0));
+
+		now += 100ms;
+		expect(animation.advance(now));
+		expect(!bitmap.takeDirty(x, y, w, h));
+
+		now += 100ms;
+		expect(animation.advance(now));
+		expect(samePixel(bitmap, 3, 0, Palette[1]));
+		expect(samePixel(bitmap, 4, 0, Palette[0])); // Pixels without data get the first color
+	}
+
+	test_hint("screen too big");
+	{
+		auto data = encodeGif(5000, 5000, std::vector<GifFrame>(1, GifFrame{ 0, 0, 1, 1, { 1 } }));
+		AnimatedBitmap animation;
+		expect_exception(std::runtime_error, [&]() { animation.open(copy(data), data.size(), pool); });
+	}
+
+	test_hint("no gif");
+	{
+		AnimatedBitmap animation;
+		std::vector<uint8_t> data(32, 0);
+		expect_exception(std::runtime_error, [&]() { animation.open(copy(data), data.size(), pool); });
+		expect_exception(std::runtime_error, [&]() { animation.open("/nonexistent.gif", pool); });
+	}
+}
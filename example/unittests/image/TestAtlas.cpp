@@ -0,0 +1,121 @@
+#include "../Test.hpp"
+
+#include <wwidget/Atlas.hpp>
+#include <wwidget/Bitmap.hpp>
+
+#include <vector>
+
+using namespace wwidget;
+
+static std::shared_ptr<Bitmap> makeBitmap(unsigned w, unsigned h, uint8_t value) {
+	auto result = std::make_shared<Bitmap>();
+	result->init(w, h, Bitmap::RGBA);
+	for(size_t i = 0; i < size_t(w) * h * 4; i++) result->data()[i] = value;
+	return result;
+}
+
+static bool overlap(AtlasRegion const& a, AtlasRegion const& b) {
+	return a.page == b.page &&
+		a.x < b.x + b.width + Atlas::Padding && b.x < a.x + a.width + Atlas::Padding &&
+		a.y < b.y + b.height + Atlas::Padding && b.y < a.y + a.height + Atlas::Padding;
+}
+
+void testAtlas() {
+	test_hint("place and copy");
+	{
+		Atlas atlas(64, 32, 1);
+		auto a = makeBitmap(10, 5, 7);
+		auto region = atlas.place(a);
+		expect(region.has_value());
+		if(region) {
+			expect_eq(region->width, 10u);
+			expect_eq(region->height, 5u);
+			expect_eq(region->x, Atlas::Padding);
+			auto& page = *atlas.page(region->page);
+			expect_eq(page.data()[(region->y * 64 + region->x) * 4], 7);
+			// The padding repeats the edges
+			expect_eq(page.data()[((region->y - 1) * 64 + region->x - 1) * 4], 7);
+			expect_eq(page.data()[((region->y + 5) * 64 + region->x + 10) * 4], 7);
+		}
+		expect(atlas.dirty(0));
+		atlas.markUploaded(0);
+
+		auto again = atlas.place(a);
+		expect(again && again->x == region->x && again->y == region->y);
+		expect(!atlas.dirty(0));
+
+		expect(!atlas.place(makeBitmap(33, 2, 0)));
+		expect(!atlas.place(nullptr));
+	}
+
+	test_hint("no overlaps");
+	{
+		Atlas atlas(128, 64, 2);
+		std::vector<std::shared_ptr<Bitmap>> bitmaps;
+		std::vector<AtlasRegion>             regions;
+		for(unsigned i = 0; i < 40; i++) {
+			bitmaps.push_back(makeBitmap(5 + i % 11, 4 + (i * 7) % 13, (uint8_t) i));
+			auto region = atlas.place(bitmaps.back());
+			expect(region.has_value());
+			if(region) regions.push_back(*region);
+		}
+		for(size_t i = 0; i < regions.size(); i++) {
+			for(size_t j = i + 1; j < regions.size(); j++) {
+				expect(!overlap(regions[i], regions[j]));
+			}
+			expect(regions[i].x + regions[i].width  + Atlas::Padding <= 128);
+			expect(regions[i].y + regions[i].height + Atlas::Padding <= 128);
+		}
+	}
+
+	test_hint("eviction and repacking");
+	{
+		// One page with room for four 30x30 bitmaps
+		Atlas atlas(64, 30, 1);
+		std::vector<std::shared_ptr<Bitmap>> bitmaps;
+		for(int i = 0; i < 4; i++) {
+			bitmaps.push_back(makeBitmap(30, 30, (uint8_t) i));
+			expect(atlas.place(bitmaps.back()).has_value());
+		}
+		// Full, and everything was drawn in this frame
+		auto extra = makeBitmap(30, 30, 9);
+		expect(!atlas.place(extra));
+
+		// A released bitmap makes room in the next frame
+		atlas.nextFrame();
+		bitmaps.erase(bitmaps.begin() + 1);
+		auto region = atlas.place(extra);
+		expect(region.has_value());
+		expect_eq(atlas.size(), 4u);
+		if(region) expect_eq(atlas.page(0)->data()[(region->y * 64 + region->x) * 4], 9);
+		for(auto& bitmap : bitmaps) {
+			auto r = atlas.place(bitmap);
+			expect(r && atlas.page(0)->data()[(r->y * 64 + r->x) * 4] == bitmap->data()[0]);
+		}
+
+		// Otherwise the least recently used one goes
+		atlas.nextFrame();
+		atlas.place(bitmaps[1]);
+		atlas.place(bitmaps[2]);
+		atlas.place(extra);
+		atlas.nextFrame();
+		auto another = makeBitmap(30, 30, 11);
+		expect(atlas.place(another).has_value());
+		expect_eq(atlas.size(), 4u);
+		expect(!atlas.place(bitmaps[0])); // Evicted, and the page is in use in this frame
+		atlas.nextFrame();
+		auto r = atlas.place(bitmaps[0]);
+		expect(r && atlas.page(0)->data()[(r->y * 64 + r->x) * 4] == 0);
+	}
+
+	test_hint("new pixels are placed again");
+	{
+		Atlas atlas(64, 32, 1);
+		auto a = makeBitmap(8, 8, 1);
+		atlas.place(a);
+		a->init(8, 8, Bitmap::RGBA);
+		for(size_t i = 0; i < 8 * 8 * 4; i++) a->data()[i] = 5;
+		auto region = atlas.place(a);
+		expect(region && atlas.page(0)->data()[(region->y * 64 + region->x) * 4] == 5);
+	}
+}
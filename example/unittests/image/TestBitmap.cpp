@@ -0,0 +1,173 @@
+#include "../Test.hpp"
+
+#include <wwidget/Attributes.hpp>
+#include <wwidget/Bitmap.hpp>
+#include <wwidget/Error.hpp>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace wwidget;
+
+void testBitmap() {
+	// A 2x1 binary ppm
+	std::string ppm = "P6\n2 1\n255\n";
+	ppm += std::string("\x01\x02\x03\x04\x05\x06", 6);
+
+	test_hint("load from memory");
+	{
+		Bitmap bitmap;
+		bitmap.load((uint8_t const*) ppm.data(), ppm.size());
+		expect_eq(bitmap.width(), 2u);
+		expect_eq(bitmap.height(), 1u);
+		expect_eq(bitmap.format(), Bitmap::RGB);
+		expect_eq(bitmap.data()[3], 4);
+
+		bitmap.load((uint8_t const*) ppm.data(), ppm.size(), Bitmap::RGBA);
+		expect_eq(bitmap.format(), Bitmap::RGBA);
+		expect_eq(bitmap.data()[7], 255);
+
+		expect_exception(std::runtime_error, [&]() { bitmap.load((uint8_t const*) "garbage", 7); });
+	}
+
+	test_hint("load from a file");
+	{
+		std::string path = test_path("bitmap.ppm");
+		test_write_file(path, ppm.data(), ppm.size());
+		Bitmap bitmap;
+		bitmap.load(path);
+		expect_eq(bitmap.width(), 2u);
+		expect_eq(bitmap.data()[5], 6);
+
+		expect_exception(std::runtime_error, [&]() { bitmap.load(test_path("does-not-exist.png")); });
+	}
+
+	test_hint("map raw pixels");
+	{
+		// A header to skip, then 2x2 RGBA
+		std::string path = test_path("bitmap.raw");
+		uint8_t file[8 + 16];
+		for(size_t i = 0; i < sizeof(file); i++) file[i] = (uint8_t) i;
+		test_write_file(path, file, sizeof(file));
+
+		auto bitmap = std::make_shared<Bitmap>();
+		bitmap->map(path, 8, 2, 2, Bitmap::RGBA);
+		expect_eq(bitmap->format(), Bitmap::RGBA);
+		expect_eq(bitmap->data()[0], 8);
+		expect_eq(bitmap->data()[15], 23);
+
+		// Copy-on-write: The file stays as it is
+		bitmap->swapRedBlue();
+		expect_eq(bitmap->data()[0], 10);
+		Bitmap again;
+		again.map(path, 8, 2, 2, Bitmap::RGBA);
+		expect_eq(again.data()[0], 8);
+
+		// Bitmaps sharing the pixels keep the mapping alive
+		Bitmap shared = bitmap->toRGBA();
+		bitmap.reset();
+		expect_eq(shared.data()[15], 23);
+
+		expect_exception(std::runtime_error, [&]() { again.map(path, 12, 2, 2, Bitmap::RGBA); });
+		expect_exception(std::runtime_error, [&]() { again.map(path, 100, 1, 1, Bitmap::ALPHA); });
+	}
+
+	test_hint("dirty areas");
+	{
+		Bitmap bitmap;
+		bitmap.init(10, 10, Bitmap::RGBA);
+		unsigned x, y, w, h;
+		expect(!bitmap.live());
+		expect(!bitmap.takeDirty(x, y, w, h));
+
+		bitmap.markDirty(Rect(1.5f, 2, 2, 1));
+		bitmap.markDirty(Rect(6, 4, 10, 1)); // Clamped to the bitmap
+		expect(bitmap.live());
+		expect(bitmap.takeDirty(x, y, w, h));
+		expect_eq(x, 1u); expect_eq(y, 2u);
+		expect_eq(w, 9u); expect_eq(h, 3u);
+		expect(!bitmap.takeDirty(x, y, w, h));
+	}
+
+	test_hint("double buffering");
+	{
+		Bitmap bitmap;
+		bitmap.init(4, 4, Bitmap::ALPHA);
+		expect_exception(exceptions::InvalidOperation, [&]() { bitmap.beginWrite(); });
+		bitmap.enableDoubleBuffering();
+		expect(!bitmap.swapBuffers());
+
+		std::thread producer([&bitmap]() {
+			uint8_t* back = bitmap.beginWrite();
+			back[5] = 7;
+			bitmap.endWrite(Rect(1, 1, 1, 1));
+		});
+		producer.join();
+		expect_eq(bitmap.data()[5], 0); // Not swapped in yet
+		expect(bitmap.swapBuffers());
+		expect_eq(bitmap.data()[5], 7);
+
+		unsigned x, y, w, h;
+		expect(bitmap.takeDirty(x, y, w, h));
+		expect_eq(x, 1u); expect_eq(w, 1u);
+
+		// The back buffer was brought up to date, a write elsewhere keeps the first one
+		uint8_t* back = bitmap.beginWrite();
+		expect_eq(back[5], 7);
+		back[0] = 3;
+		bitmap.endWrite(Rect(0, 0, 1, 1));
+		expect(bitmap.swapBuffers());
+		expect_eq(bitmap.data()[0], 3);
+		expect_eq(bitmap.data()[5], 7);
+
+		// Renderers don't wait for a producer which is writing
+		bitmap.beginWrite();
+		std::thread renderer([&bitmap]() { expect(!bitmap.swapBuffers()); });
+		renderer.join();
+		bitmap.endWrite();
+	}
+
+	test_hint("release pixels");
+	{
+		std::string path = test_path("release.ppm");
+		test_write_file(path, ppm.data(), ppm.size());
+
+		Bitmap bitmap;
+		bitmap.load(path);
+		expect(bitmap.reloadable());
+		expect_eq(bitmap.cpuBytes(), 6u);
+		expect_eq(bitmap.gpuBytes(), 0u);
+		expect(bitmap.releasePixels());
+		expect(!bitmap.resident());
+		expect_eq(bitmap.cpuBytes(), 0u);
+		expect_eq(bitmap.width(), 2u);
+
+		// Only comes back when asked to
+		expect(bitmap.data() == nullptr);
+		std::vector<uint8_t> scratch;
+		expect_exception(exceptions::InvalidOperation, [&]() { bitmap.rgba(scratch); });
+		bitmap.reload();
+		expect_eq(bitmap.data()[3], 4);
+		expect(bitmap.resident());
+		expect_eq(bitmap.cpuBytes(), 6u);
+
+		// Changed in place: Reloading would lose that
+		bitmap.markDirty();
+		expect(!bitmap.reloadable());
+		expect(!bitmap.releasePixels());
+
+		Bitmap generated;
+		generated.init(2, 2, Bitmap::RGBA);
+		expect(!generated.releasePixels());
+		expect(generated.resident());
+
+		// The file changed its size meanwhile
+		Bitmap changed;
+		changed.load(path);
+		changed.releasePixels();
+		test_write_ppm(path, 3, 1, [](size_t) { return uint8_t(1); });
+		expect_exception(std::runtime_error, [&]() { changed.reload(); });
+	}
+}
@@ -0,0 +1,110 @@
+#include "../Test.hpp"
+
+#include <wwidget/Bitmap.hpp>
+#include <wwidget/ImageCache.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace wwidget;
+
+static std::shared_ptr<Bitmap> makeBitmap(unsigned w, unsigned h) {
+	auto result = std::make_shared<Bitmap>();
+	result->init(w, h, Bitmap::RGBA);
+	return result;
+}
+
+void testImageCache() {
+	test_hint("footprint");
+	{
+		auto bitmap = makeBitmap(64, 32);
+		expect_eq(ImageCache::footprint(*bitmap), 64u * 32 * 4);
+		bitmap->generateMips(16);
+		expect_eq(ImageCache::footprint(*bitmap), 64u * 32 * 4 + 32 * 16 * 4 + 16 * 8 * 4);
+	}
+
+	test_hint("released images stay warm");
+	{
+		ImageCache cache(1 << 20);
+		cache.insert("a", makeBitmap(16, 16));
+		expect(cache.find("a") != nullptr);
+		expect_eq(cache.size(), 1u);
+		expect_eq(cache.bytes(), 16u * 16 * 4);
+		expect(cache.find("b") == nullptr);
+	}
+
+	test_hint("first insert wins");
+	{
+		ImageCache cache;
+		auto first  = cache.insert("a", makeBitmap(4, 4));
+		auto second = cache.insert("a", makeBitmap(4, 4));
+		expect(first == second);
+		expect_eq(cache.size(), 1u);
+	}
+
+	test_hint("least recently used is evicted");
+	{
+		// Room for 4 images of 1KiB
+		ImageCache cache(4 * 1024);
+		for(int i = 0; i < 4; i++) {
+			cache.insert(std::to_string(i), makeBitmap(16, 16));
+		}
+		cache.find("0");
+		cache.insert("4", makeBitmap(16, 16));
+		expect_eq(cache.size(), 4u);
+		expect(cache.bytes() <= 4u * 1024);
+		// Shards keep their own order, so only the total is exact. "0" was just used, "4" was just added.
+		expect(cache.find("0") != nullptr);
+		expect(cache.find("4") != nullptr);
+	}
+
+	test_hint("used images aren't evicted");
+	{
+		ImageCache cache(1024);
+		auto used = cache.insert("used", makeBitmap(16, 16));
+		// The caller holds the new image until insert returns, it goes on the next eviction
+		cache.insert("released", makeBitmap(16, 16));
+		cache.insert("other", makeBitmap(16, 16));
+		expect(cache.find("used") == used);
+		expect(cache.find("released") == nullptr);
+
+		cache.trim(0);
+		expect(cache.find("used") == used);
+		used.reset();
+		cache.trim(0);
+		expect_eq(cache.size(), 0u);
+		expect_eq(cache.bytes(), 0u);
+	}
+
+	test_hint("budget and clear");
+	{
+		ImageCache cache(1 << 20);
+		for(int i = 0; i < 10; i++) {
+			cache.insert(std::to_string(i), makeBitmap(16, 16));
+		}
+		cache.budget(2048);
+		expect_eq(cache.size(), 2u);
+		cache.erase("nothing");
+		cache.clear();
+		expect_eq(cache.size(), 0u);
+		expect_eq(cache.bytes(), 0u);
+	}
+
+	test_hint("concurrent use");
+	{
+		ImageCache cache(64 * 1024);
+		std::vector<std::thread> threads;
+		for(int t = 0; t < 4; t++) {
+			threads.emplace_back([&cache, t]() {
+				for(int i = 0; i < 500; i++) {
+					auto url = std::to_string((i * 7 + t) % 100);
+					if(!cache.find(url)) cache.insert(url, makeBitmap(16, 16));
+				}
+			});
+		}
+		for(auto& t : threads) t.join();
+		expect(cache.bytes() <= 64u * 1024);
+		expect_eq(cache.bytes(), cache.size() * 1024);
+	}
+}
@@ -0,0 +1,83 @@
+#include "../Test.hpp"
+
+#include <wwidget/Bitmap.hpp>
+#include <wwidget/ImageCache.hpp>
+#include <wwidget/Runtime.hpp>
+
+#include <string>
+
+using namespace wwidget;
+
+void testMips() {
+	test_hint("scaledDown");
+	{
+		auto bitmap = std::make_shared<Bitmap>();
+		bitmap->init(200, 100, Bitmap::RGBA);
+		for(size_t i = 0; i < size_t(200) * 100 * 4; i++) bitmap->data()[i] = 100;
+		auto small = bitmap->scaledDown(50);
+		expect_eq(small->width(), 50u);
+		expect_eq(small->height(), 25u);
+		expect_eq(small->sourceWidth(), 200u);
+		expect_eq(small->sourceHeight(), 100u);
+		expect_eq(small->data()[0], 100);
+		expect_eq(bitmap->scaledDown(400)->width(), 200u);
+	}
+
+	test_hint("generateMips");
+	{
+		auto bitmap = std::make_shared<Bitmap>();
+		bitmap->init(256, 64, Bitmap::RGB);
+		bitmap->generateMips(16);
+		auto& mips = bitmap->mips();
+		expect_eq(mips.size(), 4u); // 128, 64, 32, 16
+		if(mips.size() == 4) {
+			expect_eq(mips[0]->width(), 128u);
+			expect_eq(mips[0]->height(), 32u);
+			expect_eq(mips[3]->width(), 16u);
+			expect_eq(mips[3]->height(), 4u);
+			expect_eq(mips[3]->sourceWidth(), 256u);
+		}
+
+		test_hint("level");
+		expect(bitmap->level(256, 64) == bitmap);
+		expect(bitmap->level(300, 10) == bitmap);
+		expect(bitmap->level(100, 20) == mips[0]);
+		expect(bitmap->level(64, 16) == mips[1]);
+		expect(bitmap->level(1, 1) == mips[3]);
+
+		bitmap->init(8, 8, Bitmap::RGB);
+		expect(bitmap->mips().empty());
+	}
+
+	test_hint("scaled url");
+	{
+		std::string path = test_path("mips.ppm");
+		test_write_ppm(path, 300, 150, [](size_t i) { return uint8_t(i % 3 == 0 ? 255 : 0); });
+
+		Runtime runtime(1);
+		auto scaled = runtime.loadImage(Runtime::scaledUrl(path, 64));
+		expect_eq(scaled->width(), 64u);
+		expect_eq(scaled->height(), 32u);
+		expect_eq(scaled->sourceWidth(), 300u);
+		expect_eq(scaled->data()[0], 255);
+		expect_eq(scaled->data()[1], 0);
+		expect_eq(scaled->mips().size(), 2u); // 32, 16
+		expect(runtime.loadImage(Runtime::scaledUrl(path, 64)) == scaled);
+
+		// Scaled images can be released too, they're scaled again when needed
+		auto usage = runtime.imageCache().usage();
+		expect(scaled->releasePixels());
+		expect_eq(runtime.imageCache().usage().cpu, usage.cpu - 64 * 32 * 3);
+		scaled->reload();
+		expect_eq(scaled->data()[0], 255);
+		expect_eq(runtime.imageCache().usage().cpu, usage.cpu);
+
+		// Smaller than asked for: Keeps its size, the full image doesn't get mips
+		auto full   = runtime.loadImage(path);
+		auto larger = runtime.loadImage(Runtime::scaledUrl(path, 1024));
+		expect(larger != full);
+		expect_eq(larger->width(), 300u);
+		expect(full->mips().empty());
+		expect(!larger->mips().empty());
+	}
+}
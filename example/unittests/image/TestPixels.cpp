@@ -0,0 +1,109 @@
+#include "../Test.hpp"
+
+#include <wwidget/Bitmap.hpp>
+#include <wwidget/Pixels.hpp>
+
+#include <cstring>
+#include <vector>
+
+using namespace wwidget;
+
+// The straightforward versions to compare against
+static void referenceRgbToRgba(uint8_t const* s, uint8_t* d, size_t n) {
+	for(size_t i = 0; i < n; i++) {
+		d[i*4+0] = s[i*3+0]; d[i*4+1] = s[i*3+1]; d[i*4+2] = s[i*3+2]; d[i*4+3] = 255;
+	}
+}
+static void referenceAlphaToRgba(uint8_t const* s, uint8_t* d, size_t n) {
+	for(size_t i = 0; i < n; i++) {
+		d[i*4+0] = d[i*4+1] = d[i*4+2] = 255; d[i*4+3] = s[i];
+	}
+}
+static void referencePremultiply(uint8_t* p, size_t n) {
+	for(size_t i = 0; i < n * 4; i++) {
+		if(i % 4 != 3) p[i] = (uint8_t) ((p[i] * p[i - i % 4 + 3] + 127) / 255);
+	}
+}
+
+void testPixels() {
+	test_hint(pixels::implementation());
+
+	// Odd sizes and offsets, so the vector loops, their tails and unaligned buffers all get their turn
+	std::vector<uint8_t> source(200 * 4 + 1);
+	for(size_t i = 0; i < source.size(); i++) source[i] = (uint8_t) (i * 97 + 13);
+
+	bool rgbOk = true, alphaOk = true, swapOk = true, premultiplyOk = true, noOverrun = true;
+	for(size_t count : {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 64, 199}) {
+		uint8_t const* s = source.data() + 1;
+		std::vector<uint8_t> expected(count * 4 + 8, 0xAB), result(count * 4 + 8, 0xAB);
+
+		referenceRgbToRgba(s, expected.data() + 1, count);
+		pixels::rgbToRgba(s, result.data() + 1, count);
+		rgbOk &= expected == result;
+
+		referenceAlphaToRgba(s, expected.data() + 1, count);
+		pixels::alphaToRgba(s, result.data() + 1, count);
+		alphaOk &= expected == result;
+
+		// Both ways and in place
+		memcpy(result.data() + 1, s, count * 4);
+		pixels::swapRedBlue(result.data() + 1, result.data() + 1, count);
+		for(size_t i = 0; i < count; i++) {
+			swapOk &= result[1 + i*4] == s[i*4+2] && result[1 + i*4+1] == s[i*4+1] && result[1 + i*4+2] == s[i*4] && result[1 + i*4+3] == s[i*4+3];
+		}
+		pixels::swapRedBlue(result.data() + 1, result.data() + 1, count);
+		swapOk &= memcmp(result.data() + 1, s, count * 4) == 0;
+
+		memcpy(expected.data() + 1, s, count * 4);
+		memcpy(result.data() + 1, s, count * 4);
+		referencePremultiply(expected.data() + 1, count);
+		pixels::premultiply(result.data() + 1, count);
+		premultiplyOk &= expected == result;
+
+		noOverrun &= result[0] == 0xAB && result[count * 4 + 1] == 0xAB;
+	}
+	expect(rgbOk);
+	expect(alphaOk);
+	expect(swapOk);
+	expect(premultiplyOk);
+	expect(noOverrun);
+
+	test_hint("premultiply edge values");
+	{
+		uint8_t p[] = { 255, 128, 0, 255,  255, 128, 1, 0,  200, 100, 50, 128,  255, 255, 255, 1 };
+		pixels::premultiply(p, 4);
+		expect_eq(p[0], 255); expect_eq(p[1], 128); expect_eq(p[2], 0); expect_eq(p[3], 255);
+		expect_eq(p[4], 0); expect_eq(p[6], 0); expect_eq(p[7], 0);
+		expect_eq(p[8], 100); expect_eq(p[9], 50); expect_eq(p[10], 25);
+		expect_eq(p[12], 1); expect_eq(p[15], 1);
+	}
+
+	test_hint("Bitmap::rgba");
+	{
+		Bitmap rgb;
+		rgb.init(3, 2, Bitmap::RGB);
+		rgb.data()[0] = 10;
+		std::vector<uint8_t> scratch;
+		auto* pixels = rgb.rgba(scratch);
+		expect(pixels == scratch.data());
+		expect_eq(scratch.size(), 24u);
+		expect_eq(pixels[0], 10);
+		expect_eq(pixels[3], 255);
+
+		// Only the rectangle, in place
+		rgb.data()[(1 * 3 + 2) * 3] = 20;
+		scratch.assign(24, 7);
+		pixels = rgb.rgba(scratch, 1, 1, 2, 1);
+		expect_eq(scratch.size(), 24u);
+		expect_eq(pixels[(1 * 3 + 2) * 4], 20);
+		expect_eq(pixels[(1 * 3 + 1) * 4 + 3], 255);
+		expect_eq(pixels[0], 7);
+		expect_eq(pixels[(1 * 3 + 0) * 4 + 3], 7);
+
+		Bitmap rgba = rgb.toRGBA();
+		expect(rgba.rgba(scratch) == rgba.data()); // No copy
+		expect(rgba.rgba(scratch, 0, 0, 1, 1) == rgba.data());
+		expect_eq(rgba.format(), Bitmap::RGBA);
+		expect_eq(rgba.data()[0], 10);
+	}
+}
@@ -0,0 +1,103 @@
+#include "../Test.hpp"
+
+#include <wwidget/Bitmap.hpp>
+#include <wwidget/Pixels.hpp>
+#include <wwidget/Runtime.hpp>
+#include <wwidget/Thumbnails.hpp>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+using namespace wwidget;
+
+/// A ppm of a single color
+static void writePpm(std::string const& path, unsigned w, unsigned h, uint8_t r, uint8_t g, uint8_t b) {
+	test_write_ppm(path, w, h, [=](size_t i) { return i % 3 == 0 ? r : i % 3 == 1 ? g : b; });
+}
+
+void testThumbnails() {
+	test_hint("downscale");
+	{
+		uint8_t from[] = { 0, 90, 180 };
+		uint8_t to[2];
+		pixels::downscale(from, 3, 1, to, 2, 1, 1);
+		expect_eq(to[0], 30);
+		expect_eq(to[1], 150);
+
+		uint8_t gray[] = { 10, 20, 30, 40,  50, 60, 70, 80 }; // 4x2
+		uint8_t one;
+		pixels::downscale(gray, 4, 2, &one, 1, 1, 1);
+		expect_eq(one, 45);
+	}
+
+	std::string image     = test_path("thumbnail.ppm");
+	std::string directory = test_path("thumbnails");
+	std::string pack      = directory + "/thumbs.pack";
+	writePpm(image, 200, 100, 10, 200, 30);
+
+	test_hint("create thumbnail");
+	{
+		ThumbnailCache cache(pack, 64);
+		expect(!cache.find(image));
+		auto thumbnail = cache.get(image);
+		expect_eq(thumbnail->width(), 64u);
+		expect_eq(thumbnail->height(), 32u);
+		expect_eq(thumbnail->data()[0], 10);
+		expect_eq(thumbnail->data()[1], 200);
+		expect(cache.find(image) == thumbnail);
+
+		// The cache doesn't hold it, it's read from the pack again
+		std::weak_ptr<Bitmap> created = thumbnail;
+		thumbnail = nullptr;
+		expect(created.expired());
+		thumbnail = cache.find(image);
+		expect(thumbnail != nullptr);
+		if(thumbnail) {
+			expect_eq(thumbnail->width(), 64u);
+			expect_eq(thumbnail->data()[1], 200);
+			expect_eq(thumbnail->data()[64 * 32 * 3 - 1], 30);
+		}
+	}
+
+	test_hint("thumbnail from the pack");
+	{
+		ThumbnailCache cache(pack, 64);
+		auto thumbnail = cache.find(image);
+		expect(thumbnail != nullptr);
+		if(thumbnail) {
+			expect_eq(thumbnail->width(), 64u);
+			expect_eq(thumbnail->format(), Bitmap::RGB);
+			expect_eq(thumbnail->data()[64 * 32 * 3 - 1], 30);
+		}
+
+		// Changed files get a new thumbnail
+		writePpm(image, 100, 100, 1, 2, 3);
+		expect(!cache.find(image));
+		thumbnail = cache.get(image);
+		expect_eq(thumbnail->height(), 64u);
+		expect_eq(thumbnail->data()[0], 1);
+	}
+
+	test_hint("other size");
+	{
+		ThumbnailCache cache(pack, 32);
+		expect(!cache.find(image)); // The pack was made for another size
+		expect_eq(cache.get(image)->width(), 32u);
+	}
+
+	test_hint("cut off pack");
+	{
+		{ ThumbnailCache cache(pack, 64); cache.get(image); }
+		if(FILE* f = fopen(pack.c_str(), "ab")) { fputs("garbage", f); fclose(f); }
+		{ ThumbnailCache cache(pack, 64); expect(cache.find(image) != nullptr); }
+	}
+
+	test_hint("thumbnail url");
+	{
+		auto runtime = std::make_shared<Runtime>(1);
+		runtime->thumbnailDirectory(directory);
+		auto bitmap = runtime->loadImage(Runtime::thumbnailUrl(image, 16));
+		expect_eq(bitmap->width(), 16u);
+	}
+}
@@ -0,0 +1,84 @@
+#include "../Test.hpp"
+
+#include <wwidget/Graveyard.hpp>
+#include <wwidget/widget/List.hpp>
+
+#include <chrono>
+
+using namespace wwidget;
+
+static int gDestroyed = 0;
+
+class Counted : public List {
+public:
+	~Counted() { ++gDestroyed; }
+};
+
+// Owns a member widget, which itself owns children
+class WithMember : public Counted {
+	Counted mMember;
+public:
+	WithMember() {
+		add(mMember);
+		mMember.add<Counted>();
+		mMember.add<Counted>();
+	}
+};
+
+void testGraveyard() {
+	test_hint("collect");
+	{
+		gDestroyed = 0;
+		List root;
+		Counted* a = root.add<Counted>();
+		a->add<Counted>()->add<Counted>();
+
+		Graveyard graveyard;
+		graveyard.collect(a->remove());
+		expect(!a->parent());
+		expect_eq(root.children(), (Widget*)nullptr);
+		expect_eq(graveyard.size(), 1u);
+		expect_eq(a->owner(), OWNER_GC1);
+
+		// Survives the first sweep, even with an unlimited budget
+		graveyard.sweep(std::chrono::steady_clock::time_point::max());
+		expect_eq(gDestroyed, 0);
+		expect_eq(a->owner(), OWNER_GC2);
+
+		graveyard.sweep(std::chrono::steady_clock::time_point::max());
+		expect_eq(gDestroyed, 3);
+		expect(graveyard.empty());
+	}
+
+	test_hint("time slicing");
+	{
+		gDestroyed = 0;
+		Graveyard graveyard;
+		auto root = std::make_unique<Counted>();
+		for(int i = 0; i < 100; i++) {
+			root->add<WithMember>();
+		}
+		graveyard.collect(std::move(root));
+		graveyard.sweep(std::chrono::steady_clock::time_point::max());
+
+		// Past deadline: Only the first batch is done
+		graveyard.sweep(std::chrono::steady_clock::time_point::min());
+		expect_eq(gDestroyed, 0);
+
+		size_t destroyed = graveyard.sweep(std::chrono::steady_clock::time_point::max());
+		expect_eq(destroyed, 1u + 100u + 200u); // Members are destroyed by their owners
+		expect_eq(gDestroyed, 1 + 100 * 4);
+		expect(graveyard.empty());
+	}
+
+	test_hint("clear");
+	{
+		gDestroyed = 0;
+		Graveyard graveyard;
+		auto root = std::make_unique<Counted>();
+		root->add<WithMember>();
+		graveyard.collect(std::move(root));
+		expect_eq(graveyard.clear(), 4u);
+		expect_eq(gDestroyed, 5);
+	}
+}
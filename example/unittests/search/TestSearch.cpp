@@ -0,0 +1,63 @@
+#include "../Test.hpp"
+
+#include <wwidget/widget/List.hpp>
+#include <wwidget/widget/Text.hpp>
+#include <wwidget/widget/Button.hpp>
+#include <wwidget/widget/TextField.hpp>
+
+using namespace wwidget;
+
+// Not registered with WWIDGET_TYPE, has to fall back to dynamic_cast
+class UnregisteredText : public Text {};
+
+void testSearch() {
+	test_hint("isA");
+	{
+		TextField field;
+		expect(field.isA<Widget>());
+		expect(field.isA<Text>());
+		expect(field.isA<TextField>());
+		expect(!field.isA<Button>());
+		expect(!field.isA<List>());
+
+		UnregisteredText unregistered;
+		expect(unregistered.isA<Text>());
+		expect(unregistered.isA<UnregisteredText>());
+		expect(!field.isA<UnregisteredText>());
+	}
+
+	test_hint("search");
+	{
+		List root;
+		List* a = root.add<List>();
+		List* b = root.add<List>();
+		Button* button = a->add<Button>();
+		Text*   text   = b->add<Text>("Hello");
+		text->name("hello");
+
+		expect_eq(root.search<Button>(), button);
+		expect_eq(root.search<Text>(), text);
+		expect_eq(root.search<TextField>(), (TextField*)nullptr);
+		expect_eq(root.search<Text>("hello"), text);
+		expect_eq(root.search<Button>("hello"), (Button*)nullptr);
+		expect_eq(text->searchParent<List>(), b);
+		expect_eq(text->searchParent<Button>(), (Button*)nullptr);
+
+		expect(root.descendantTypes() & Text::StaticType().bit);
+		expect(!(a->descendantTypes() & Text::StaticType().bit));
+
+		// Summaries have to follow tree mutations
+		a->add(text);
+		expect(a->descendantTypes() & Text::StaticType().bit);
+		expect(!(b->descendantTypes() & Text::StaticType().bit));
+		expect_eq(a->search<Text>(), text);
+		expect_eq(b->search<Text>(), (Text*)nullptr);
+
+		text->remove();
+		expect_eq(root.search<Text>(), (Text*)nullptr);
+
+		auto* unregistered = b->add<UnregisteredText>();
+		expect_eq(root.search<UnregisteredText>(), unregistered);
+		expect_eq(root.search<Text>(), (Text*)unregistered);
+	}
+}
@@ -0,0 +1,128 @@
+#include "../Test.hpp"
+
+#include <wwidget/Selector.hpp>
+#include <wwidget/widget/List.hpp>
+#include <wwidget/widget/WrappedList.hpp>
+#include <wwidget/widget/Text.hpp>
+#include <wwidget/widget/Button.hpp>
+#include <wwidget/widget/Image.hpp>
+#include <wwidget/Error.hpp>
+
+using namespace wwidget;
+
+void testSelector() {
+	List root;
+	List*        sidebar = root.add<List>();
+	WrappedList* grid    = root.add<WrappedList>();
+	sidebar->name("sidebar");
+
+	Button* ok = sidebar->add<Button>();
+	ok->text("Ok");
+	Text* okText = ok->search<Text>();
+	Text* title  = grid->add<Text>("Title");
+
+	test_hint("Selector::matches");
+	{
+		expect(Selector("Text").matches(title));
+		expect(Selector("text").matches(title));
+		expect(Selector("List").matches(grid));
+		expect(Selector("*").matches(ok));
+		expect(Selector("#sidebar").matches(sidebar));
+		expect(Selector(".generated").matches(okText));
+		expect(!Selector(".generated").matches(title));
+		expect(Selector("List Text.generated").matches(okText));
+		expect(Selector("#sidebar > Button").matches(ok));
+		expect(!Selector("#sidebar > Text").matches(okText));
+		expect(Selector("#sidebar Text").matches(okText));
+		expect(Selector("Slider, Button").matches(ok));
+	}
+
+	test_hint("Selector queries");
+	{
+		expect_eq(Selector("Text").all(&root).size(), 2u);
+		expect_eq(Selector("WrappedList > Text").first(&root), (Widget*)title);
+		expect_eq(Selector("#nothing").first(&root), (Widget*)nullptr);
+		expect_eq(Selector("List").all(sidebar).size(), 0u); // The root isn't part of the results
+		expect_eq(Selector("Text").first(&root), (Widget*)okText);
+
+		// Callbacks which return false stop the traversal
+		int visited = 0;
+		expect(!Selector("*").each(&root, [&](Widget*) { visited++; return false; }));
+		expect_eq(visited, 1);
+		expect(Selector("*").each(&root, [&](Widget*) { visited++; }));
+		expect(visited > 2);
+	}
+
+	test_hint("Selector parsing errors");
+	{
+		expect_exception(exceptions::ParsingError, [&]() { Selector("List >"); });
+		expect_exception(exceptions::ParsingError, [&]() { Selector("#"); });
+		expect_exception(exceptions::ParsingError, [&]() { Selector("List + Text"); });
+	}
+
+	test_hint("LiveSelection");
+	{
+		LiveSelection generated(&root, "List .generated");
+		int entered = 0, left = 0;
+		generated.onEnter([&](Widget*) { ++entered; });
+		generated.onLeave([&](Widget*) { ++left; });
+		expect_eq(generated.size(), 1u);
+		expect(generated.contains(okText));
+		expect_eq(entered, 1);
+
+		grid->add<Button>()->text("Cancel");
+		expect_eq(generated.size(), 2u);
+		expect_eq(entered, 2);
+
+		title->classes("generated");
+		expect(generated.contains(title));
+
+		sidebar->remove();
+		expect_eq(generated.size(), 2u);
+		expect(!generated.contains(okText));
+		expect_eq(left, 1);
+
+		LiveSelection named(&root, "#main Text");
+		expect(named.empty());
+		grid->name("main");
+		expect_eq(named.size(), 2u);
+	}
+
+	test_hint("observers which remove themselves");
+	{
+		struct OneShot : public TreeObserver {
+			Widget* root;
+			int     calls = 0;
+			OneShot(Widget* root) : root(root) { root->addObserver(this); }
+			void onAdded(Widget*) override {}
+			void onRemoved(Widget*) override {}
+			void onChanged(Widget*) override { calls++; root->removeObserver(this); }
+			void onObservedDestroyed(Widget*) override {}
+		};
+		OneShot first(&root), second(&root);
+		LiveSelection named(&root, "#renamed");
+		title->name("renamed");
+		expect_eq(first.calls, 1);
+		expect_eq(second.calls, 1);
+		expect(named.contains(title));
+		title->name("again");
+		expect_eq(first.calls, 1);
+		expect(named.empty());
+	}
+
+	test_hint("move assignment keeps live selections up to date");
+	{
+		Image* original = grid->add<Image>();
+		original->name("moved");
+		LiveSelection named(&root, "#moved");
+		expect(named.contains(original));
+		{
+			Image moved;
+			moved = std::move(*original); // Takes the place of original in the tree
+			expect(named.contains(&moved));
+			expect(!named.contains(original));
+			moved.remove().release(); // It's on the stack, the parent mustn't delete it
+		}
+		delete original;
+	}
+}
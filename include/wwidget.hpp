@@ -1,6 +1,7 @@
 #pragma once
 
 #include "wwidget/Widget.hpp"
+#include "wwidget/Selector.hpp"
 
 #include "wwidget/Window.hpp"
 
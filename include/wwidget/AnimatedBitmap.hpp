@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace wwidget {
+
+class Bitmap;
+class Threadpool;
+
+/// An animated GIF which is decoded while it plays, instead of all frames upfront.
+/// Workers decode a few frames ahead into a ring of buffers, which are reused when the animation loops,
+///  so a long animation takes as much memory as a short one: The mapped file, the ring and the frame on screen.
+/// advance() shows the frames on the ui thread and only copies the part which changed into bitmap().
+/// Loops forever, the loop count of the file is ignored.
+class AnimatedBitmap {
+	struct Decoder;
+	struct Shared;
+
+	std::shared_ptr<Shared>               mShared;
+	std::shared_ptr<Bitmap>               mBitmap;
+	std::chrono::steady_clock::time_point mDue;
+	bool                                  mStarted = false;
+
+	void decodeAhead();
+public:
+	/// How often advance() should look again while the workers are behind
+	static constexpr std::chrono::milliseconds PollInterval{10};
+	/// The biggest screen a GIF may have, in pixels. Frames are clipped to the screen.
+	static constexpr size_t MaxPixels = 4096 * 4096;
+
+	AnimatedBitmap();
+	~AnimatedBitmap();
+
+	AnimatedBitmap(AnimatedBitmap const&) = delete;
+	AnimatedBitmap& operator=(AnimatedBitmap const&) = delete;
+
+	/// Maps the GIF at path and starts decoding up to frames frames ahead on pool.
+	/// Only reads the header here, throws std::runtime_error if it's no GIF. Broken frames or running out of memory later stop the animation.
+	void open(std::string const& path, Threadpool& pool, size_t frames = 4);
+	/// Plays a GIF in memory, data is kept
+	void open(std::shared_ptr<uint8_t[]> data, size_t length, Threadpool& pool, size_t frames = 4);
+
+	/// Shows the frames which are due at now. Returns whether bitmap() changed. Only on the ui thread.
+	bool advance(std::chrono::steady_clock::time_point now);
+	/// When advance() has something to do again, time_point::max() if the animation ended or broke
+	std::chrono::steady_clock::time_point due() const noexcept { return mDue; }
+
+	/// The current frame as RGBA, changed in place. Transparent until the first frame is shown.
+	std::shared_ptr<Bitmap> const& bitmap() const noexcept { return mBitmap; }
+	/// How many frames are decoded and waiting
+	size_t buffered() const;
+	/// How many frames fit into the ring
+	size_t capacity() const noexcept;
+};
+
+} // namespace wwidget
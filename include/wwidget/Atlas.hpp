@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace wwidget {
+
+class Bitmap;
+
+/// Where a bitmap was placed in an Atlas. Excludes the padding around it.
+struct AtlasRegion {
+	unsigned page = 0;
+	unsigned x = 0, y = 0, width = 0, height = 0;
+};
+
+/// Packs small bitmaps into a few shared RGBA pages, so backends can draw many of them from one texture.
+/// Pages are filled with skyline packing. When they're full, the least recently used page which isn't drawn in the
+///  current frame is repacked: Released bitmaps are dropped, then the least recently used ones until the new one fits.
+/// Bitmaps are identified by address and data: Replacing the pixels with Bitmap::init places them again,
+///  changing them in place needs remove().
+/// Not threadsafe, it belongs to a canvas.
+class Atlas {
+	struct Segment {
+		unsigned x, y, width;
+	};
+	struct Page {
+		std::shared_ptr<Bitmap> bitmap;
+		std::vector<Segment>    skyline;
+		bool                    dirty = true;
+
+		void reset(unsigned size);
+		bool fit(unsigned width, unsigned height, unsigned size, unsigned& x, unsigned& y) const;
+		void add(unsigned x, unsigned y, unsigned width, unsigned height);
+	};
+	struct Entry {
+		std::weak_ptr<Bitmap> bitmap;
+		uint8_t const*        data;     //!< To notice when the bitmap got new pixels
+		AtlasRegion           region;
+		uint64_t              lastUse;
+		uint64_t              lastFrame;
+	};
+
+	unsigned mPageSize;
+	unsigned mMaxItemSize;
+	size_t   mMaxPages;
+	uint64_t mUses  = 0;
+	uint64_t mFrame = 1;
+	std::vector<Page>                        mPages;
+	std::unordered_map<Bitmap const*, Entry> mEntries;
+	std::vector<uint8_t>                     mScratch;
+
+	bool allocate(unsigned width, unsigned height, AtlasRegion& region);
+	bool reclaim(unsigned width, unsigned height, AtlasRegion& region);
+	void blit(Bitmap const& bitmap, AtlasRegion const& region);
+public:
+	static constexpr unsigned Padding = 1; //!< Around each bitmap, filled with its edges so filtering doesn't bleed
+
+	/// Up to maxPages pages of pageSize x pageSize pixels, for bitmaps up to maxItemSize pixels wide and high
+	Atlas(unsigned pageSize = 1024, unsigned maxItemSize = 128, size_t maxPages = 4);
+
+	/// Where bitmap is, placing it first if needed. Marks it as used in the current frame.
+	/// Nothing if it's too big, not in a valid format, its pixels are released or there's no room left this frame.
+	std::optional<AtlasRegion> place(std::shared_ptr<Bitmap> const& bitmap);
+	/// Frees the space of bitmap on the next repack
+	void remove(Bitmap const* bitmap);
+	/// Starts a new frame. Pages which were drawn in the last one may be repacked again.
+	void nextFrame() noexcept { ++mFrame; }
+
+	/// Whether bitmap fits into the atlas at all
+	bool accepts(Bitmap const& bitmap) const noexcept;
+
+	size_t pageCount() const noexcept { return mPages.size(); }
+	unsigned pageSize() const noexcept { return mPageSize; }
+	/// The RGBA pixels of a page
+	std::shared_ptr<Bitmap> const& page(size_t index) const noexcept { return mPages[index].bitmap; }
+	/// Whether the page changed since the last markUploaded
+	bool dirty(size_t index) const noexcept { return mPages[index].dirty; }
+	void markUploaded(size_t index) noexcept { mPages[index].dirty = false; }
+	/// How many bitmaps are placed
+	size_t size() const noexcept { return mEntries.size(); }
+};
+
+} // namespace wwidget
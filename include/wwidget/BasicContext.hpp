@@ -1,27 +1,75 @@
 #pragma once
 
 #include "Context.hpp"
+#include "FdWatcher.hpp"
+
+#include <chrono>
 
 namespace wwidget {
 
-class Font;
+class Runtime;
+class Threadpool;
+
+/// Counters for the deferred tasks of one priority. @see BasicContext::taskStats
+struct TaskStats {
+	size_t executed         = 0; //!< Tasks which ran
+	size_t postponed        = 0; //!< Summed up over all updates: Tasks which had to wait for the next update
+	size_t postponedUpdates = 0; //!< Updates which left tasks behind
+	size_t waiting          = 0; //!< Tasks the last update left behind
+};
 
 class BasicContext : public Context {
 	struct Implementation;
 
 	Implementation* mImpl;
 public:
+	/// Uses the runtime shared by the whole process. @see Runtime::shared
 	BasicContext();
+	/// Uses the given runtime, e.g. an isolated one with its own workers and caches
+	explicit BasicContext(std::shared_ptr<Runtime> runtime);
 	~BasicContext();
 
+	/// Evicts all cached images which aren't in use anymore, of all contexts of the runtime
 	void cleanCache();
 
-	void defer(std::function<void()>) override;
+	void defer(unique_task, TaskPriority priority = PRIORITY_NORMAL) override;
+	/// The timers run at the start of update(), before the deferred tasks
+	void deferUntil(std::chrono::steady_clock::time_point when, unique_task) override;
+	std::chrono::steady_clock::time_point now() const noexcept override;
+	/// When the earliest timer is due, time_point::max() without any. Event loops shouldn't sleep past it.
+	std::chrono::steady_clock::time_point nextTimer() const noexcept;
+	/// How long each update may spend on deferred tasks. Input tasks ignore it, the rest waits for the next update.
+	void taskBudget(std::chrono::microseconds budget) noexcept;
+	TaskStats const& taskStats(TaskPriority priority) const noexcept;
+	/// Called from any thread when deferred tasks arrive after the last update or a frame is requested.
+	/// Interrupts fdWatcher().wait(), override it to wake up other event loops which block.
+	virtual void wakeup();
+
+	/// Calls fn on the ui thread whenever fd is ready. @see FdWatcher::watch
+	/// The callbacks run in update(), or as soon as the fd is ready if the event loop waits with fdWatcher().
+	std::shared_ptr<FdWatch> watch(int fd, unique_function<void(int events)> fn, int events = FD_READABLE, Owner* owner = nullptr);
+	FdWatcher& fdWatcher() noexcept;
+
+	/// Whether the next frame would change anything: Tasks arrived, a timer is due, a widget needs a relayout or redraw,
+	/// an animation runs or somebody requested it. Event loops can sleep until input arrives, wakeup() is called or nextTimer() otherwise.
+	bool needsFrame() const noexcept;
+	/// Makes needsFrame() true until the next update and wakes up the event loop. Threadsafe.
+	void requestFrame();
 
-	void loadImage(std::function<void(std::shared_ptr<Bitmap>)>, std::string const& url) override;
+	void startAnimation() override;
+	void stopAnimation() override;
+
+	/// Requests for an url which is already being loaded share its decode, also with the other contexts of the runtime
+	std::shared_ptr<ImageRequest> loadImage(unique_function<void(std::shared_ptr<Bitmap>)>, std::string const& url, Owner* owner = nullptr, Widget* viewer = nullptr) override;
 
 	std::shared_ptr<Bitmap> loadImage(std::string const& url) override;
 
+	void collect(std::unique_ptr<Widget> w) override;
+	/// Destroys all collected widgets now
+	void collectGarbage();
+	/// How long each update may spend destroying collected widgets
+	void destructionBudget(std::chrono::microseconds budget) noexcept;
+
 	void execute(Widget* from, std::string_view cmd) override;
 	void execute(Widget* from, std::string_view const* cmds, size_t count) override;
 
@@ -33,6 +81,12 @@ public:
 
 	void canvas(std::shared_ptr<Canvas> c) noexcept;
 	Canvas& canvas() const noexcept override;
+
+	FrameArena& frameArena() noexcept override;
+
+	Runtime& runtime() noexcept override;
+	/// The workers of the runtime. @see Runtime::threadpool
+	Threadpool& threadpool() noexcept;
 };
 
 } // namespace wwidget
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace wwidget {
 
+struct Rect;
+
 class Bitmap : public std::enable_shared_from_this<Bitmap> {
 public:
 	enum Format {
@@ -13,12 +18,30 @@ public:
 		RGB     = 3,
 		RGBA    = 4
 	};
+	/// Whether the pixels stay in memory after a renderer has them in a texture
+	enum Residency {
+		KEEP_PIXELS,
+		RELEASE_AFTER_UPLOAD //!< Only if the bitmap has a reloader, renderers reload() the pixels when they need them again
+	};
 protected:
 	friend class Canvas;
 
+	/// The back buffer for a producer thread. @see beginWrite
+	struct Writer;
+
 	unsigned mWidth = 0, mHeight = 0;
+	unsigned mSourceWidth = 0, mSourceHeight = 0;
 	Format   mFormat = INVALID;
-	std::shared_ptr<uint8_t[]> mData;
+	mutable std::shared_ptr<uint8_t[]> mData; //!< nullptr while released
+	std::vector<std::shared_ptr<Bitmap>> mMips;
+	Residency mResidency = KEEP_PIXELS;
+	std::function<void(Bitmap& into)> mReloader;
+	unsigned mDirty[4] = { 0, 0, 0, 0 }; //!< Changed area as x0, y0, x1, y1, empty if x0 == x1
+	bool     mLive = false;
+	std::shared_ptr<Writer> mWriter;
+
+	void convertToRGBA(uint8_t* to) const;
+	void decode(uint8_t const* data, size_t length, Format preferredFormat, std::string const& source);
 public:
 	mutable std::shared_ptr<void> mRendererProxy;
 
@@ -26,15 +49,90 @@ public:
 	~Bitmap();
 
 	Bitmap toRGBA();
+	/// The pixels as RGBA. RGBA bitmaps are returned as they are, the others are converted into scratch, which can be reused.
+	/// Throws exceptions::InvalidOperation while the pixels are released.
+	uint8_t const* rgba(std::vector<uint8_t>& scratch) const;
+	/// Like rgba(), but only converts the pixels in the rectangle, e.g. the dirty area.
+	/// The result has the layout of the whole bitmap, the rest of scratch is left as it was.
+	uint8_t const* rgba(std::vector<uint8_t>& scratch, unsigned x, unsigned y, unsigned w, unsigned h) const;
+	/// Multiplies the colors of a RGBA bitmap with its alpha
+	void premultiply();
+	/// Turns a RGBA bitmap into BGRA and the other way around
+	void swapRedBlue();
+
+	/// A copy which fits into maxSize x maxSize, keeping the aspect ratio. Its source size stays the one of this bitmap.
+	/// Throws exceptions::InvalidOperation while the pixels are released.
+	std::shared_ptr<Bitmap> scaledDown(unsigned maxSize) const;
+	/// Creates the mips, each half the size of the one before, down to smallest pixels. Slow for big bitmaps, call it on a worker.
+	void generateMips(unsigned smallest = 16);
+	/// Smaller versions of this bitmap, biggest first. @see generateMips
+	std::vector<std::shared_ptr<Bitmap>> const& mips() const noexcept { return mMips; }
+	/// The smallest of this bitmap and its mips which covers width x height pixels, this one if none does.
+	/// The bitmap has to be owned by a shared_ptr.
+	std::shared_ptr<Bitmap> level(float width, float height);
 
 	void init(std::shared_ptr<uint8_t[]> data, unsigned w, unsigned h, Format fmt);
 	void init(unsigned w, unsigned h, Format fmt);
+	/// Decodes an image file. The file is mapped into memory instead of read.
 	void load(std::string const& url, Format preferredFormat = DEFAULT);
+	/// Decodes an encoded image (png, jpeg, ...) in memory
 	void load(uint8_t const* data, size_t length, Format preferredFormat = DEFAULT);
+	/// Uses raw pixels at offset in a file without copying or decoding them, e.g. from a cache of decoded images.
+	/// The file is mapped copy-on-write: The bitmap can be modified, the file stays as it is. It's unmapped with the last user of the pixels.
+	void map(std::string const& path, size_t offset, unsigned w, unsigned h, Format fmt);
 	void free();
 
+	/// Marks pixels which were changed in place, so renderers update that part of their textures.
+	/// Only on the ui thread, producers on other threads use beginWrite.
+	void markDirty(Rect const& area);
+	void markDirty();
+	/// The area changed since the last call, false if there's none. For renderers.
+	bool takeDirty(unsigned& x, unsigned& y, unsigned& w, unsigned& h) noexcept;
+	/// How to get the pixels back after releasePixels: It loads them into a bitmap of the same size and format.
+	/// load() and map() set one, init() and changing the pixels in place remove it.
+	void reloader(std::function<void(Bitmap& into)> fn) { mReloader = std::move(fn); }
+	bool reloadable() const noexcept { return bool(mReloader); }
+	Residency residency() const noexcept { return mResidency; }
+	void residency(Residency r) noexcept { mResidency = r; }
+	/// Drops the pixels if the bitmap can reload them, reload() brings them back. Only on the ui thread.
+	/// Returns whether they were dropped.
+	bool releasePixels() noexcept;
+	/// Brings released pixels back with the reloader. Decodes the source again, so it's as slow as loading it. Only on the ui thread.
+	/// Does nothing if the pixels are there. Throws std::runtime_error if the source can't be loaded anymore or changed its size.
+	void reload();
+	/// Whether the pixels are in memory
+	bool resident() const noexcept { return mData || !mReloader; }
+	/// How much memory the pixels take, 0 while released. Without the mips.
+	size_t cpuBytes() const noexcept;
+	/// How much memory the texture of a renderer takes, if there is one. Textures are RGBA.
+	size_t gpuBytes() const noexcept;
+
+	/// Whether the pixels changed after the bitmap was created. Renderers keep these in textures of their own.
+	bool live() const noexcept { return mLive; }
+
+	/// Adds a back buffer, so a producer thread can fill the next image while the current one is drawn.
+	/// Call it on the ui thread before handing the bitmap to the producer. Mips are dropped, they'd be outdated.
+	void enableDoubleBuffering();
+	/// Gives the producer the back buffer, which holds the current image. Blocks while renderers swap buffers.
+	/// Throws exceptions::InvalidOperation unless enableDoubleBuffering was called.
+	uint8_t* beginWrite();
+	/// Finishes the write, changed is what was written. Renderers swap it in the next time they draw the bitmap,
+	///  so defer a requestRedraw to the ui thread afterwards.
+	void endWrite(Rect const& changed);
+	void endWrite();
+	/// Makes the last finished write the current image. On the ui thread, doesn't wait for a producer which is writing.
+	/// Returns whether it swapped.
+	bool swapBuffers();
+
+	/// Reads only the header and returns how many bytes the decoded image will take. 0 if it can't be read.
+	static size_t decodedSize(std::string const& url) noexcept;
+
 	inline unsigned width()  const noexcept { return mWidth; }
 	inline unsigned height() const noexcept { return mHeight; }
+	/// The size of the image this bitmap was scaled down from, its own size otherwise
+	inline unsigned sourceWidth()  const noexcept { return mSourceWidth; }
+	inline unsigned sourceHeight() const noexcept { return mSourceHeight; }
+	/// The pixels. nullptr while they're released, call reload() first if !resident(). Never decodes anything.
 	inline uint8_t* data()   const noexcept { return mData.get(); }
 	inline Format   format() const noexcept { return mFormat; }
 };
@@ -24,6 +24,8 @@ public:
 	virtual Canvas& beginFrame(Size const& frame_size, float dpi) = 0;
 	virtual Canvas& endFrame() = 0;
 	virtual Canvas& cancelFrame() = 0;
+	/// Whether some textures were only drawn as placeholders and need another frame
+	virtual bool uploadsPending() const noexcept { return false; }
 
 	// State
 	virtual Canvas& pushState() = 0;
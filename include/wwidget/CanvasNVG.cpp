@@ -2,13 +2,38 @@
 
 #include "Bitmap.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <mutex>
 
 namespace wwidget {
 
+struct CanvasNVG::ReleasedTextures {
+	std::mutex       mutex;
+	std::vector<int> textures;
+};
+
+struct CanvasNVG::Texture {
+	int                             id;
+	std::weak_ptr<ReleasedTextures> canvas;
+
+	Texture(int id, std::weak_ptr<ReleasedTextures> canvas) : id(id), canvas(std::move(canvas)) {}
+	Texture(Texture const&) = delete;
+	Texture& operator=(Texture const&) = delete;
+	~Texture() {
+		// Whoever drops the bitmap might not be on the gl thread
+		if(auto released = canvas.lock()) {
+			auto l = std::lock_guard<std::mutex>(released->mutex);
+			released->textures.push_back(id);
+		}
+	}
+};
+
 CanvasNVG::CanvasNVG(NVGcontext* ctxt, PFNContextClose close_ctxt) :
 	m_context(ctxt),
-	m_close_ctxt(close_ctxt)
+	m_close_ctxt(close_ctxt),
+	m_released_textures(std::make_shared<ReleasedTextures>())
 {
 	for(auto [name, path] : std::initializer_list<std::pair<const char*, const char*>>{
 		{"mono", "/usr/share/fonts/TTF/DejaVuSansMono.ttf"},
@@ -22,39 +47,162 @@ CanvasNVG::CanvasNVG(NVGcontext* ctxt, PFNContextClose close_ctxt) :
 	nvgAddFallbackFont(m_context, "sans", "icon");
 }
 CanvasNVG::~CanvasNVG() {
+	deleteReleasedTextures();
+	m_released_textures.reset();
+	for(int texture : m_atlas_textures) {
+		nvgDeleteImage(m_context, texture);
+	}
 	if(m_close_ctxt) {
 		m_close_ctxt(m_context);
 	}
 }
 
-int CanvasNVG::getHandle(std::shared_ptr<Bitmap> const& bm) {
-	if(bm->mRendererProxy) {
-		return (int)(size_t)bm->mRendererProxy.get();
+/// The texture of bm on this canvas, -1 if it wasn't uploaded here
+int CanvasNVG::texture(Bitmap const& bm) const noexcept {
+	auto* proxy = static_cast<Texture const*>(bm.mRendererProxy.get());
+	// Compares the control blocks, which stay unique as long as the proxy exists, even if its canvas is gone
+	bool mine = proxy && !proxy->canvas.owner_before(m_released_textures) && !m_released_textures.owner_before(proxy->canvas);
+	return mine ? proxy->id : -1;
+}
+
+int CanvasNVG::upload(std::shared_ptr<Bitmap> const& bm) {
+	if(int existing = texture(*bm); existing >= 0) {
+		return existing;
 	}
 	else {
-		int texture = nvgCreateImageRGBA(
+		// Another canvas' texture is replaced, that canvas deletes it
+		m_uploaded_bytes += size_t(bm->width()) * bm->height() * 4;
+		// Released after another canvas uploaded it
+		bm->reload();
+		// RGBA is uploaded straight from the bitmap
+		int id = nvgCreateImageRGBA(
 			m_context,
 			bm->width(), bm->height(),
 			NVG_IMAGE_REPEATX | NVG_IMAGE_REPEATY,
-			bm->toRGBA().data()
+			bm->rgba(m_upload_buffer)
 		);
-		assert(texture >= 0);
-		bm->mRendererProxy = {
-			(void*)(size_t)texture,
-			[this](void* vp) {
-				nvgDeleteImage(m_context, (int)(size_t)vp);
-			}
-		};
-		return texture;
+		assert(id >= 0);
+		unsigned x, y, w, h;
+		bm->takeDirty(x, y, w, h); // All of it is up to date
+		// The texture has the pixels now. Small ones go into the atlas, keep those.
+		if(bm->residency() == Bitmap::RELEASE_AFTER_UPLOAD && !m_atlas.accepts(*bm)) {
+			bm->releasePixels();
+		}
+		// Don't hold on to the size of the biggest photo ever shown
+		if(m_upload_buffer.capacity() > (16u << 20)) {
+			m_upload_buffer = {};
+		}
+		bm->mRendererProxy = std::make_shared<Texture>(id, m_released_textures);
+		return id;
+	}
+}
+
+/// The texture to draw bm with: Its own, a lower mip while it waits for the upload, or -1 if there's nothing yet
+int CanvasNVG::getHandle(std::shared_ptr<Bitmap> const& bm, Rect const& to) {
+	if(bm->live()) {
+		bm->swapBuffers();
+	}
+	if(int existing = texture(*bm); existing >= 0) {
+		if(bm->live()) updateTexture(*bm, existing);
+		return existing;
+	}
+	size_t bytes = size_t(bm->width()) * bm->height() * 4;
+	if(m_uploaded_bytes == 0 || m_uploaded_bytes + bytes <= m_upload_budget) {
+		return upload(bm);
+	}
+
+	float xform[6];
+	nvgCurrentTransform(m_context, xform);
+	float area = std::abs(to.width() * to.height() * (xform[0] * xform[3] - xform[1] * xform[2]));
+	auto& pending = m_pending_uploads[bm.get()];
+	if(pending.bitmap.lock() != bm) {
+		pending = PendingUpload{ bm, area, m_frame };
+	}
+	else {
+		pending.area  = pending.frame == m_frame ? std::max(pending.area, area) : area;
+		pending.frame = m_frame;
+	}
+
+	// The biggest mip which is there already, or the smallest one, which is cheap
+	auto& mips = bm->mips();
+	for(auto& mip : mips) {
+		if(int existing = texture(*mip); existing >= 0) return existing;
+	}
+	return mips.empty() ? -1 : upload(mips.back());
+}
+/// Uploads what changed. Live bitmaps aren't held back by the budget, they'd lag behind.
+void CanvasNVG::updateTexture(Bitmap& bm, int texture) {
+	unsigned x, y, w, h;
+	if(!bm.takeDirty(x, y, w, h)) return;
+	m_uploaded_bytes += size_t(w) * h * 4;
+	// Only the changed rows and columns, nvgUpdateImage would upload all of it
+	NVGparams* params = nvgInternalParams(m_context);
+	params->renderUpdateTexture(params->userPtr, texture, (int) x, (int) y, (int) w, (int) h, bm.rgba(m_upload_buffer, x, y, w, h));
+}
+void CanvasNVG::processUploads() {
+	m_uploaded_bytes = 0;
+	if(m_pending_uploads.empty()) return;
+
+	// Only what was drawn in the last frame, the ones covering the most screen first
+	auto& queue = m_upload_queue;
+	for(auto& [key, pending] : m_pending_uploads) {
+		auto bm = pending.bitmap.lock();
+		if(bm && texture(*bm) < 0 && pending.frame + 1 >= m_frame) {
+			queue.emplace_back(pending, std::move(bm));
+		}
+	}
+	m_pending_uploads.clear();
+	std::sort(queue.begin(), queue.end(), [](auto& a, auto& b) { return a.first.area > b.first.area; });
+
+	for(auto& [pending, bm] : queue) {
+		size_t bytes = size_t(bm->width()) * bm->height() * 4;
+		if(m_uploaded_bytes == 0 || m_uploaded_bytes + bytes <= m_upload_budget) {
+			upload(bm);
+		}
+		else {
+			m_pending_uploads.emplace(bm.get(), pending);
+		}
+	}
+	queue.clear();
+}
+
+int CanvasNVG::getAtlasHandle(AtlasRegion const& region) {
+	while(m_atlas_textures.size() <= region.page) {
+		auto& page = m_atlas.page(m_atlas_textures.size());
+		m_atlas_textures.push_back(nvgCreateImageRGBA(m_context, page->width(), page->height(), 0, page->data()));
+		m_atlas.markUploaded(m_atlas_textures.size() - 1);
+	}
+	return m_atlas_textures[region.page];
+}
+void CanvasNVG::deleteReleasedTextures() {
+	auto& released = *m_released_textures;
+	auto l = std::lock_guard<std::mutex>(released.mutex);
+	for(int texture : released.textures) {
+		nvgDeleteImage(m_context, texture);
+	}
+	released.textures.clear();
+}
+void CanvasNVG::uploadAtlas() {
+	// Once per frame instead of after each new bitmap, nanovg only draws in nvgEndFrame
+	for(size_t i = 0; i < m_atlas_textures.size(); i++) {
+		if(m_atlas.dirty(i)) {
+			nvgUpdateImage(m_context, m_atlas_textures[i], m_atlas.page(i)->data());
+			m_atlas.markUploaded(i);
+		}
 	}
 }
 
 // Frame
 Canvas& CanvasNVG::beginFrame(Size const& frame_size, float dpi) {
+	m_atlas.nextFrame();
+	++m_frame;
+	deleteReleasedTextures();
+	processUploads();
 	nvgBeginFrame(m_context, frame_size.x, frame_size.y, dpi);
 	return *this;
 }
 Canvas& CanvasNVG::endFrame() {
+	uploadAtlas();
 	nvgEndFrame(m_context);
 	return *this;
 }
@@ -115,12 +263,33 @@ Canvas& CanvasNVG::fillColor(Color const& color) {
 	return *this;
 }
 Canvas& CanvasNVG::fillTexture(Rect const& to, std::shared_ptr<Bitmap> const& bm, Color const& tint) {
+	if(auto region = bm->live() ? std::nullopt : m_atlas.place(bm)) {
+		// Scales the whole page so the region covers the target
+		float sx = to.width()  / region->width;
+		float sy = to.height() / region->height;
+		nvgFillPaint(m_context,
+			nvgImagePattern(m_context,
+				to.min.x - region->x * sx, to.min.y - region->y * sy,
+				m_atlas.pageSize() * sx, m_atlas.pageSize() * sy,
+				0,
+				getAtlasHandle(*region),
+				1
+			)
+		);
+		return *this;
+	}
+	int texture = getHandle(bm, to);
+	if(texture < 0) {
+		// Placeholder until the upload
+		nvgFillColor(m_context, nvgRGBA(128, 128, 128, 64));
+		return *this;
+	}
 	nvgFillPaint(m_context,
 		nvgImagePattern(m_context,
 			to.min.x, to.min.y, // Translation
 			to.width(), to.height(), // Scale
 			0, // rotation
-			getHandle(bm), // image
+			texture, // image
 			1 // alpha
 		)
 	);
@@ -131,12 +300,17 @@ Canvas& CanvasNVG::strokeColor(Color const& color) {
 	return *this;
 }
 Canvas& CanvasNVG::strokeTexture(Rect const& to, std::shared_ptr<Bitmap> const& bm, Color const& tint) {
+	int texture = getHandle(bm, to);
+	if(texture < 0) {
+		nvgStrokeColor(m_context, nvgRGBA(128, 128, 128, 64));
+		return *this;
+	}
 	nvgStrokePaint(m_context,
 		nvgImagePattern(m_context,
 			to.min.x, to.min.y, // Translation
 			to.width() / bm->width(), to.height() / bm->height(), // Scale
 			0, // rotation
-			getHandle(bm), // image
+			texture, // image
 			1 // alpha
 		)
 	);
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "Atlas.hpp"
 #include "Attributes.hpp"
 #include "Canvas.hpp"
 
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 extern "C" {
 	#include <nanovg.h>
@@ -18,12 +21,44 @@ class CanvasNVG final : public Canvas {
 
 	NVGcontext* m_context;
 	PFNContextClose m_close_ctxt;
-
-	int getHandle(std::shared_ptr<Bitmap> const& bm);
+	std::vector<uint8_t> m_upload_buffer; //!< For converting bitmaps which aren't RGBA yet
+	struct ReleasedTextures;
+	/// Textures of bitmaps which went away, deleted in beginFrame(). Bitmaps can go on any thread (e.g. evicted from the image cache by a worker),
+	///  but only this one may touch the gl context. Textures of bitmaps which outlive the canvas aren't deleted through it.
+	std::shared_ptr<ReleasedTextures> m_released_textures;
+	struct Texture; //!< What a bitmap's renderer proxy points to: The texture and the canvas it belongs to
+	Atlas m_atlas; //!< Small bitmaps share these textures instead of getting one each
+	std::vector<int> m_atlas_textures; //!< One per atlas page
+
+	struct PendingUpload {
+		std::weak_ptr<Bitmap> bitmap;
+		float                 area;  //!< On screen, in pixels
+		uint64_t              frame; //!< When it was last drawn
+	};
+	size_t   m_upload_budget  = 8 << 20; //!< Bytes per frame
+	size_t   m_uploaded_bytes = 0;       //!< In this frame
+	uint64_t m_frame          = 0;
+	std::unordered_map<Bitmap const*, PendingUpload> m_pending_uploads;
+	std::vector<std::pair<PendingUpload, std::shared_ptr<Bitmap>>> m_upload_queue; //!< Kept between frames, so sorting them doesn't allocate
+
+	int texture(Bitmap const& bm) const noexcept;
+	int upload(std::shared_ptr<Bitmap> const& bm);
+	void updateTexture(Bitmap& bm, int texture);
+	int getHandle(std::shared_ptr<Bitmap> const& bm, Rect const& to);
+	void processUploads();
+	int getAtlasHandle(AtlasRegion const& region);
+	void uploadAtlas();
+	void deleteReleasedTextures();
 public:
 	CanvasNVG(NVGcontext* ctxt, PFNContextClose close_ctxt = nullptr);
 	~CanvasNVG();
 
+	/// How many bytes of textures are uploaded per frame. Bitmaps over it are drawn from a lower mip or as placeholder,
+	///  and uploaded in the next frames, the ones which cover the most screen first. A single bitmap always fits.
+	CanvasNVG& uploadBudget(size_t bytes) noexcept { m_upload_budget = bytes; return *this; }
+	size_t uploadBudget() const noexcept { return m_upload_budget; }
+	bool uploadsPending() const noexcept override { return !m_pending_uploads.empty(); }
+
 	// Frame
 	Canvas& beginFrame(Size const& frame_size, float dpi) override;
 	Canvas& endFrame() override;
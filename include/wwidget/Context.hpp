@@ -2,9 +2,36 @@
 
 #include "Widget.hpp"
 
+#include "async/UniqueTask.hpp"
+
+#include <atomic>
+#include <chrono>
+
 namespace wwidget {
 
 class Font;
+class FrameArena;
+class Runtime;
+
+/// A pending asynchronous image load. @see Context::loadImage
+class ImageRequest {
+protected:
+	std::atomic<float> mPriority;
+	Widget*            mViewer; //!< Only used on the ui thread
+public:
+	ImageRequest(float priority, Widget* viewer) noexcept : mPriority(priority), mViewer(viewer) {}
+	virtual ~ImageRequest() {}
+
+	/// Drops the load if it didn't start yet. Either way the callback won't be called anymore. Only call it on the ui thread.
+	virtual void cancel() = 0;
+
+	/// Loads with smaller values start first. 0 means the viewer is visible, otherwise it's its distance to the visible area in pixels.
+	float priority() const noexcept { return mPriority.load(std::memory_order_relaxed); }
+	void  priority(float p) noexcept { mPriority.store(p, std::memory_order_relaxed); }
+
+	/// The widget whose visibility defines the priority. nullptr once the request is done or cancelled.
+	Widget* viewer() const noexcept { return mViewer; }
+};
 
 enum RessourceId {
 	URL_ROOT,
@@ -24,16 +51,40 @@ public:
 	Context();
 	virtual ~Context();
 
-	virtual void defer(std::function<void()>) = 0;
+	/// Runs the task on the ui thread during a later update. Threadsafe.
+	virtual void defer(unique_task, TaskPriority priority = PRIORITY_NORMAL) = 0;
+	/// Runs the task on the ui thread during the first update at or after when. Only call it on the ui thread.
+	virtual void deferUntil(std::chrono::steady_clock::time_point when, unique_task) = 0;
+	/// When the current update started. Everything that moves with time uses it, so a frame shows a single point in time.
+	virtual std::chrono::steady_clock::time_point now() const noexcept = 0;
 
 	virtual std::string getRessource(RessourceId res);
 
 	virtual Canvas& canvas() const noexcept = 0;
 
+	/// Memory for temporaries which is reclaimed at the end of each frame. Only use it on the ui thread. @see FrameArena
+	virtual FrameArena& frameArena() noexcept = 0;
+
+	/// The workers and caches this context shares with others. @see Runtime
+	virtual Runtime& runtime() noexcept = 0;
+
 	virtual std::shared_ptr<Bitmap> loadImage(std::string const& url) = 0;
-	virtual void                    loadImage(
-		std::function<void(std::shared_ptr<Bitmap>)>,
-		std::string const& url) = 0;
+	/// Loads the image on a worker and calls the callback with the result on the ui thread.
+	/// If owner is given, clearing its ownerships cancels the request. While the request is pending,
+	/// it's prioritized by the distance of viewer to the visible area, so the viewer has to live as long as the owner.
+	/// Returns nullptr if the image was cached and the callback has already been called.
+	virtual std::shared_ptr<ImageRequest> loadImage(
+		unique_function<void(std::shared_ptr<Bitmap>)>,
+		std::string const& url,
+		Owner*  owner  = nullptr,
+		Widget* viewer = nullptr) = 0;
+
+	/// While at least one animation runs, every frame gets drawn. Balance each startAnimation() with a stopAnimation().
+	virtual void startAnimation() = 0;
+	virtual void stopAnimation() = 0;
+
+	/// Takes a detached widget and destroys it during a later update. @see Widget::destroy
+	virtual void collect(std::unique_ptr<Widget> w) = 0;
 
 	virtual void execute(Widget* from, std::string_view cmd) = 0;
 	virtual void execute(Widget* from, std::string_view const* cmds, size_t count) = 0;
@@ -33,6 +33,12 @@ public:
 	Unimplemented();
 };
 
+/// Something which was waited for got cancelled. @see Future
+class Cancelled : public AnyError {
+public:
+	Cancelled();
+};
+
 class InvalidPointer : public AnyError {
 public:
 	InvalidPointer(std::string const& argumentName);
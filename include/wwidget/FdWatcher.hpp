@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Ownership.hpp"
+
+#include "async/UniqueTask.hpp"
+
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+
+namespace wwidget {
+
+class FdWatcher;
+
+enum FdEvents {
+	FD_READABLE = 1,
+	FD_WRITABLE = 2,
+	FD_HANGUP   = 4, //!< Only reported, never asked for. Cancel the watch, or it's reported over and over.
+};
+
+/// A file descriptor which is watched by a FdWatcher. @see FdWatcher::watch
+class FdWatch final : public OwnedObject {
+	friend class FdWatcher;
+
+	FdWatcher*                 mWatcher; //!< nullptr once cancelled
+	int                        mFd;
+	int                        mEvents;
+	unique_function<void(int)> mCallback;
+
+	void becameOrphan() override { cancel(); }
+public:
+	FdWatch(FdWatcher* watcher, int fd, int events, unique_function<void(int)> callback) :
+		mWatcher(watcher), mFd(fd), mEvents(events), mCallback(std::move(callback))
+	{}
+
+	/// Stops watching. The callback isn't called anymore, the fd stays open. Only call it on the ui thread.
+	void cancel();
+
+	int  fd()     const noexcept { return mFd; }
+	bool active() const noexcept { return mWatcher; }
+};
+
+/// Waits for file descriptors (pipes, sockets, eventfds, inotify, device handles, ...) and calls back when they're ready.
+/// Everything but interrupt() belongs to the ui thread. Needs epoll, so it only watches on linux.
+class FdWatcher {
+	int mEpoll     = -1;
+	int mInterrupt = -1; //!< An eventfd, so other threads can cut a wait short
+
+	std::unordered_map<int, std::shared_ptr<FdWatch>> mWatches;
+
+	friend class FdWatch;
+	void remove(FdWatch* watch);
+public:
+	FdWatcher();
+	~FdWatcher();
+
+	FdWatcher(FdWatcher const&) = delete;
+	FdWatcher& operator=(FdWatcher const&) = delete;
+
+	/// Calls fn with the FdEvents which happened whenever fd is ready for events, until the watch is cancelled.
+	/// If owner is given, clearing its ownerships cancels the watch. Each fd can only be watched once.
+	std::shared_ptr<FdWatch> watch(int fd, unique_function<void(int events)> fn, int events = FD_READABLE, Owner* owner = nullptr);
+
+	bool empty() const noexcept { return mWatches.empty(); }
+
+	/// Blocks until a watched fd is ready, interrupt() is called or the timeout passed, then runs the callbacks of the ready fds.
+	/// A negative timeout waits forever, zero just looks. Returns how many callbacks ran.
+	size_t wait(std::chrono::milliseconds timeout);
+	/// Makes the current or next wait() return. Threadsafe.
+	void interrupt() noexcept;
+};
+
+} // namespace wwidget
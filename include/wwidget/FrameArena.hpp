@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace wwidget {
+
+/// A bump allocator for temporaries which only have to live until the end of the frame.
+///  Deallocation is a no-op, all memory is reclaimed at once by reset().
+///  It keeps its memory between frames, so once it has grown to the size a frame
+///  needs it doesn't touch the global heap anymore.
+///  Not threadsafe, only use it on the ui thread. @see Context::frameArena
+class FrameArena final : public std::pmr::memory_resource {
+	struct Block {
+		Block* next;
+		size_t size;
+	};
+
+	Block* mBlocks;
+	char*  mCursor;
+	char*  mEnd;
+
+	size_t mUsed;
+	size_t mCapacity;
+	size_t mHighWater;
+
+	void addBlock(size_t minSize);
+	void freeBlocks() noexcept;
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void  do_deallocate(void* p, size_t bytes, size_t alignment) override;
+	bool  do_is_equal(std::pmr::memory_resource const& other) const noexcept override;
+
+public:
+	FrameArena(size_t initialSize = 64 * 1024);
+	~FrameArena();
+
+	FrameArena(FrameArena const&) = delete;
+	FrameArena& operator=(FrameArena const&) = delete;
+
+	/// Frees everything allocated since the last reset. If the frame didn't fit into one block,
+	/// the blocks get merged into a single one, so the next frame fits.
+	void reset() noexcept;
+
+	size_t used()      const noexcept { return mUsed; }      //!< Bytes allocated since the last reset
+	size_t capacity()  const noexcept { return mCapacity; }  //!< Bytes reserved
+	size_t highWater() const noexcept { return mHighWater; } //!< The most bytes a single frame used
+};
+
+// Containers for frame temporaries. Construct them with Context::frameArena or Widget::frameMemory
+template<class T>
+using FrameVector = std::pmr::vector<T>;
+using FrameString = std::pmr::string;
+
+} // namespace wwidget
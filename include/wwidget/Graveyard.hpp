@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace wwidget {
+
+class Widget;
+
+/// Destroys detached widgets in small batches, so dropping a large subtree doesn't stall a frame.
+///  Collected widgets are in the young generation (OWNER_GC1) until the next sweep, so
+///  code which is still running on them (e.g. the click handler which removed them) stays valid.
+///  After that they are promoted to the old generation (OWNER_GC2) and taken apart from the
+///  leafs up, a few widgets at a time.
+///  Widget destructors touch the renderer (e.g. Bitmap proxies) and run virtual callbacks, so all
+///  of this happens on the ui thread.
+class Graveyard {
+	std::vector<Widget*> mYoung;
+	std::vector<Widget*> mOld;
+
+	bool destroyStep();
+public:
+	Graveyard();
+	~Graveyard();
+
+	Graveyard(Graveyard const&) = delete;
+	Graveyard& operator=(Graveyard const&) = delete;
+
+	/// Takes ownership of a detached widget and destroys it in a later sweep.
+	void collect(std::unique_ptr<Widget> w);
+
+	/// Destroys old widgets until the deadline and promotes the young ones. Returns the number of destroyed widgets.
+	size_t sweep(std::chrono::steady_clock::time_point deadline);
+	/// Destroys all collected widgets now.
+	size_t clear();
+
+	bool   empty() const noexcept { return mYoung.empty() && mOld.empty(); }
+	size_t size()  const noexcept { return mYoung.size() + mOld.size(); } //!< The number of pending subtrees
+};
+
+} // namespace wwidget
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace wwidget {
+
+class Bitmap;
+
+/// Decoded images by url, kept warm after their last user lets go until the byte budget is used up.
+/// Urls are spread over shards with a lock each, so lookups of different urls rarely contend.
+/// Each shard keeps its own least recently used order, eviction goes through the shards one after another.
+/// Images which are still used elsewhere are never evicted, they'd only be decoded a second time.
+class ImageCache {
+	static constexpr size_t ShardCount = 16;
+
+	struct Shard {
+		struct Entry {
+			std::shared_ptr<Bitmap>          bitmap;
+			size_t                           bytes;
+			std::list<std::string>::iterator lru;
+		};
+
+		std::mutex                             mutex;
+		std::unordered_map<std::string, Entry> entries;
+		std::list<std::string>                 lru; //!< Most recently used first
+
+		/// Drops released entries, least recently used first, until freed bytes are gone or none are left
+		size_t evict(size_t bytes);
+	};
+
+	Shard               mShards[ShardCount];
+	std::atomic<size_t> mBytes;
+	std::atomic<size_t> mBudget;
+	std::atomic<size_t> mNextEviction; //!< The shard where the next eviction starts
+
+	Shard& shard(std::string const& url) noexcept;
+	void evictDownTo(size_t bytes, size_t first);
+public:
+	/// Memory of the cached images right now, including their mips
+	struct Usage {
+		size_t cpu = 0; //!< Pixels in memory, released ones don't count
+		size_t gpu = 0; //!< Textures of renderers
+	};
+
+	/// How many bytes an image takes in memory when its pixels are there, including its mips
+	static size_t footprint(Bitmap const& bitmap) noexcept;
+
+	explicit ImageCache(size_t budget = 128 << 20);
+
+	ImageCache(ImageCache const&) = delete;
+	ImageCache& operator=(ImageCache const&) = delete;
+
+	/// The image of url and marks it as recently used, nullptr if it isn't cached
+	std::shared_ptr<Bitmap> find(std::string const& url);
+	/// Caches bitmap for url and returns it. If another thread was faster, its bitmap is returned instead.
+	/// Evicts released images if this goes over the budget.
+	std::shared_ptr<Bitmap> insert(std::string const& url, std::shared_ptr<Bitmap> bitmap);
+	/// Forgets the image of url. Its users keep it.
+	void erase(std::string const& url);
+
+	/// Evicts released images until at most bytes are cached, or only used ones are left
+	void trim(size_t bytes);
+	/// Evicts all images, its users keep them
+	void clear();
+
+	/// How many bytes of images may be cached. Shrinking it evicts right away.
+	void budget(size_t bytes);
+	size_t budget() const noexcept { return mBudget; }
+	/// Bytes of all cached images, including the ones in use. What the budget counts, also for released pixels.
+	size_t bytes() const noexcept { return mBytes; }
+	/// Where the memory of the cached images is. Goes through all of them.
+	Usage usage();
+	/// How many images are cached
+	size_t size();
+};
+
+} // namespace wwidget
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace wwidget {
+
+/// The whole file in memory, mapped copy-on-write where possible, otherwise read.
+/// Writing to it never changes the file. The memory is unmapped or freed with the last shared_ptr.
+/// Throws std::runtime_error if the file can't be opened or is empty.
+std::shared_ptr<uint8_t[]> mapFile(std::string const& path, size_t& length);
+
+} // namespace wwidget
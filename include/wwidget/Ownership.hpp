@@ -18,8 +18,8 @@ public:
 	OwnedObject() {}
 	~OwnedObject() { removeFromOwner(); }
 
-	OwnedObject(OwnedObject&& other) { *this = (OwnedObject&&)other; }
-	OwnedObject& operator=(OwnedObject&& other) {
+	OwnedObject(OwnedObject&& other) noexcept { *this = (OwnedObject&&)other; }
+	OwnedObject& operator=(OwnedObject&& other) noexcept {
 		mLast = other.mLast;
 		if(mLast) *mLast = this;
 		mNext = other.mNext;
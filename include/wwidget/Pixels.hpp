@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wwidget {
+
+/// Conversions between pixel formats. The fastest implementation the cpu supports is picked on first use (AVX2, SSSE3, SSE2 or plain C++).
+/// Buffers don't need any alignment. Unless noted otherwise, source and destination must not overlap.
+namespace pixels {
+
+/// RGB to RGBA with opaque alpha
+void rgbToRgba(uint8_t const* rgb, uint8_t* rgba, size_t count) noexcept;
+/// Alpha to white RGBA with that alpha
+void alphaToRgba(uint8_t const* alpha, uint8_t* rgba, size_t count) noexcept;
+/// Swaps red and blue, RGBA to BGRA and the other way around. rgba and bgra may be the same buffer.
+void swapRedBlue(uint8_t const* rgba, uint8_t* bgra, size_t count) noexcept;
+/// Multiplies the color channels of RGBA or BGRA with alpha, in place
+void premultiply(uint8_t* rgba, size_t count) noexcept;
+
+/// Scales an image with 1 to 4 channels down by averaging the area each target pixel covers (a box filter).
+/// Any ratio works, targets bigger than the source are clamped to it.
+void downscale(
+	uint8_t const* from, unsigned width, unsigned height,
+	uint8_t* to, unsigned toWidth, unsigned toHeight,
+	unsigned channels);
+
+/// Which implementation is used: "avx2", "ssse3", "sse2" or "scalar"
+const char* implementation() noexcept;
+
+} // namespace pixels
+
+} // namespace wwidget
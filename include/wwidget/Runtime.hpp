@@ -0,0 +1,86 @@
+#pragma once
+
+#include "async/UniqueTask.hpp"
+
+#include <memory>
+#include <string>
+
+namespace wwidget {
+
+class Bitmap;
+class Canvas;
+class Context;
+class ImageCache;
+class ImageRequest;
+class Owner;
+class Threadpool;
+class Widget;
+
+/// What the contexts of a process share: The workers, the image cache, the decodes in flight and the fonts.
+///  Contexts use shared() unless they're given a runtime of their own.
+class Runtime {
+	struct Implementation;
+	struct ImageJob;
+	struct ImageDecode;
+
+	Implementation* mImpl;
+
+	void loadNextImage();
+public:
+	/// An isolated runtime with Threadpool::defaultSize() workers
+	Runtime();
+	/// An isolated runtime with its own workers and caches
+	explicit Runtime(size_t threads);
+	~Runtime();
+
+	Runtime(Runtime const&) = delete;
+	Runtime& operator=(Runtime const&) = delete;
+
+	/// The runtime of the process. It's created on first use and lives as long as somebody holds it.
+	static std::shared_ptr<Runtime> shared();
+
+	/// The workers for image loading etc. Call start() on it to change the number of threads.
+	Threadpool& threadpool() noexcept;
+	/// The decoded images of all contexts. Configure how much it keeps warm with ImageCache::budget.
+	ImageCache& imageCache() noexcept;
+
+	/// Loads the image on the calling thread, or takes it from the cache. @see thumbnailUrl
+	std::shared_ptr<Bitmap> loadImage(std::string const& url);
+	/// @see Context::loadImage. The callback is deferred to context.
+	/// Requests for an url which is already being loaded share its decode, even when they come from different contexts.
+	std::shared_ptr<ImageRequest> loadImage(
+		Context* context,
+		unique_function<void(std::shared_ptr<Bitmap>)> fn,
+		std::string const& url,
+		Owner*  owner  = nullptr,
+		Widget* viewer = nullptr);
+	/// Updates the priorities of context's pending loads by the visibility of their viewers. Only call it on context's ui thread.
+	void reprioritizeImageLoads(Context* context);
+	/// Cancels all loads of context. Nothing gets deferred to it afterwards.
+	void detach(Context* context);
+	/// How many bytes of decoded images may be in flight at once. A single image is always allowed, however big.
+	void decodeBudget(size_t bytes) noexcept;
+	/// The most bytes which were in flight at once so far
+	size_t peakDecodeBytes() noexcept;
+
+	/// Whether images loaded from now on drop their pixels once a renderer uploaded them. They're decoded again when needed.
+	/// Halves the memory of image heavy interfaces, but bitmaps which are drawn by several canvases are decoded again for each.
+	void releasePixelsAfterUpload(bool enable) noexcept;
+
+	/// Loading this url gives a thumbnail of the image file at path, at most size pixels wide and high.
+	/// Thumbnails are stored in a ThumbnailCache, so they're only created once.
+	static std::string thumbnailUrl(std::string const& path, unsigned size = 64);
+	/// Loading this url gives the image file at path scaled down to at most size pixels wide and high, with mips.
+	/// Images which are smaller keep their size. The bitmap's sourceWidth() and sourceHeight() are the ones of the file.
+	static std::string scaledUrl(std::string const& path, unsigned size);
+	/// Where the thumbnail packs are stored. Defaults to the URL_CACHE_DIR of the first context which loads a thumbnail.
+	/// Only has an effect before the first thumbnail is loaded.
+	void thumbnailDirectory(std::string directory);
+
+	/// Makes a font available to all canvases of this runtime's contexts
+	void registerFont(std::string name, std::string path);
+	/// Registers the fonts from the index first on the canvas and returns the index to continue from next time
+	size_t registerFonts(Canvas& canvas, size_t first) const;
+};
+
+} // namespace wwidget
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "Widget.hpp"
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+namespace wwidget {
+
+/// A compiled css-like selector.
+/// Supported syntax:
+///  - `Type`: Matches widgets which are a Type (including subclasses, e.g. `List` matches a `WrappedList`). Case insensitive.
+///  - `*`: Matches any widget
+///  - `#name`: Matches widgets with the name
+///  - `.class`: Matches widgets with the class
+///  - `A B`: Matches B if it has an ancestor A
+///  - `A > B`: Matches B if its parent is A
+///  - `A, B`: Matches A or B
+/// e.g. `List Text.generated` or `#sidebar > Button`
+class Selector {
+	struct Compound {
+		std::string              type;
+		mutable TypeMask         typeBit = 0; //<! Resolved on first match
+		std::string              name;
+		std::vector<std::string> classes;
+		bool                     childOf = false; //<! Combinator to the left is '>' instead of a descendant combinator
+
+		bool matches(Widget const* w) const noexcept;
+	};
+	using Complex = std::vector<Compound>;
+
+	std::string          mSource;
+	std::vector<Complex> mAlternatives;
+
+	bool matchComplex(Complex const& c, size_t idx, Widget const* w, Widget const* scope) const noexcept;
+	TypeMask candidateTypes() const noexcept;
+
+	template<typename C>
+	bool eachCandidate(Widget* w, TypeMask types, C&& c) const;
+public:
+	/// Compiles a selector. Throws a exceptions::ParsingError if it's invalid.
+	Selector(std::string_view selector);
+	~Selector();
+
+	/// Returns whether w matches. Combinators don't look past the scope (if it isn't a nullptr).
+	bool matches(Widget const* w, Widget const* scope = nullptr) const noexcept;
+
+	/// Returns the first matching descendant of root (pre-order) or a nullptr
+	Widget* first(Widget* root) const;
+	/// Returns all matching descendants of root in pre-order
+	std::vector<Widget*> all(Widget* root) const;
+	/// Calls c for each matching descendant of root in pre-order.
+	/// If c returns a bool, returning false stops the traversal. Returns false if it was stopped.
+	template<typename C>
+	bool each(Widget* root, C&& c) const;
+	/// Calls c for each matching widget in the subtree w (including w) with combinators scoped to root. @see each
+	template<typename C>
+	bool eachIn(Widget* root, Widget* w, C&& c) const;
+
+	std::string const& source() const noexcept { return mSource; }
+};
+
+/// A cached result set of a Selector, which is updated incrementally when the tree changes.
+/// The order of the results is unspecified.
+class LiveSelection final : public TreeObserver {
+	Widget*                     mRoot;
+	Selector                    mSelector;
+	std::unordered_set<Widget*> mResults;
+
+	std::function<void(Widget*)> mOnEnter;
+	std::function<void(Widget*)> mOnLeave;
+
+	void update(Widget* w);
+	void erase(Widget* w);
+
+protected:
+	void onAdded(Widget* w) override;
+	void onRemoved(Widget* w) override;
+	void onChanged(Widget* w) override;
+	void onObservedDestroyed(Widget* w) override;
+public:
+	LiveSelection(Widget* root, Selector selector);
+	LiveSelection(Widget* root, std::string_view selector);
+	~LiveSelection();
+
+	LiveSelection(LiveSelection const&) = delete;
+	LiveSelection& operator=(LiveSelection const&) = delete;
+
+	/// Called when a widget starts matching (also for the initial results)
+	LiveSelection& onEnter(std::function<void(Widget*)> fn);
+	/// Called when a widget stops matching (also when it's removed from the tree)
+	LiveSelection& onLeave(std::function<void(Widget*)> fn);
+
+	Widget*         root()     const noexcept { return mRoot; }
+	Selector const& selector() const noexcept { return mSelector; }
+
+	size_t size()  const noexcept { return mResults.size(); }
+	bool   empty() const noexcept { return mResults.empty(); }
+	bool   contains(Widget* w) const noexcept { return mResults.count(w); }
+	auto   begin() const noexcept { return mResults.begin(); }
+	auto   end()   const noexcept { return mResults.end(); }
+};
+
+// =============================================================
+// == Inline implementation =============================================
+// =============================================================
+
+template<typename C>
+bool Selector::eachCandidate(Widget* w, TypeMask types, C&& c) const {
+	if(!c(w)) return false;
+	for(Widget* child = w->children(); child; child = child->nextSibling()) {
+		if(types && !((child->type().mask | child->descendantTypes()) & types))
+			continue; // Nothing in this branch can match
+		if(!eachCandidate(child, types, c)) return false;
+	}
+	return true;
+}
+
+template<typename C>
+bool Selector::each(Widget* root, C&& c) const {
+	for(Widget* child = root->children(); child; child = child->nextSibling()) {
+		if(!eachIn(root, child, c)) return false;
+	}
+	return true;
+}
+
+template<typename C>
+bool Selector::eachIn(Widget* root, Widget* w, C&& c) const {
+	TypeMask types = candidateTypes();
+	if(types && !((w->type().mask | w->descendantTypes()) & types))
+		return true;
+	return eachCandidate(w, types, [&](Widget* candidate) {
+		if(candidate == root || !matches(candidate, root)) return true;
+		if constexpr(std::is_same_v<decltype(c(candidate)), bool>) {
+			return c(candidate);
+		}
+		else {
+			c(candidate);
+			return true;
+		}
+	});
+}
+
+} // namespace wwidget
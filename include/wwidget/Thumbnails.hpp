@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wwidget {
+
+class Bitmap;
+
+/// Small versions of image files, kept in a pack file across runs.
+/// Entries are keyed by path, modification time and size of the image, so changed files get a new thumbnail.
+/// The pack is mapped when it's opened and the thumbnails point into it, new ones are appended.
+/// The cache doesn't keep thumbnails created in this run alive, they're read from the pack again once nobody uses them.
+/// Outdated entries stay in the pack until clear() is called.
+class ThumbnailCache {
+	struct Entry {
+		uint64_t                      modified; //!< Of the image file
+		uint64_t                      size;
+		size_t                        offset;   //!< Of the pixels in the pack, 0 if they couldn't be stored
+		unsigned                      width, height, format;
+		bool                          mapped;   //!< Whether the pixels are in the mapping, or were appended in this run
+		mutable std::weak_ptr<Bitmap> bitmap;   //!< Of an appended entry, while somebody uses it
+	};
+
+	std::string                            mPackPath;
+	unsigned                               mSize;
+	mutable std::mutex                     mMutex;
+	std::shared_ptr<uint8_t[]>             mMapping;
+	std::unordered_map<std::string, Entry> mEntries;
+
+	void open();
+	std::shared_ptr<Bitmap> bitmap(Entry const& entry) const;
+	/// Returns the offset of the pixels in the pack, 0 if it failed
+	size_t append(std::string const& path, Entry const& entry, uint8_t const* pixels, size_t bytes);
+public:
+	/// Opens or creates the pack. Thumbnails are at most size pixels wide and high.
+	ThumbnailCache(std::string packPath, unsigned size = 64);
+
+	/// The thumbnail of the image file at path. Taken from the pack, or decoded, scaled down and stored.
+	/// Threadsafe, but slow when the thumbnail has to be created: Call it on a worker.
+	/// Throws std::runtime_error if the image can't be loaded.
+	std::shared_ptr<Bitmap> get(std::string const& path);
+	/// Only the stored thumbnail, nullptr if there's none or the file changed since
+	std::shared_ptr<Bitmap> find(std::string const& path) const;
+
+	/// Removes all thumbnails, also from the pack
+	void clear();
+
+	unsigned size() const noexcept { return mSize; }
+	std::string const& packPath() const noexcept { return mPackPath; }
+};
+
+} // namespace wwidget
@@ -5,10 +5,12 @@
 #include <bitset>
 #include <memory>
 #include <functional>
+#include <memory_resource>
 
 #include "Events.hpp"
 #include "Ownership.hpp"
 #include "Attributes.hpp"
+#include "async/UniqueTask.hpp"
 
 #define WWIDGET_DECLARE_VARIADIC_SET_FUNCTION() \
 	template<class Arg1, class Arg2, class... ArgN> \
@@ -19,14 +21,53 @@
 		return *this; \
 	}
 
+/// Registers a widget class with the type system used by Widget::isA and the
+/// typed searches. Put it at the top of the class body: WWIDGET_TYPE(Text, Widget)
+#define WWIDGET_TYPE(TYPE, BASE) \
+	public: \
+	using WidgetTypeSelf = TYPE; \
+	static ::wwidget::WidgetType const& StaticType() noexcept { \
+		static ::wwidget::WidgetType const type = ::wwidget::WidgetType::Register(#TYPE, &BASE::StaticType()); \
+		return type; \
+	} \
+	::wwidget::WidgetType const& type() const noexcept override { return StaticType(); } \
+	private:
+
 namespace wwidget {
 
 class AttributeCollectorInterface;
+class Widget;
 class Canvas;
 class Bitmap;
 class Font;
 class Image;
 class Context;
+class ImageRequest;
+
+/// A bit set of widget types, one bit per registered type. @see WidgetType
+using TypeMask = uint64_t;
+
+/// Runtime type information of a widget class. @see WWIDGET_TYPE
+struct WidgetType {
+	const char*       name;
+	WidgetType const* base;
+	TypeMask          bit;  //!< The bit of this type, 0 if the registry ran out of bits
+	TypeMask          mask; //!< The bits of this type and all its bases
+
+	/// Allocates a bit for a new type. Types registered after the first 64 get bit 0 and fall back to dynamic_cast.
+	static WidgetType Register(const char* name, WidgetType const* base) noexcept;
+};
+
+/// Receives notifications about changes in the subtree of a widget. @see Widget::addObserver
+class TreeObserver {
+public:
+	virtual ~TreeObserver() {}
+
+	virtual void onAdded(Widget* w) = 0; //<! w and its children were added to the observed subtree
+	virtual void onRemoved(Widget* w) = 0; //<! w and its children are about to be removed from the observed subtree. Don't call virtual functions of w, it might be in it's destructor.
+	virtual void onChanged(Widget* w) = 0; //<! The name or classes of w (which is the observed widget or a descendant) changed
+	virtual void onObservedDestroyed(Widget* w) = 0; //<! The observed widget w is being destroyed
+};
 
 enum OwnerType {
 	OWNER_EXTERNAL,
@@ -35,6 +76,14 @@ enum OwnerType {
 	OWNER_GC2
 };
 
+/// How urgent a deferred task is. @see Context::defer
+enum TaskPriority {
+	PRIORITY_INPUT,  //!< Reactions to input. Run in the next update, however long it takes.
+	PRIORITY_NORMAL, //!< Run in order, as long as the update's budget lasts
+	PRIORITY_IDLE,   //!< Only run when no normal tasks wait and there's budget left
+	PRIORITY_COUNT
+};
+
 /**
  * Widget is the base class of all widget windows etc.
  * The Ui is build as a tree of widgets, where the children of each widget are stored as a linked list.
@@ -68,12 +117,20 @@ private:
 			childFocused : 1,
 			needsRedraw : 1,
 			childNeedsRedraw : 1,
-			recalcPrefSize : 1;
+			recalcPrefSize : 1,
+			descendantTypesDirty : 1,
+			observed : 1;
 	} mFlags;
 
+	TypeMask mDescendantTypes;
+
 	void notifyChildAdded(Widget* newChild);
 	void notifyChildRemoved(Widget* noLongerChild);
 
+	void descendantTypesChanged() noexcept;
+
+	void notifyObservers(void (TreeObserver::*fn)(Widget*), Widget* subject);
+
 	void drawRecursive(Canvas& canvas, bool minimal);
 
 	template<typename T>
@@ -131,6 +188,11 @@ public:
 	virtual void getAttributes(AttributeCollectorInterface& collector);
 
 public:
+	using WidgetTypeSelf = Widget;
+	static WidgetType const& StaticType() noexcept;
+	/// Returns the type of the most derived registered class. @see WWIDGET_TYPE
+	virtual WidgetType const& type() const noexcept;
+
 	Widget() noexcept;
 	virtual ~Widget();
 
@@ -169,6 +231,9 @@ public:
 	std::unique_ptr<Widget> remove();
 	/// Removes this widget and its children. Returns ownership if the widget has the flag FlagOwnedByParent @see extract
 	std::unique_ptr<Widget> removeQuiet();
+	/// Removes this widget and, if it's owned by the parent, hands it to the context which destroys it later in small batches.
+	/// Without a context it's destroyed immediately. Safe to call from the widget's own event handlers. @see Graveyard
+	void destroy();
 
 	/// If the widet has the FlagOwnedByParent it unsets the flag and returns a unique_ptr to this widget
 	std::unique_ptr<Widget> acquireOwnership() noexcept;
@@ -176,11 +241,17 @@ public:
 	Widget*   owner(OwnerType type) noexcept;
 	OwnerType owner() const noexcept;
 
-	/// Calls remove() on all children. @see remove()
+	/// Calls destroy() on all children. @see destroy()
 	void clearChildren();
 	/// Calls removeQuiet() on all children. @see remove()
 	void clearChildrenQuietly();
 
+	/// Returns whether this is a T. Uses the type bits if T is registered, dynamic_cast otherwise.
+	template<typename T>
+	bool isA() const noexcept;
+	/// Returns the types of all descendants (not including this widget)
+	TypeMask descendantTypes() noexcept;
+
 	/// Dynamic casts this to T&
 	template<typename T>
 	T&       as()       { return dynamic_cast<T&>(*this); }
@@ -190,24 +261,28 @@ public:
 
 	/// Searches the (depth-)first widget with the specified name, and tries to cast it to T. Returns a nullptr on failure. @see Widget::search
 	template<typename T = Widget> T* search(const char* name) noexcept;
-	/// Returns the (depth-)first widget dynamic_cast-able to T* or a nullptr.
+	/// Returns the (depth-)first widget which isA<T>() or a nullptr. Skips branches which don't contain a T.
 	template<typename T = Widget> T* search() noexcept;
 	/// Searches the (depth-)first widget with the specified name, and tries to cast it to T. throws a WidgetNotFound if the widget wasn't found. @see Widget::search
 	template<typename T = Widget> T* find(const char* name);
-	/// Returns the (depth-)first widget dynamic_cast-able to T* or throws a WidgetNotFound. @see Widget::search
+	/// Returns the (depth-)first widget which isA<T>() or throws a WidgetNotFound. @see Widget::search
 	template<typename T = Widget> T* find();
 
 	/// Searches the first parent with the specified name, and tries to cast it to T. Returns a nullptr on failure. @see Widget::search
 	template<typename T = Widget> T* searchParent(const char* name) const noexcept;
-	/// Returns the first parent dynamic_cast-able to T* or a nullptr.
+	/// Returns the first parent which isA<T>() or a nullptr.
 	template<typename T = Widget> T* searchParent() const noexcept;
 	/// Searches the first parent with the specified name, and tries to cast it to T. throws a WidgetNotFound if the widget wasn't found. @see Widget::search
 	template<typename T = Widget> T* findParent(const char* name) const;
-	/// Returns the first parent dynamic_cast-able to T* or throws a WidgetNotFound. @see Widget::search
+	/// Returns the first parent which isA<T>() or throws a WidgetNotFound. @see Widget::search
 	template<typename T = Widget> T* findParent() const;
 	/// Returns root (including this)
 	Widget* findRoot() const noexcept;
 
+	/// Notifies o about changes in this widget and its subtree until it's removed. @see TreeObserver
+	void addObserver(TreeObserver* o);
+	void removeObserver(TreeObserver* o);
+
 
 	// ** Events *******************************************************
 
@@ -266,7 +341,7 @@ public:
 	Widget*  context(Context* ctxt);
 
 	inline const char* name() const noexcept { return mName.c_str(); }
-	inline Widget& name(std::string const& n) noexcept { mName.reset(n.data(), n.length()); return *this; }
+	Widget&            name(std::string const& n) noexcept;
 
 	std::vector<TinyString> const& classes() const noexcept { return mClasses; }
 	Widget* classes(std::string const& s) noexcept;
@@ -336,9 +411,13 @@ public:
 	// ** Queries *******************************************************
 
 	Offset absoluteOffset(Widget const* relativeToParent = nullptr);
+	/// How far (in pixels) this widget is outside of the area its ancestors show, 0 if it's (partly) visible
+	float viewportDistance() const noexcept;
 
 	inline bool needsRelayout() const noexcept { return mFlags.needsRelayout; }
 	inline bool childNeedsRelayout() const noexcept { return mFlags.childNeedsRelayout; }
+	inline bool needsRedraw() const noexcept { return mFlags.needsRedraw; }
+	inline bool childNeedsRedraw() const noexcept { return mFlags.childNeedsRedraw; }
 	inline bool focused() const noexcept { return mFlags.focused; }
 	inline bool childFocused() const noexcept { return mFlags.childFocused; }
 	Widget* findFocused() noexcept;
@@ -347,11 +426,14 @@ public:
 	operator Widget const*() const noexcept { return this; }
 
 	// ** Backend shortcuts *******************************************************
-	void defer(std::function<void()> fn);
+	void defer(unique_task fn, TaskPriority priority = PRIORITY_NORMAL);
+	/// The frame arena of the context or, without a context, the default heap. Use it for FrameVector, FrameString etc.
+	std::pmr::memory_resource* frameMemory() const noexcept;
 	// void deferDraw(std::function<void()> fn);
 
-	void                    loadImage(Owner* taskOwner, std::function<void(std::shared_ptr<Bitmap>)> fn, std::string const& url);
-	void                    loadImage(Owner* taskOwner, std::shared_ptr<Bitmap>& to, std::string const& url);
+	/// Loads the image asynchronously, prioritized by the visibility of this widget. Clearing taskOwner cancels it. @see Context::loadImage
+	std::shared_ptr<ImageRequest> loadImage(Owner* taskOwner, unique_function<void(std::shared_ptr<Bitmap>)> fn, std::string const& url);
+	std::shared_ptr<ImageRequest> loadImage(Owner* taskOwner, std::shared_ptr<Bitmap>& to, std::string const& url);
 	std::shared_ptr<Bitmap> loadImage(std::string const& url);
 
 	// ** Iterator utilities *******************************************************
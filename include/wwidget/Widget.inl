@@ -1,24 +1,63 @@
 #include "Error.hpp"
 
+#include <type_traits>
+
 namespace wwidget {
 
 template<typename T, typename... ARGS>
 T* Widget::add(ARGS&&... args) {
 	return static_cast<T*>(add(std::make_unique<T>(std::forward<ARGS>(args)...)));
 }
+namespace detail {
+
+template<typename T, typename = void>
+struct HasWidgetType : std::false_type {};
+/// True if T registered itself with WWIDGET_TYPE (and doesn't just inherit the registration of a base)
+template<typename T>
+struct HasWidgetType<T, std::void_t<typename T::WidgetTypeSelf>> : std::is_same<typename T::WidgetTypeSelf, T> {};
+
+/// The type bit of T, or 0 if T isn't registered
+template<typename T>
+TypeMask typeBit() noexcept {
+	if constexpr(HasWidgetType<T>::value)
+		return T::StaticType().bit;
+	else
+		return 0;
+}
+
+/// Casts w to T* using the type bits where possible, otherwise falls back to dynamic_cast
+template<typename T, typename W>
+T* widgetCast(W* w) noexcept {
+	if(TypeMask bit = typeBit<std::remove_cv_t<T>>())
+		return (w->type().mask & bit) ? static_cast<T*>(w) : nullptr;
+	return dynamic_cast<T*>(w);
+}
+
+} // namespace detail
+
+template<typename T>
+bool Widget::isA() const noexcept {
+	return detail::widgetCast<T const>(this);
+}
+
 template<>
 Widget* Widget::search<Widget>(const char* name) noexcept;
 template<typename T>
 T* Widget::search(const char* name) noexcept {
-	return dynamic_cast<T*>(search<Widget>(name));
+	Widget* w = search<Widget>(name);
+	return w ? detail::widgetCast<T>(w) : nullptr;
 }
 
 template<typename T>
 T* Widget::search() noexcept {
+	TypeMask bit = detail::typeBit<T>();
 	for(auto* c = mChildren; c; c = c->mNextSibling) {
-		if(T* result = dynamic_cast<T*>(c)) {
+		if(T* result = detail::widgetCast<T>(c)) {
 			return result;
 		}
+		if(bit && !(c->descendantTypes() & bit)) {
+			continue; // No T in this branch
+		}
 		if(T* result = c->search<T>()) {
 			return result;
 		}
@@ -44,12 +83,13 @@ template<>
 Widget* Widget::searchParent<Widget>(const char* name) const noexcept;
 template<typename T>
 T* Widget::searchParent(const char* name) const noexcept {
-	return dynamic_cast<T*>(searchParent<Widget>(name));
+	Widget* p = searchParent<Widget>(name);
+	return p ? detail::widgetCast<T>(p) : nullptr;
 }
 template<typename T>
 T* Widget::searchParent() const noexcept {
 	for(Widget* p = parent(); p; p = p->parent()) {
-		if(T* t = dynamic_cast<T*>(p)) {
+		if(T* t = detail::widgetCast<T>(p)) {
 			return t;
 		}
 	}
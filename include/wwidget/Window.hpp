@@ -2,6 +2,7 @@
 
 #include "BasicContext.hpp"
 
+#include <mutex>
 #include <stdexcept>
 
 namespace wwidget {
@@ -16,11 +17,27 @@ struct FailedOpeningWindow : public std::runtime_error {
 
 /// A desktop environment window.
 class Window : public Widget, public BasicContext {
+	WWIDGET_TYPE(Window, Widget)
+
 	void* mWindowPtr;
 
 	Mouse mMouse;
 	uint32_t mFlags;
 
+	std::chrono::steady_clock::duration   mFrameInterval; //!< One refresh of the monitor
+	std::chrono::steady_clock::time_point mLastFrame;
+
+	std::shared_ptr<FdWatch> mDisplayWatch; //!< The connection to the display server, if we can wait for it together with the watched fds
+
+	std::mutex mWakeMutex;          //!< wakeup() comes from any thread, this keeps close() from tearing glfw down under it
+	bool       mPostWakeup = false; //!< Whether wakeup() has to post an empty event, because the loop waits in glfw
+
+	void paceFrame();
+	/// Waits for input, watched fds or wakeup(), at most timeout
+	void waitEvents(std::chrono::steady_clock::duration timeout);
+	/// Waits for input, watched fds, wakeup() or the next timer
+	void waitIdle();
+
 protected:
 	PreferredSize onCalcPreferredSize() override;
 	void onResized() override;
@@ -33,7 +50,7 @@ public:
 		FlagNoVsync        = 2,
 		FlagAntialias      = 4,
 		FlagRelative       = 8,
-		FlagUpdateOnEvent  = 16,
+		FlagUpdateOnEvent  = 16, //!< update() waits for events or watched fds when there's nothing to do. keepOpen() always does.
 		FlagDrawDebug      = 32,
 		FlagShrinkFit      = 64
 	};
@@ -48,8 +65,12 @@ public:
 	void requestClose();
 
 	bool update() override;
+	/// Interrupts waiting for events, so deferred tasks get executed
+	void wakeup() override;
 
-	/// Blocks and updates the window until it is closed
+	/// Blocks and updates the window until it is closed.
+	/// Frames are only drawn when there's input or needsFrame(), otherwise it sleeps.
+	/// They are paced to the refresh rate of the monitor, by vsync or by waiting when FlagNoVsync is set.
 	void keepOpen();
 
 	/// Draws the window with it's own canvas
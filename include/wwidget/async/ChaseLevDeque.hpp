@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace wwidget {
+
+/// A lock-free work stealing deque (Chase, Lev: "Dynamic Circular Work-Stealing Deque",
+///  with the memory orderings from Lê et al.: "Correct and Efficient Work-Stealing for Weak Memory Models").
+///  Only the owning thread may push() and pop() (at the bottom), any thread may steal() (from the top).
+///  T has to be trivially copyable, usually it's a pointer.
+template<class T>
+class ChaseLevDeque {
+	static_assert(std::is_trivially_copyable_v<T>, "ChaseLevDeque needs trivially copyable elements");
+
+	struct Array {
+		int64_t                         capacity;
+		std::unique_ptr<std::atomic<T>[]> slots;
+
+		Array(int64_t capacity) :
+			capacity(capacity),
+			slots(new std::atomic<T>[capacity])
+		{}
+
+		T    get(int64_t i) const noexcept { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+		void put(int64_t i, T x) noexcept { slots[i & (capacity - 1)].store(x, std::memory_order_relaxed); }
+	};
+
+	alignas(64) std::atomic<int64_t> mTop;
+	alignas(64) std::atomic<int64_t> mBottom;
+	std::atomic<Array*>                 mArray;
+	std::vector<std::unique_ptr<Array>> mRetired; //!< Thieves might still read from old arrays, so they live as long as the deque
+
+	Array* grow(Array* a, int64_t bottom, int64_t top) {
+		auto* bigger = new Array(a->capacity * 2);
+		for(int64_t i = top; i < bottom; i++) {
+			bigger->put(i, a->get(i));
+		}
+		mRetired.emplace_back(a);
+		mArray.store(bigger, std::memory_order_release);
+		return bigger;
+	}
+
+public:
+	/// capacity has to be a power of two
+	explicit ChaseLevDeque(int64_t capacity = 256) :
+		mTop(0),
+		mBottom(0),
+		mArray(new Array(capacity))
+	{}
+	~ChaseLevDeque() {
+		delete mArray.load(std::memory_order_relaxed);
+	}
+
+	ChaseLevDeque(ChaseLevDeque const&) = delete;
+	ChaseLevDeque& operator=(ChaseLevDeque const&) = delete;
+
+	/// Owner only
+	void push(T x) {
+		int64_t b = mBottom.load(std::memory_order_relaxed);
+		int64_t t = mTop.load(std::memory_order_acquire);
+		Array*  a = mArray.load(std::memory_order_relaxed);
+		if(b - t > a->capacity - 1) {
+			a = grow(a, b, t);
+		}
+		a->put(b, x);
+		std::atomic_thread_fence(std::memory_order_release);
+		mBottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	/// Owner only. Returns false if the deque is empty.
+	bool pop(T& out) {
+		int64_t b = mBottom.load(std::memory_order_relaxed) - 1;
+		Array*  a = mArray.load(std::memory_order_relaxed);
+		mBottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = mTop.load(std::memory_order_relaxed);
+
+		bool result = true;
+		if(t <= b) {
+			out = a->get(b);
+			if(t == b) {
+				// The last element: Race against the thieves
+				result = mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+				mBottom.store(b + 1, std::memory_order_relaxed);
+			}
+		}
+		else {
+			result = false;
+			mBottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return result;
+	}
+
+	/// Any thread. Returns false if the deque is empty or another thread was faster.
+	bool steal(T& out) {
+		int64_t t = mTop.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = mBottom.load(std::memory_order_acquire);
+
+		if(t < b) {
+			Array* a = mArray.load(std::memory_order_acquire);
+			T x = a->get(t);
+			if(!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				return false;
+			}
+			out = x;
+			return true;
+		}
+		return false;
+	}
+
+	/// Approximate when called concurrently
+	bool empty() const noexcept {
+		return mBottom.load(std::memory_order_relaxed) <= mTop.load(std::memory_order_relaxed);
+	}
+};
+
+} // namespace wwidget
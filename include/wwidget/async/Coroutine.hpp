@@ -0,0 +1,389 @@
+#pragma once
+
+// Coroutines need C++20. Without it, this header is empty. Build with `premake5 --coroutines` to enable them.
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#define WWIDGET_COROUTINES 1
+
+#include "Future.hpp"
+#include "Threadpool.hpp"
+#include "UniqueTask.hpp"
+
+#include "../Context.hpp"
+#include "../Error.hpp"
+#include "../Ownership.hpp"
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace wwidget {
+
+template<class T = void> class Task;
+
+namespace detail {
+
+template<class T> struct TaskAwaiter;
+
+/// Coroutine frames are allocated often and only live for a few frames. Freed frames are kept per thread
+///  in size classes of 64 bytes, so suspending and finishing a coroutine usually doesn't reach the allocator.
+///  Frames are often freed on another thread than they were allocated on, the caches even that out.
+class FramePool {
+	static constexpr size_t Granularity = 64;
+	static constexpr size_t Classes     = 16; //!< Up to 1KiB, bigger frames come from the heap
+	static constexpr size_t MaxCached   = 64; //!< Per class and thread
+
+	struct Node { Node* next; };
+	struct Cache {
+		Node*  lists[Classes]  = {};
+		size_t counts[Classes] = {};
+
+		~Cache() {
+			for(size_t c = 0; c < Classes; c++) {
+				while(Node* n = lists[c]) {
+					lists[c] = n->next;
+					::operator delete(n);
+				}
+				counts[c] = MaxCached; // Frames freed after this on the exiting thread go straight to the heap
+			}
+		}
+	};
+
+	static Cache& cache() noexcept {
+		static thread_local Cache tCache;
+		return tCache;
+	}
+	static size_t sizeClass(size_t size) noexcept { return (size + Granularity - 1) / Granularity - 1; }
+public:
+	static void* allocate(size_t size) {
+		size_t c = sizeClass(size);
+		if(c >= Classes) return ::operator new(size);
+
+		auto& cc = cache();
+		if(Node* n = cc.lists[c]) {
+			cc.lists[c] = n->next;
+			cc.counts[c]--;
+			return n;
+		}
+		return ::operator new((c + 1) * Granularity);
+	}
+	static void deallocate(void* p, size_t size) noexcept {
+		size_t c = sizeClass(size);
+		if(c >= Classes) {
+			::operator delete(p);
+			return;
+		}
+		auto& cc = cache();
+		if(cc.counts[c] >= MaxCached) {
+			::operator delete(p);
+			return;
+		}
+		auto* n = static_cast<Node*>(p);
+		n->next = cc.lists[c];
+		cc.lists[c] = n;
+		cc.counts[c]++;
+	}
+};
+
+} // namespace detail
+
+/// A coroutine started with spawn() and everything it awaits.
+///  Every suspension ends in exactly one attempt to resume it (a worker, a deferred task, a callback).
+///  Once the scope is cancelled, that attempt destroys the whole coroutine instead, on whichever thread it happens.
+///  Clearing the Owner of the scope cancels it, so coroutines die with their widget.
+class CoroutineScope final : public OwnedObject {
+	std::atomic<bool>            mCancelled{false};
+	std::coroutine_handle<>      mRoot;
+	unique_function<void(unique_task)> mDefer;  //!< To the ui thread
+	unique_task                  mCancelHook;   //!< Set by ui thread awaiters while they're suspended, so the wait can be cut short
+
+	void becameOrphan() override { cancel(); }
+
+public:
+	CoroutineScope(std::coroutine_handle<> root, unique_function<void(unique_task)> defer) :
+		mRoot(root),
+		mDefer(std::move(defer))
+	{}
+
+	/// Ui thread only
+	void cancel() {
+		if(mCancelled.exchange(true, std::memory_order_acq_rel)) return;
+		if(auto hook = std::move(mCancelHook)) hook();
+	}
+	bool cancelled() const noexcept { return mCancelled.load(std::memory_order_acquire); }
+
+	/// Resumes h, which belongs to this scope, or destroys the coroutine if the scope was cancelled.
+	void resume(std::coroutine_handle<> h) {
+		if(cancelled()) {
+			std::exchange(mRoot, nullptr).destroy();
+			return;
+		}
+		h.resume();
+	}
+
+	void defer(unique_task fn) { mDefer(std::move(fn)); }
+
+	/// Ui thread only
+	void cancelHook(unique_task fn) { mCancelHook = std::move(fn); }
+
+	/// The root coroutine finished and destroyed itself
+	void finished(std::shared_ptr<CoroutineScope> self, std::exception_ptr error) {
+		mRoot = nullptr;
+		defer([self = std::move(self), error]() {
+			self->removeFromOwner();
+			if(error) std::rethrow_exception(error);
+		});
+	}
+};
+
+namespace detail {
+
+struct PromiseBase {
+	std::shared_ptr<CoroutineScope> scope;        //!< Inherited from the awaiting coroutine
+	std::coroutine_handle<>         continuation; //!< The awaiting coroutine, none for the root
+	std::exception_ptr              error;
+
+	static void* operator new(size_t size) { return FramePool::allocate(size); }
+	static void  operator delete(void* p, size_t size) noexcept { FramePool::deallocate(p, size); }
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+
+	struct FinalAwaiter {
+		bool await_ready() noexcept { return false; }
+
+		template<class P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+			auto& p = h.promise();
+			if(p.continuation) return p.continuation;
+
+			// The root: Nobody waits for it, so it cleans up after itself. Cancelled is how it's supposed to end.
+			auto scope = std::move(p.scope);
+			auto error = p.error;
+			h.destroy();
+			if(error) {
+				try { std::rethrow_exception(error); }
+				catch(exceptions::Cancelled&) { error = nullptr; }
+				catch(...) {}
+			}
+			if(scope) scope->finished(scope, error);
+			return std::noop_coroutine();
+		}
+		void await_resume() noexcept {}
+	};
+	FinalAwaiter final_suspend() noexcept { return {}; }
+
+	void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template<class T>
+struct Promise : public PromiseBase {
+	std::optional<T> value;
+
+	Task<T> get_return_object() noexcept;
+
+	template<class U>
+	void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+
+	T result() {
+		if(error) std::rethrow_exception(error);
+		return std::move(*value);
+	}
+};
+template<>
+struct Promise<void> : public PromiseBase {
+	Task<void> get_return_object() noexcept;
+
+	void return_void() noexcept {}
+
+	void result() {
+		if(error) std::rethrow_exception(error);
+	}
+};
+
+/// Resumes h through its scope from any thread
+inline void resume(std::shared_ptr<CoroutineScope> const& scope, std::coroutine_handle<> h) {
+	if(scope) scope->resume(h);
+	else      h.resume();
+}
+
+// The awaiters need the promise of the awaiting coroutine, so they can't be local classes with template members
+
+template<class T>
+struct TaskAwaiter {
+	std::coroutine_handle<Promise<T>> h;
+
+	bool await_ready() noexcept { return false; }
+
+	template<class P>
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<P> parent) noexcept {
+		h.promise().scope        = parent.promise().scope;
+		h.promise().continuation = parent;
+		return h;
+	}
+	T await_resume() { return h.promise().result(); }
+};
+
+struct PoolAwaiter {
+	Threadpool& pool;
+	TaskLane    lane;
+
+	bool await_ready() const noexcept { return pool.isWorkerFor(lane); }
+
+	template<class P>
+	void await_suspend(std::coroutine_handle<P> h) {
+		pool.add([scope = h.promise().scope, h]() { resume(scope, h); }, lane);
+	}
+	void await_resume() noexcept {}
+};
+
+template<class Ctx>
+struct UiAwaiter {
+	Ctx& ctx;
+
+	bool await_ready() const noexcept { return false; }
+
+	template<class P>
+	void await_suspend(std::coroutine_handle<P> h) {
+		ctx.defer([scope = h.promise().scope, h]() { resume(scope, h); });
+	}
+	void await_resume() noexcept {}
+};
+
+template<class T>
+struct FutureAwaiter {
+	Future<T>         future;
+	Outcome<T>        outcome = {};
+	std::atomic<bool> arrived{false}; //!< Whoever comes second, the result or the suspension, resumes
+
+	bool await_ready() const noexcept { return false; }
+
+	template<class P>
+	bool await_suspend(std::coroutine_handle<P> h) {
+		std::move(future).then_inline([this, scope = h.promise().scope, h](Outcome<T>&& result) {
+			outcome = std::move(result);
+			if(arrived.exchange(true, std::memory_order_acq_rel))
+				resume(scope, h);
+		});
+		return !arrived.exchange(true, std::memory_order_acq_rel);
+	}
+	T await_resume() {
+		if(outcome.error) std::rethrow_exception(outcome.error);
+		if(!outcome.ok())  throw exceptions::Cancelled();
+		if constexpr(!std::is_void_v<T>) return std::move(*outcome.value);
+	}
+};
+
+struct ImageAwaiter {
+	Context&                      ctx;
+	std::string                   url;
+	Widget*                       viewer;
+	std::shared_ptr<Bitmap>       bitmap     = nullptr;
+	std::shared_ptr<ImageRequest> request    = nullptr;
+	bool                          suspending = false;
+	bool                          loaded     = false;
+
+	bool await_ready() const noexcept { return false; }
+
+	template<class P>
+	bool await_suspend(std::coroutine_handle<P> h) {
+		auto scope = h.promise().scope;
+		suspending = true;
+		request = ctx.loadImage([this, scope, h](std::shared_ptr<Bitmap> b) {
+			bitmap = std::move(b);
+			loaded = true;
+			if(suspending) return; // From the cache, still in await_suspend
+			if(scope) scope->cancelHook(nullptr);
+			resume(scope, h);
+		}, url, nullptr, viewer);
+		suspending = false;
+		if(loaded) return false;
+
+		if(scope) {
+			scope->cancelHook([this, weak = std::weak_ptr<CoroutineScope>(scope), h]() {
+				request->cancel();
+				// The callback won't come anymore. Resuming the cancelled scope destroys the coroutine.
+				if(auto s = weak.lock()) {
+					s->defer([s, h]() { s->resume(h); });
+				}
+			});
+		}
+		return true;
+	}
+	std::shared_ptr<Bitmap> await_resume() noexcept { return std::move(bitmap); }
+};
+
+} // namespace detail
+
+/// A lazily started coroutine. co_await it from another Task, or run it with spawn().
+///  The awaiting coroutine continues on the thread this one finishes on.
+template<class T>
+class [[nodiscard]] Task {
+public:
+	using promise_type = detail::Promise<T>;
+	using handle_type  = std::coroutine_handle<promise_type>;
+
+private:
+	handle_type mHandle;
+
+	template<class Ctx>
+	friend void spawn(Ctx& ctx, Owner* owner, Task<void> task);
+public:
+	explicit Task(handle_type h) noexcept : mHandle(h) {}
+	Task(Task&& other) noexcept : mHandle(std::exchange(other.mHandle, nullptr)) {}
+	Task& operator=(Task&& other) noexcept {
+		if(mHandle) mHandle.destroy();
+		mHandle = std::exchange(other.mHandle, nullptr);
+		return *this;
+	}
+	~Task() {
+		if(mHandle) mHandle.destroy();
+	}
+
+	auto operator co_await() && noexcept { return detail::TaskAwaiter<T>{mHandle}; }
+};
+
+namespace detail {
+
+template<class T>
+Task<T> Promise<T>::get_return_object() noexcept { return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this)); }
+inline
+Task<void> Promise<void>::get_return_object() noexcept { return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this)); }
+
+} // namespace detail
+
+/// Starts task on the calling (ui) thread. It runs until it's done, or until owner clears its ownerships.
+/// ctx (anything with defer(), usually a Context) receives exceptions the task didn't catch.
+template<class Ctx>
+void spawn(Ctx& ctx, Owner* owner, Task<void> task) {
+	auto h     = std::exchange(task.mHandle, nullptr);
+	auto scope = std::make_shared<CoroutineScope>(h, [&ctx](unique_task fn) { ctx.defer(std::move(fn)); });
+	if(owner) owner->transferOwnership(scope.get());
+	h.promise().scope = std::move(scope);
+	h.resume();
+}
+
+/// co_await resume_on_pool(pool) continues the coroutine on a worker. If it already runs on one, it just continues.
+inline
+auto resume_on_pool(Threadpool& pool, TaskLane lane = LANE_BULK) noexcept { return detail::PoolAwaiter{pool, lane}; }
+
+/// co_await resume_on_ui(ctx) continues the coroutine in a later update of ctx (anything with defer(), usually a Context)
+template<class Ctx>
+auto resume_on_ui(Ctx& ctx) noexcept { return detail::UiAwaiter<Ctx>{ctx}; }
+
+/// co_await a Future: The coroutine continues on the thread which completes it. Throws exceptions::Cancelled if it was cancelled.
+template<class T>
+auto operator co_await(Future<T>&& future) { return detail::FutureAwaiter<T>{std::move(future)}; }
+
+/// auto bitmap = co_await loadImageAsync(ctx, url, this);
+///  Loads the image like Context::loadImage, prioritized by the visibility of viewer, and continues on the ui thread.
+///  Cancelling the coroutine cancels the load.
+inline
+auto loadImageAsync(Context& ctx, std::string url, Widget* viewer = nullptr) { return detail::ImageAwaiter{ctx, std::move(url), viewer}; }
+
+} // namespace wwidget
+
+#endif // C++20 coroutines
@@ -0,0 +1,389 @@
+#pragma once
+
+#include "Threadpool.hpp"
+#include "UniqueTask.hpp"
+
+#include "../Ownership.hpp"
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace wwidget {
+
+template<class T> class Future;
+template<class T> class Promise;
+
+namespace detail {
+
+/// What a step produced: A value, an exception, or neither if it was cancelled
+template<class T>
+struct Outcome {
+	std::optional<T>   value;
+	std::exception_ptr error;
+
+	bool ok() const noexcept { return value.has_value(); }
+
+	template<class... Args>
+	void set(Args&&... args) { value.emplace(std::forward<Args>(args)...); }
+};
+template<>
+struct Outcome<void> {
+	bool               done = false;
+	std::exception_ptr error;
+
+	bool ok() const noexcept { return done; }
+	void set() noexcept { done = true; }
+};
+
+/// The untyped part of a step. It's an OwnedObject, so clearing an Owner can cancel it,
+///  but the ownership may only be touched on the ui thread.
+class FutureStateBase : public OwnedObject {
+protected:
+	std::atomic<bool> mCancelled{false};
+	std::atomic<bool> mOwned{false}; //!< Whether it's still linked to an Owner, so other threads know they mustn't unlink it
+
+	void becameOrphan() override {
+		mOwned.store(false, std::memory_order_release);
+		cancel();
+	}
+public:
+	std::weak_ptr<FutureStateBase> upstream; //!< The step this one waits for. Set before the state is shared.
+
+	virtual ~FutureStateBase() {}
+
+	/// Threadsafe. Steps which didn't start yet are skipped. It goes up the pipeline, the producers can check Promise::cancelled().
+	virtual void cancel() {
+		if(mCancelled.exchange(true, std::memory_order_acq_rel)) return;
+		if(auto up = upstream.lock()) up->cancel();
+	}
+	bool cancelled() const noexcept { return mCancelled.load(std::memory_order_acquire); }
+
+	/// Ui thread only
+	void own(Owner& owner) {
+		owner.transferOwnership(this);
+		mOwned.store(true, std::memory_order_release);
+	}
+	/// Ui thread only
+	void disown() {
+		removeFromOwner();
+		mOwned.store(false, std::memory_order_release);
+	}
+	/// Threadsafe. An owned step has to go over the ui thread, even when it's skipped: It must be unlinked (or destroyed) there.
+	bool owned() const noexcept { return mOwned.load(std::memory_order_acquire); }
+};
+
+/// Result and continuation of a step. Whoever comes second, the producer or the consumer, runs the continuation.
+template<class T>
+class FutureState final : public FutureStateBase {
+	enum { HAS_RESULT = 1, HAS_CONTINUATION = 2 };
+
+	std::atomic<int>                      mPhase{0};
+	Outcome<T>                            mOutcome;
+	unique_function<void(Outcome<T>&&)>   mContinuation;
+
+	void run() {
+		auto fn = std::move(mContinuation);
+		fn(std::move(mOutcome));
+	}
+public:
+	/// Producer only, once
+	void complete(Outcome<T>&& outcome) {
+		mOutcome = std::move(outcome);
+		if(mPhase.fetch_or(HAS_RESULT, std::memory_order_acq_rel) & HAS_CONTINUATION)
+			run();
+	}
+	/// Consumer only, once. Runs fn right away if the result is already there.
+	void then(unique_function<void(Outcome<T>&&)> fn) {
+		mContinuation = std::move(fn);
+		if(mPhase.fetch_or(HAS_CONTINUATION, std::memory_order_acq_rel) & HAS_RESULT)
+			run();
+	}
+
+	bool ready() const noexcept { return mPhase.load(std::memory_order_acquire) & HAS_RESULT; }
+};
+
+template<class T, class F>
+struct ResultOf { using type = std::invoke_result_t<F&, T>; };
+template<class F>
+struct ResultOf<void, F> { using type = std::invoke_result_t<F&>; };
+template<class T, class F>
+using ResultOf_t = typename ResultOf<T, F>::type;
+
+template<class T, class F>
+decltype(auto) invokeWith(F& fn, Outcome<T>& input) {
+	if constexpr(std::is_void_v<T>) return fn();
+	else                            return fn(std::move(*input.value));
+}
+
+/// Runs fn on the input, unless it failed or the step was cancelled, and completes next with the result
+template<class R, class T, class F>
+void runStep(FutureState<R>& next, F& fn, Outcome<T>&& input) {
+	Outcome<R> out;
+	if(next.cancelled()) {
+		// Nobody wants it anymore
+	}
+	else if(!input.ok()) {
+		out.error = std::move(input.error);
+	}
+	else {
+		try {
+			if constexpr(std::is_void_v<R>) {
+				invokeWith(fn, input);
+				out.set();
+			}
+			else {
+				out.set(invokeWith(fn, input));
+			}
+		}
+		catch(...) {
+			out.error = std::current_exception();
+		}
+	}
+	next.complete(std::move(out));
+}
+
+/// Collects the inputs of when_all. Cancelling the result cancels all of them.
+template<class T>
+class JoinState final : public FutureStateBase {
+	std::vector<std::optional<T>>          mValues;
+	std::atomic<size_t>                    mRemaining;
+	std::atomic<bool>                      mFailed{false};
+	std::exception_ptr                     mError; //!< Only written by whoever set mFailed
+	std::shared_ptr<FutureState<std::vector<T>>> mResult;
+public:
+	std::vector<std::weak_ptr<FutureStateBase>> inputs;
+
+	JoinState(size_t n, std::shared_ptr<FutureState<std::vector<T>>> result) :
+		mValues(n),
+		mRemaining(n),
+		mResult(std::move(result))
+	{}
+
+	void cancel() override {
+		if(mCancelled.exchange(true, std::memory_order_acq_rel)) return;
+		for(auto& input : inputs) {
+			if(auto p = input.lock()) p->cancel();
+		}
+	}
+
+	void arrive(size_t i, Outcome<T>&& input) {
+		if(input.ok())
+			mValues[i] = std::move(input.value);
+		else if(!mFailed.exchange(true, std::memory_order_acq_rel))
+			mError = std::move(input.error); // Stays empty if the input was cancelled
+
+		if(mRemaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+			return;
+
+		Outcome<std::vector<T>> out;
+		if(mFailed) {
+			out.error = std::move(mError);
+		}
+		else {
+			std::vector<T> values;
+			values.reserve(mValues.size());
+			for(auto& v : mValues) values.emplace_back(std::move(*v));
+			out.set(std::move(values));
+		}
+		mResult->complete(std::move(out));
+	}
+};
+
+} // namespace detail
+
+/// The result of an asynchronous step, which can be continued on the pool or the ui thread.
+///  A future has a single consumer: Continuing it consumes it, so call then_*() on an rvalue.
+///  Failures (exceptions thrown by a step) and cancellations skip the following steps without a detour over their threads.
+///  Dropping a future doesn't cancel anything, call cancel() or give the step an Owner.
+template<class T>
+class Future {
+	template<class U> friend class Future;
+	template<class U> friend Future<std::vector<U>> when_all(std::vector<Future<U>> futures);
+
+	std::shared_ptr<detail::FutureState<T>> mState;
+
+	template<class R>
+	std::shared_ptr<detail::FutureState<R>> next() {
+		auto result = std::make_shared<detail::FutureState<R>>();
+		result->upstream = mState;
+		return result;
+	}
+public:
+	using value_type = T;
+
+	Future() noexcept {}
+	/// Used by the producers, e.g. Promise
+	explicit Future(std::shared_ptr<detail::FutureState<T>> state) noexcept : mState(std::move(state)) {}
+
+	bool valid() const noexcept { return (bool)mState; }
+	bool ready() const noexcept { return mState && mState->ready(); }
+
+	/// Cancels this step and the ones before it which didn't start yet
+	void cancel() { if(mState) mState->cancel(); }
+
+	/// Runs fn with the value on a worker of pool. If the value arrives on such a worker, fn runs right there.
+	template<class F>
+	Future<detail::ResultOf_t<T, std::decay_t<F>>> then_on_pool(Threadpool& pool, F&& fn, TaskLane lane = LANE_BULK) && {
+		using R = detail::ResultOf_t<T, std::decay_t<F>>;
+		auto result = next<R>();
+		auto prev   = std::move(mState);
+		prev->then([result, &pool, lane, fn = std::forward<F>(fn)](detail::Outcome<T>&& input) mutable {
+			if(!input.ok() || result->cancelled() || pool.isWorkerFor(lane)) {
+				detail::runStep(*result, fn, std::move(input));
+				return;
+			}
+			pool.add([result = std::move(result), fn = std::move(fn), input = std::move(input)]() mutable {
+				detail::runStep(*result, fn, std::move(input));
+			}, lane);
+		});
+		return Future<R>(std::move(result));
+	}
+
+	/// Runs fn with the value on the ui thread of ctx (anything with defer(), usually a Context).
+	/// Clearing owner's ownerships cancels the step, so fn can safely use the owner. Call it on the ui thread if owner is given.
+	template<class Ctx, class F>
+	Future<detail::ResultOf_t<T, std::decay_t<F>>> then_on_ui(Ctx& ctx, F&& fn, Owner* owner = nullptr) && {
+		using R = detail::ResultOf_t<T, std::decay_t<F>>;
+		auto result = next<R>();
+		if(owner) result->own(*owner);
+		auto prev = std::move(mState);
+		prev->then([result, &ctx, fn = std::forward<F>(fn)](detail::Outcome<T>&& input) mutable {
+			// A step whose owner let go isn't owned anymore. The owner (and maybe the context) might be gone, don't touch them.
+			// One which was cancelled through cancel() is still linked to its owner though, so it's skipped on the ui thread.
+			if(!result->owned() && (result->cancelled() || !input.ok())) {
+				detail::runStep(*result, fn, std::move(input));
+				return;
+			}
+			ctx.defer([result = std::move(result), fn = std::move(fn), input = std::move(input)]() mutable {
+				result->disown();
+				detail::runStep(*result, fn, std::move(input));
+			});
+		});
+		return Future<R>(std::move(result));
+	}
+
+	/// Calls fn with the outcome on whichever thread completes the future. For adapters, like awaiting it in a coroutine.
+	void then_inline(unique_function<void(detail::Outcome<T>&&)> fn) && {
+		auto prev = std::move(mState);
+		prev->then(std::move(fn));
+	}
+
+	/// Runs fn with the exception on the ui thread of ctx if a step before failed. Values pass through. @see then_on_ui
+	template<class Ctx, class F>
+	Future<T> catch_on_ui(Ctx& ctx, F&& fn, Owner* owner = nullptr) && {
+		auto result = next<T>();
+		if(owner) result->own(*owner);
+		auto prev = std::move(mState);
+		prev->then([result, &ctx, fn = std::forward<F>(fn)](detail::Outcome<T>&& input) mutable {
+			if(!result->owned() && (result->cancelled() || !input.error)) {
+				result->complete(result->cancelled() ? detail::Outcome<T>() : std::move(input));
+				return;
+			}
+			ctx.defer([result = std::move(result), fn = std::move(fn), input = std::move(input)]() mutable {
+				result->disown();
+				if(result->cancelled()) {
+					result->complete({});
+					return;
+				}
+				if(input.error) {
+					fn(std::exchange(input.error, nullptr));
+				}
+				result->complete(std::move(input));
+			});
+		});
+		return Future<T>(std::move(result));
+	}
+};
+
+/// The producing end of a Future. Dropping it without a value cancels the steps which wait for it.
+template<class T>
+class Promise {
+	std::shared_ptr<detail::FutureState<T>> mState;
+
+	void finish(detail::Outcome<T>&& outcome) {
+		auto state = std::move(mState);
+		if(state) state->complete(std::move(outcome));
+	}
+public:
+	Promise() : mState(std::make_shared<detail::FutureState<T>>()) {}
+	~Promise() { finish({}); }
+
+	Promise(Promise&& other) noexcept = default;
+	Promise& operator=(Promise&& other) noexcept {
+		finish({});
+		mState = std::move(other.mState);
+		return *this;
+	}
+
+	/// Call it once, before the value is set
+	Future<T> future() { return Future<T>(mState); }
+
+	template<class... Args>
+	void set_value(Args&&... args) {
+		detail::Outcome<T> outcome;
+		outcome.set(std::forward<Args>(args)...);
+		finish(std::move(outcome));
+	}
+	void set_exception(std::exception_ptr e) {
+		detail::Outcome<T> outcome;
+		outcome.error = std::move(e);
+		finish(std::move(outcome));
+	}
+
+	/// Whether the consumer cancelled, so the work can be skipped
+	bool cancelled() const noexcept { return !mState || mState->cancelled(); }
+};
+
+/// Runs fn on a worker of pool
+template<class F>
+Future<std::invoke_result_t<std::decay_t<F>&>> run_on_pool(Threadpool& pool, F&& fn, TaskLane lane = LANE_BULK) {
+	using R = std::invoke_result_t<std::decay_t<F>&>;
+	auto state = std::make_shared<detail::FutureState<R>>();
+	pool.add([state, fn = std::forward<F>(fn)]() mutable {
+		detail::Outcome<void> start;
+		start.set();
+		detail::runStep(*state, fn, std::move(start));
+	}, lane);
+	return Future<R>(std::move(state));
+}
+
+template<class T>
+Future<std::decay_t<T>> make_ready_future(T&& value) {
+	Promise<std::decay_t<T>> promise;
+	auto result = promise.future();
+	promise.set_value(std::forward<T>(value));
+	return result;
+}
+
+/// Completes with all values in order once all futures did. If one fails, the result fails with its exception.
+template<class T>
+Future<std::vector<T>> when_all(std::vector<Future<T>> futures) {
+	static_assert(!std::is_void_v<T>, "when_all needs futures with values");
+
+	auto result = std::make_shared<detail::FutureState<std::vector<T>>>();
+	if(futures.empty()) {
+		detail::Outcome<std::vector<T>> empty;
+		empty.set();
+		result->complete(std::move(empty));
+		return Future<std::vector<T>>(std::move(result));
+	}
+
+	auto join = std::make_shared<detail::JoinState<T>>(futures.size(), result);
+	for(auto& f : futures) join->inputs.push_back(f.mState);
+	result->upstream = join;
+
+	for(size_t i = 0; i < futures.size(); i++) {
+		auto state = std::move(futures[i].mState);
+		state->then([join, i](detail::Outcome<T>&& input) {
+			join->arrive(i, std::move(input));
+		});
+	}
+	return Future<std::vector<T>>(std::move(result));
+}
+
+} // namespace wwidget
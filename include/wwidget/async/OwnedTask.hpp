@@ -17,7 +17,7 @@ struct OwnedTask final : public OwnedObject {
 	{}
 	OwnedTask& operator=(OwnedTask<C>& other) { return *this = std::move(other); }
 
-	OwnedTask(OwnedTask<C>&& other) :
+	OwnedTask(OwnedTask<C>&& other) noexcept(std::is_nothrow_move_constructible_v<std::remove_reference_t<C>>) :
 		OwnedObject(std::move(other)),
 		c(std::move(other.c))
 	{}
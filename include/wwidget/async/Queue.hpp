@@ -1,22 +1,58 @@
 #pragma once
 
+#include "UniqueTask.hpp"
+
+#include <atomic>
 #include <deque>
+#include <memory>
 #include <mutex>
-#include <functional>
+#include <vector>
 
 namespace wwidget {
 
-/// A single consumer multiple provider task-queue.
-///  It's still threadsafe for multiple consumers, just not optimized
+/// A multiple producer, single consumer task-queue.
+///  add() is lock-free as long as the ring buffer has space. When it's full, tasks go to a mutex
+///  protected overflow list until the consumer drained it, so tasks from the same thread stay in order.
+///  Only one thread (usually the ui thread) may call drain() and executeSingleConsumer().
 class TaskQueue {
-	std::mutex mMutex;
-	std::deque<std::function<void()>> mTasks;
+	struct Slot {
+		std::atomic<size_t> sequence;
+		unique_task         task;
+	};
+
+	std::unique_ptr<Slot[]> mSlots;
+	size_t                  mMask;
+	alignas(64) std::atomic<size_t> mEnqueue;
+	alignas(64) size_t              mDequeue;
+
+	std::mutex              mOverflowMutex;
+	std::deque<unique_task> mOverflow;
+	std::atomic<bool>       mOverflowing;
+
+	std::atomic<bool>       mSignaled;
+	unique_task             mWakeup;
+
+	std::vector<unique_task> mExecuting; //!< Kept around so executing doesn't allocate every frame
+
+	bool tryPush(unique_task& fn) noexcept;
 public:
-	TaskQueue();
+	/// capacity is rounded up to a power of two
+	TaskQueue(size_t capacity = 256);
 	~TaskQueue();
 
-	void add(std::function<void()> fn);
+	TaskQueue(TaskQueue const&) = delete;
+	TaskQueue& operator=(TaskQueue const&) = delete;
+
+	/// Threadsafe
+	void add(unique_task fn);
+
+	/// Called (on the adding thread) when a task arrives while the queue was drained, e.g. to wake up a sleeping event loop.
+	/// Set it before tasks get added from other threads.
+	void wakeupHook(unique_task fn);
 
+	/// Consumer only. Moves all queued tasks to the end of batch and returns how many there were.
+	size_t drain(std::vector<unique_task>& batch);
+	/// Consumer only. Executes tasks until the queue is empty, including the ones added by the executed tasks.
 	size_t executeSingleConsumer();
 };
 
@@ -1,8 +1,9 @@
 #pragma once
 
-#include <functional>
+#include "UniqueTask.hpp"
 
-#include <deque>
+#include <atomic>
+#include <memory>
 #include <vector>
 
 #include <thread>
@@ -11,26 +12,81 @@
 
 namespace wwidget {
 
+enum TaskLane {
+	LANE_LATENCY, //!< Short tasks somebody is waiting for (layout, text measurement). Always run before bulk tasks.
+	LANE_BULK,    //!< Long running throughput work (decoding, filesystem scans)
+	LANE_COUNT
+};
+
+/// A work stealing threadpool.
+///  Every worker has its own lock-free deque per lane. Tasks added from a worker go to its own deque,
+///  tasks added from other threads go to a shared injection queue from which workers take them in batches.
+///  Idle workers steal from the others.
+///  Some workers can be reserved for the latency lane, so it stays responsive while the bulk lane is saturated.
+///  Tasks are kept in pooled nodes, which go back to a free list after they ran, so adding a task doesn't allocate once the pool warmed up.
 class Threadpool {
-	volatile bool            mRunning;
-	std::mutex               mMutex;
-	std::condition_variable  mWaiting;
-	std::vector<std::thread> mThreads;
-	std::deque<std::function<void()>> mTasks;
+	struct Worker;
+	struct Node;
+	/// An intrusive fifo of nodes
+	struct Injector {
+		std::mutex mutex;
+		Node*      head  = nullptr;
+		Node*      tail  = nullptr;
+		size_t     count = 0;
+	};
+	/// Nodes of tasks which were added from outside the pool, after they ran
+	struct Spares {
+		std::mutex mutex;
+		Node*      nodes = nullptr;
+		size_t     count = 0;
+	};
+
+	std::atomic<bool>                    mRunning;
+	std::vector<std::unique_ptr<Worker>> mWorkers;
+	Injector                             mInjectors[LANE_COUNT];
+	std::atomic<size_t>                  mPending[LANE_COUNT]; //!< Tasks which were added but not taken yet
+	Spares                               mSpares;
+
+	// Sleeping workers. Index 0: Latency only workers, 1: all others
+	std::mutex               mSleepMutex;
+	std::condition_variable  mWake[2];
+	std::atomic<int>         mSleeping[2];
+
+	static thread_local Worker* tCurrentWorker;
+
+	void  run(Worker& w);
+	Node* find(Worker* w, TaskLane lane);
+	Node* findInjected(Worker* w, TaskLane lane);
+	Node* steal(Worker* w, TaskLane lane);
+	Node* acquire(Worker* w);
+	void  release(Worker* w, Node* node);
+	void  returnSpares(Worker& w);
+	void  wake(TaskLane lane);
+	bool  hasWork(bool latencyOnly) const noexcept;
 
 public:
 	Threadpool();
-	Threadpool(size_t size);
+	/// @see start
+	Threadpool(size_t size, size_t latencyWorkers = 0);
 	~Threadpool();
 
-	void start(size_t size);
+	/// Starts size workers, latencyWorkers of which only run tasks of LANE_LATENCY. latencyWorkers has to be smaller than size.
+	void start(size_t size, size_t latencyWorkers = 0);
+	/// Stops all workers. Tasks which didn't start yet are kept for the next start().
 	void stop();
 
-	void add(std::function<void()>&& fn);
-	std::function<void()> await_pop();
-	std::function<void()> try_pop();
+	void add(unique_task fn, TaskLane lane = LANE_BULK);
+	/// Takes a task which didn't start yet, so a waiting thread can help out. Latency tasks first.
+	unique_task try_pop();
+
+	/// Whether the calling thread is a worker of this pool which runs tasks of the lane
+	bool   isWorkerFor(TaskLane lane) const noexcept;
+
+	bool   running() const noexcept { return mRunning; }
+	size_t size() const noexcept { return mWorkers.size(); }
 
-	bool running() const noexcept { return mRunning; }
+	/// hardware_concurrency() - 1, but at least 1
+	static size_t defaultSize() noexcept;
 };
 
-} // namespace wwidget
\ No newline at end of file
+} // namespace wwidget
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace wwidget {
+
+template<class Signature>
+class unique_function;
+
+namespace detail {
+	template<class F>
+	struct IsStdFunction : std::false_type {};
+	template<class Signature>
+	struct IsStdFunction<std::function<Signature>> : std::true_type {};
+} // namespace detail
+
+/// A move-only std::function. Callables up to 56 bytes (which are nothrow movable) are stored inline,
+///  so posting them doesn't allocate. Bigger ones are moved to the heap.
+///  Unlike std::function it can hold move-only callables, like lambdas which capture a unique_ptr or an OwnedTask.
+template<class R, class... Args>
+class unique_function<R(Args...)> {
+public:
+	static constexpr size_t InlineSize = 56;
+
+private:
+	struct VTable {
+		R    (*invoke)(void* storage, Args&&... args);
+		void (*move)(void* to, void* from) noexcept; //!< Move constructs into to and destroys from
+		void (*destroy)(void* storage) noexcept;
+	};
+
+	template<class F>
+	static constexpr bool fitsInline =
+		sizeof(F) <= InlineSize &&
+		alignof(F) <= alignof(std::max_align_t) &&
+		std::is_nothrow_move_constructible_v<F>;
+
+	template<class F>
+	struct InlineOps {
+		static F* get(void* s) noexcept { return std::launder(reinterpret_cast<F*>(s)); }
+
+		static R invoke(void* s, Args&&... args) {
+			return std::invoke(*get(s), std::forward<Args>(args)...);
+		}
+		static void move(void* to, void* from) noexcept {
+			new(to) F(std::move(*get(from)));
+			get(from)->~F();
+		}
+		static void destroy(void* s) noexcept {
+			get(s)->~F();
+		}
+		static constexpr VTable vtable = { &invoke, &move, &destroy };
+	};
+
+	template<class F>
+	struct HeapOps {
+		static F*& get(void* s) noexcept { return *std::launder(reinterpret_cast<F**>(s)); }
+
+		static R invoke(void* s, Args&&... args) {
+			return std::invoke(*get(s), std::forward<Args>(args)...);
+		}
+		static void move(void* to, void* from) noexcept {
+			new(to) F*(get(from));
+		}
+		static void destroy(void* s) noexcept {
+			delete get(s);
+		}
+		static constexpr VTable vtable = { &invoke, &move, &destroy };
+	};
+
+	alignas(std::max_align_t) unsigned char mStorage[InlineSize];
+	VTable const* mVTable;
+
+	template<class F>
+	static constexpr bool isCallable =
+		!std::is_same_v<std::decay_t<F>, unique_function> &&
+		std::is_invocable_r_v<R, std::decay_t<F>&, Args...>;
+
+public:
+	unique_function() noexcept : mVTable(nullptr) {}
+	unique_function(std::nullptr_t) noexcept : mVTable(nullptr) {}
+
+	template<class F, class = std::enable_if_t<isCallable<F>>>
+	unique_function(F&& f) : mVTable(nullptr) {
+		using Fn = std::decay_t<F>;
+
+		if constexpr(std::is_pointer_v<Fn> || std::is_member_pointer_v<Fn> || detail::IsStdFunction<Fn>::value) {
+			// Function pointers and std::function can be empty
+			if(!f) return;
+		}
+
+		if constexpr(fitsInline<Fn>) {
+			new(mStorage) Fn(std::forward<F>(f));
+			mVTable = &InlineOps<Fn>::vtable;
+		}
+		else {
+			new(mStorage) Fn*(new Fn(std::forward<F>(f)));
+			mVTable = &HeapOps<Fn>::vtable;
+		}
+	}
+
+	unique_function(unique_function&& other) noexcept :
+		mVTable(other.mVTable)
+	{
+		if(mVTable) {
+			mVTable->move(mStorage, other.mStorage);
+			other.mVTable = nullptr;
+		}
+	}
+	unique_function& operator=(unique_function&& other) noexcept {
+		if(this != &other) {
+			reset();
+			if(other.mVTable) {
+				mVTable = other.mVTable;
+				mVTable->move(mStorage, other.mStorage);
+				other.mVTable = nullptr;
+			}
+		}
+		return *this;
+	}
+	unique_function& operator=(std::nullptr_t) noexcept {
+		reset();
+		return *this;
+	}
+
+	unique_function(unique_function const&) = delete;
+	unique_function& operator=(unique_function const&) = delete;
+
+	~unique_function() { reset(); }
+
+	void reset() noexcept {
+		if(mVTable) {
+			mVTable->destroy(mStorage);
+			mVTable = nullptr;
+		}
+	}
+
+	explicit operator bool() const noexcept { return mVTable; }
+
+	R operator()(Args... args) {
+		return mVTable->invoke(mStorage, std::forward<Args>(args)...);
+	}
+};
+
+/// A task for the async layer. @see TaskQueue, Threadpool, Context::defer
+using unique_task = unique_function<void()>;
+
+} // namespace wwidget
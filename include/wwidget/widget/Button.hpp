@@ -7,6 +7,8 @@
 namespace wwidget {
 
 class Button : public Widget {
+	WWIDGET_TYPE(Button, Widget)
+
 protected:
 	bool mPressed;
 	std::function<void()> mOnClick;
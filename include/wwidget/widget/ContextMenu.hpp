@@ -6,6 +6,8 @@
 namespace wwidget {
 
 class ContextMenu : public List {
+	WWIDGET_TYPE(ContextMenu, List)
+
 public:
 	ContextMenu();
 
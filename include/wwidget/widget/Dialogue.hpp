@@ -7,6 +7,8 @@
 namespace wwidget {
 
 class Dialogue : public List {
+	WWIDGET_TYPE(Dialogue, List)
+
 protected:
 	void onDraw(Canvas& c) override;
 public:
@@ -8,6 +8,8 @@
 namespace wwidget {
 
 class FileBrowser : public List {
+	WWIDGET_TYPE(FileBrowser, List)
+
 	List mHeader;
 	WrappedList mFilePane;
 
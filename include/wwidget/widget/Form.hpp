@@ -15,6 +15,8 @@ namespace wwidget {
 ///  You can register your own widgets by using the Form::factory functions, but
 ///  you have to call Form::addDefaultFactories if you want to add the default widgets then.
 class Form : public Widget {
+	WWIDGET_TYPE(Form, Widget)
+
 public:
 	using FactoryFn = std::function<std::unique_ptr<Widget>()>;
 
@@ -4,9 +4,12 @@
 
 namespace wwidget {
 
+class AnimatedBitmap;
 class Bitmap;
 
 class Image : public Widget {
+	WWIDGET_TYPE(Image, Widget)
+
 	std::string mSource;
 
 	bool                    mStretch;
@@ -14,10 +17,21 @@ class Image : public Widget {
 	std::shared_ptr<Bitmap> mImage;
 	Owner                   mLoadingTasks;
 	Size                    mMaxSize;
+	unsigned                mResolution; //!< The size of the last load, 0 for the full image
+	std::shared_ptr<AnimatedBitmap> mAnimation;
+	Owner                           mAnimationTasks; //!< The timer of the next frame
+
+	unsigned neededResolution() const noexcept;
+	void updateResolution();
+	void loadResolution(unsigned resolution);
+	bool loadAnimation(std::string const& path);
+	void stopAnimation();
+	void animate();
 
 protected:
 	void load(std::string path, bool force_synchronous);
 	void reload(bool force_synchronous);
+	void onResized() override;
 	PreferredSize onCalcPreferredSize() override;
 	void onDrawBackground(Canvas& canvas) override;
 	void onDraw(Canvas& canvas) override;
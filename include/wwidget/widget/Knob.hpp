@@ -5,6 +5,8 @@
 namespace wwidget {
 
 class Knob : public Slider {
+	WWIDGET_TYPE(Knob, Slider)
+
 public:
 	Knob();
 	~Knob();
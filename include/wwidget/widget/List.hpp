@@ -5,6 +5,8 @@
 namespace wwidget {
 
 class List : public Widget {
+	WWIDGET_TYPE(List, Widget)
+
 private:
 	Flow  mFlow;
 	bool  mScrollable;
@@ -5,6 +5,8 @@
 namespace wwidget {
 
 class ProgressBar : public Widget {
+	WWIDGET_TYPE(ProgressBar, Widget)
+
 	float mScale;
 	float mProgress;
 
@@ -7,6 +7,8 @@
 namespace wwidget {
 
 class Slider : public Widget {
+	WWIDGET_TYPE(Slider, Widget)
+
 	bool  mPressed;
 	double mValue;
 	double mStart, mScale, mExponent;
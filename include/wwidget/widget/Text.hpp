@@ -7,6 +7,8 @@
 namespace wwidget {
 
 class Text : public Widget {
+	WWIDGET_TYPE(Text, Widget)
+
 protected:
 	Color       mFontColor;
 	float       mFontSize;
@@ -28,7 +30,7 @@ public:
 	Text(Text&& other) noexcept;
 	Text& operator=(Text&& other) noexcept;
 
-	Text* content(std::string s);
+	Text* content(std::string_view s);
 	auto& content() const noexcept { return mText; }
 	Text* font   (std::string const& name);
 	auto& font() const noexcept { return mFont; }
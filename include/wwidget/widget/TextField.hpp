@@ -8,6 +8,8 @@ namespace wwidget {
 
 // TODO: add cursor
 class TextField : public Text {
+	WWIDGET_TYPE(TextField, Text)
+
 private:
 	std::function<void()> mOnReturn;
 	std::function<void()> mOnUpdate;
@@ -23,7 +25,7 @@ public:
 	~TextField();
 
 	std::string const& content() const noexcept { return Text::content(); }
-	TextField* content(std::string c);
+	TextField* content(std::string_view c);
 
 	TextField* onReturn(std::function<void()> ret);
 	TextField* onUpdate(std::function<void()> update);
@@ -5,6 +5,8 @@
 namespace wwidget {
 
 class WrappedList : public List {
+	WWIDGET_TYPE(WrappedList, List)
+
 public:
 	WrappedList();
 	WrappedList(Widget* addTo);
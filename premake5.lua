@@ -3,6 +3,20 @@ workspace 'WonkyWidgets'
 language   'C++'
 cppdialect 'C++17'
 
+newoption {
+	trigger     = 'coroutines',
+	description = 'Build with C++20, which enables the coroutines in wwidget/async/Coroutine.hpp'
+}
+if _OPTIONS['coroutines'] then
+	cppdialect 'C++20'
+	-- UnicodeConstants are u8 literals in char arrays
+	filter 'toolset:gcc or clang'
+		buildoptions '-fno-char8_t'
+	filter 'toolset:msc*'
+		buildoptions '/Zc:char8_t-'
+	filter {}
+end
+
 configurations {
 	'dev',
 	'debug',
@@ -44,6 +58,10 @@ function widgetApp(name)
 		kind "ConsoleApp"
 		links { "wwidget", "glfw", "GL", "stdc++fs", "pthread", "nanovg" }
 		includedirs "include"
+		-- The window waits for the X11 connection together with watched fds
+		filter 'system:linux'
+			links "X11"
+		filter {}
 end
 
 widgetApp "unittests"
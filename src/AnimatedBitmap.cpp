@@ -0,0 +1,461 @@
+#include "../include/wwidget/AnimatedBitmap.hpp"
+
+#include "../include/wwidget/Attributes.hpp"
+#include "../include/wwidget/Bitmap.hpp"
+#include "../include/wwidget/MappedFile.hpp"
+
+#include "../include/wwidget/async/Threadpool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace wwidget {
+
+/// Grows the box x0, y0, x1, y1 by area, which is one too. Empty boxes have x0 == x1.
+static
+void unite(unsigned (&box)[4], unsigned const (&area)[4]) {
+	if(area[0] == area[2]) return;
+	if(box[0] == box[2]) {
+		std::copy(area, area + 4, box);
+		return;
+	}
+	box[0] = std::min(box[0], area[0]); box[1] = std::min(box[1], area[1]);
+	box[2] = std::max(box[2], area[2]); box[3] = std::max(box[3], area[3]);
+}
+
+/// The row of the image which is the row-th one in the data of an interlaced GIF
+static
+unsigned interlacedRow(unsigned row, unsigned height) {
+	// Every 8th row from 0, every 8th from 4, every 4th from 2, every 2nd from 1
+	unsigned pass = (height + 7) / 8;
+	if(row < pass) return row * 8;
+	row -= pass;
+	pass = (height + 3) / 8;
+	if(row < pass) return 4 + row * 8;
+	row -= pass;
+	pass = (height + 1) / 4;
+	if(row < pass) return 2 + row * 4;
+	row -= pass;
+	return 1 + row * 2;
+}
+
+/// Decodes one frame after the other, drawing each onto the canvas the ones before left behind.
+/// Only keeps the canvas, the one before a frame which restores it afterwards and the data of the frame being decoded.
+struct AnimatedBitmap::Decoder {
+	std::shared_ptr<uint8_t[]> file;
+	size_t   length     = 0;
+	size_t   pos        = 0;
+	size_t   firstFrame = 0; //!< Where the blocks after the header start, looping goes back there
+	unsigned width = 0, height = 0;
+	uint8_t  globalPalette[256 * 3];
+	unsigned globalColors = 0;
+
+	std::vector<uint8_t>  canvas;   //!< RGBA
+	std::vector<uint8_t>  previous; //!< The canvas before a frame which is disposed to the previous one
+	std::vector<uint8_t>  indices;  //!< Of the frame being decoded
+	std::vector<uint16_t> prefix;   //!< The LZW table
+	std::vector<uint8_t>  suffix;
+	std::vector<uint8_t>  stack;
+
+	unsigned disposal = 0;                //!< Of the last frame, applied before the next one is drawn
+	unsigned last[4]  = { 0, 0, 0, 0 };   //!< The area of the last frame
+	size_t   decoded  = 0;                //!< Since the start of the file
+	bool     ended    = false;            //!< A still image, there's nothing after the first frame
+
+	uint8_t byte() {
+		if(pos >= length) throw std::runtime_error("Failed decoding GIF: Unexpected end of file");
+		return file[pos++];
+	}
+	unsigned word() {
+		unsigned low = byte();
+		return low | (unsigned(byte()) << 8);
+	}
+	void skip(size_t n) {
+		if(n > length - pos) throw std::runtime_error("Failed decoding GIF: Unexpected end of file");
+		pos += n;
+	}
+	void skipSubBlocks() {
+		while(size_t n = byte()) skip(n);
+	}
+
+	void open(std::shared_ptr<uint8_t[]> data, size_t size) {
+		file   = std::move(data);
+		length = size;
+		pos    = 0;
+		if(length < 13 || (memcmp(file.get(), "GIF87a", 6) != 0 && memcmp(file.get(), "GIF89a", 6) != 0)) {
+			throw std::runtime_error("Failed opening animation: Not a GIF");
+		}
+		pos    = 6;
+		width  = word();
+		height = word();
+		uint8_t flags = byte();
+		skip(2); // Background color and aspect ratio
+		if(width == 0 || height == 0) throw std::runtime_error("Failed opening animation: The GIF is empty");
+		// Each buffer of the ring has the size of the screen, the header alone mustn't make us allocate gigabytes
+		if(size_t(width) * height > MaxPixels) throw std::runtime_error("Failed opening animation: The GIF is too big");
+		if(flags & 0x80) {
+			globalColors = 2u << (flags & 7);
+			skip(globalColors * 3);
+			memcpy(globalPalette, file.get() + pos - globalColors * 3, globalColors * 3);
+		}
+		firstFrame = pos;
+		canvas.assign(size_t(width) * height * 4, 0);
+	}
+
+	/// Decodes the LZW data of a w x h frame at x, y into indices, which only keeps the part on the screen.
+	/// Returns the size of that part, the data is read completely in any case.
+	void decodeRaster(unsigned x, unsigned y, unsigned w, unsigned h, bool interlaced, unsigned& visibleW, unsigned& visibleH) {
+		// The frame's size comes from the file, only what's on the screen takes memory
+		visibleW = x < width  ? std::min(w, width - x)  : 0;
+		visibleH = y < height ? std::min(h, height - y) : 0;
+		indices.assign(size_t(visibleW) * visibleH, 0);
+		size_t   total = size_t(w) * h;
+		unsigned row = 0, col = 0, ty = y; // Of the next index
+		prefix.resize(4096);
+		suffix.resize(4096);
+		stack.resize(4097);
+
+		unsigned minSize = byte();
+		if(minSize < 1 || minSize > 11) throw std::runtime_error("Failed decoding GIF: Invalid code size");
+		unsigned clear    = 1u << minSize;
+		unsigned end      = clear + 1;
+		unsigned codeSize = minSize + 1;
+		unsigned next     = clear + 2;
+		int      old      = -1;
+		uint8_t  first    = 0;
+
+		uint32_t bits   = 0;
+		unsigned count  = 0;     // Valid bits
+		size_t   block  = 0;     // Bytes left in the current sub-block
+		bool     closed = false; // Reached the empty sub-block which ends the data
+		size_t   out    = 0;
+		while(true) {
+			while(count < codeSize && !closed) {
+				if(block == 0) {
+					block = byte();
+					if(block == 0) { closed = true; break; }
+				}
+				bits  |= uint32_t(byte()) << count;
+				count += 8;
+				block--;
+			}
+			if(closed) break;
+
+			unsigned code = bits & ((1u << codeSize) - 1);
+			bits  >>= codeSize;
+			count  -= codeSize;
+			if(code == clear) {
+				codeSize = minSize + 1;
+				next     = clear + 2;
+				old      = -1;
+				continue;
+			}
+			if(code == end) break;
+			if(code > next || (old < 0 && code >= clear)) {
+				throw std::runtime_error("Failed decoding GIF: Corrupt image data");
+			}
+
+			// Walks the string back to front, the one which isn't in the table yet is the last one plus its first index
+			size_t   n = 0;
+			unsigned c = code;
+			if(code == next) {
+				stack[n++] = first;
+				c = (unsigned) old;
+			}
+			while(c >= clear) {
+				stack[n++] = suffix[c];
+				c = prefix[c];
+			}
+			stack[n++] = (uint8_t) c;
+			first = (uint8_t) c;
+			for(; n > 0 && out < total; out++) {
+				uint8_t index = stack[--n];
+				if(col < visibleW && ty < y + visibleH) indices[size_t(ty - y) * visibleW + col] = index;
+				if(++col == w) {
+					col = 0;
+					row++;
+					ty = y + (interlaced ? interlacedRow(row, h) : row);
+				}
+			}
+
+			// A full table stays as it is until the next clear code
+			if(old >= 0 && next < 4096) {
+				prefix[next] = (uint16_t) old;
+				suffix[next] = first;
+				next++;
+				if(next == (1u << codeSize) && codeSize < 12) codeSize++;
+			}
+			old = (int) code;
+		}
+		if(!closed) {
+			skip(block);
+			skipSubBlocks();
+		}
+	}
+
+	/// Draws the next frame and copies the canvas to out. changed is the area which differs from the frame before.
+	/// Starts over after the last frame, with all of it changed. Returns false for a still image after its frame.
+	bool next(uint8_t* out, unsigned (&changed)[4], std::chrono::milliseconds& delay) {
+		std::fill(changed, changed + 4, 0u);
+		if(ended) return false;
+
+		// Take back the last frame
+		if(disposal == 2 || disposal == 3) {
+			for(unsigned y = last[1]; y < last[3]; y++) {
+				size_t offset = (size_t(y) * width + last[0]) * 4;
+				size_t bytes  = size_t(last[2] - last[0]) * 4;
+				if(disposal == 2) memset(canvas.data() + offset, 0, bytes);
+				else              memcpy(canvas.data() + offset, previous.data() + offset, bytes);
+			}
+			unite(changed, last);
+		}
+		disposal = 0;
+		std::fill(last, last + 4, 0u);
+
+		// From the graphic control extension before the frame
+		unsigned frameDisposal = 0;
+		int      transparent   = -1;
+		unsigned centiseconds  = 0;
+		while(true) {
+			uint8_t block = pos < length ? byte() : 0x3B;
+			if(block == 0x21) {
+				uint8_t label = byte();
+				if(label == 0xF9) {
+					uint8_t size = byte();
+					if(size >= 4) {
+						uint8_t flags = byte();
+						centiseconds  = word();
+						uint8_t index = byte();
+						frameDisposal = (flags >> 2) & 7;
+						transparent   = (flags & 1) ? index : -1;
+						skip(size - 4);
+					}
+					else {
+						skip(size);
+					}
+				}
+				skipSubBlocks();
+			}
+			else if(block == 0x2C) {
+				break;
+			}
+			else {
+				// The trailer, anything else after the last frame is ignored as well
+				if(decoded == 0) throw std::runtime_error("Failed decoding GIF: No frames");
+				if(decoded == 1) {
+					ended = true;
+					return false;
+				}
+				pos     = firstFrame;
+				decoded = 0;
+				std::fill(canvas.begin(), canvas.end(), 0);
+				unsigned all[4] = { 0, 0, width, height };
+				unite(changed, all);
+				frameDisposal = 0;
+				transparent   = -1;
+				centiseconds  = 0;
+			}
+		}
+
+		unsigned x = word(), y = word(), w = word(), h = word();
+		uint8_t  flags   = byte();
+		uint8_t  localPalette[256 * 3];
+		uint8_t const* palette = globalPalette;
+		unsigned colors  = globalColors;
+		if(flags & 0x80) {
+			colors = 2u << (flags & 7);
+			skip(colors * 3);
+			memcpy(localPalette, file.get() + pos - colors * 3, colors * 3);
+			palette = localPalette;
+		}
+		unsigned visibleW, visibleH;
+		decodeRaster(x, y, w, h, flags & 0x40, visibleW, visibleH);
+
+		if(frameDisposal == 3) {
+			previous.assign(canvas.begin(), canvas.end());
+		}
+		for(unsigned row = 0; row < visibleH; row++) {
+			uint8_t const* from = indices.data() + size_t(row) * visibleW;
+			uint8_t*       to   = canvas.data() + size_t(y + row) * width * 4;
+			for(unsigned col = 0; col < visibleW; col++) {
+				unsigned index = from[col];
+				if((int) index == transparent || index >= colors) continue;
+				uint8_t* pixel = to + size_t(x + col) * 4;
+				pixel[0] = palette[index * 3 + 0];
+				pixel[1] = palette[index * 3 + 1];
+				pixel[2] = palette[index * 3 + 2];
+				pixel[3] = 255;
+			}
+		}
+
+		if(visibleW > 0 && visibleH > 0) {
+			unsigned area[4] = { x, y, x + visibleW, y + visibleH };
+			unite(changed, area);
+			std::copy(area, area + 4, last);
+		}
+		disposal = frameDisposal;
+		// Browsers play frames without a delay, or one too short to be meant, with 100ms
+		delay = std::chrono::milliseconds(centiseconds < 2 ? 100 : centiseconds * 10);
+		decoded++;
+		memcpy(out, canvas.data(), canvas.size());
+		return true;
+	}
+};
+
+struct AnimatedBitmap::Shared {
+	struct Frame {
+		std::unique_ptr<uint8_t[]> pixels; //!< Allocated by the first frame decoded into it
+		unsigned                   changed[4];
+		std::chrono::milliseconds  delay;
+	};
+
+	Threadpool*        pool;
+	Decoder            decoder; //!< Only used by the task which is decoding
+	std::mutex         mutex;
+	std::vector<Frame> ring;
+	size_t             first    = 0;     //!< The oldest decoded frame
+	size_t             ready    = 0;     //!< How many frames are decoded and not shown yet
+	bool               decoding = false; //!< A task is on the pool
+	bool               done     = false; //!< No more frames come: The animation ended, broke or isn't played anymore
+};
+
+AnimatedBitmap::AnimatedBitmap() {}
+AnimatedBitmap::~AnimatedBitmap() {
+	if(mShared) {
+		auto l = std::lock_guard<std::mutex>(mShared->mutex);
+		mShared->done = true;
+	}
+}
+
+void AnimatedBitmap::open(std::string const& path, Threadpool& pool, size_t frames) {
+	size_t length = 0;
+	auto   data   = mapFile(path, length);
+	open(std::move(data), length, pool, frames);
+}
+void AnimatedBitmap::open(std::shared_ptr<uint8_t[]> data, size_t length, Threadpool& pool, size_t frames) {
+	auto shared = std::make_shared<Shared>();
+	shared->pool = &pool;
+	shared->decoder.open(std::move(data), length);
+	shared->ring.resize(std::max<size_t>(frames, 1));
+
+	if(mShared) {
+		auto l = std::lock_guard<std::mutex>(mShared->mutex);
+		mShared->done = true;
+	}
+	mShared  = std::move(shared);
+	mStarted = false;
+	mDue     = std::chrono::steady_clock::time_point::min();
+
+	mBitmap = std::make_shared<Bitmap>();
+	mBitmap->init(mShared->decoder.width, mShared->decoder.height, Bitmap::RGBA); // Transparent
+	mBitmap->markDirty(); // Makes it live: Renderers update the parts which change instead of uploading all of it
+
+	decodeAhead();
+}
+
+/// Starts a task which fills the ring, unless one is running already
+void AnimatedBitmap::decodeAhead() {
+	auto& s = *mShared;
+	{ auto l = std::lock_guard<std::mutex>(s.mutex);
+		if(s.decoding || s.done || s.ready == s.ring.size()) return;
+		s.decoding = true;
+	}
+	s.pool->add([shared = mShared]() {
+		auto&  s     = *shared;
+		size_t bytes = s.decoder.canvas.size();
+		while(true) {
+			size_t slot;
+			{ auto l = std::lock_guard<std::mutex>(s.mutex);
+				if(s.done || s.ready == s.ring.size()) {
+					s.decoding = false;
+					return;
+				}
+				slot = (s.first + s.ready) % s.ring.size();
+			}
+			// Nobody else looks at the slot until it's counted as ready
+			auto& frame = s.ring[slot];
+			bool decoded;
+			try {
+				if(!frame.pixels) frame.pixels.reset(new uint8_t[bytes]);
+				decoded = s.decoder.next(frame.pixels.get(), frame.changed, frame.delay);
+			}
+			catch(std::exception&) {
+				decoded = false; // Broken or out of memory, keeps showing what worked
+			}
+			auto l = std::lock_guard<std::mutex>(s.mutex);
+			if(!decoded) {
+				s.done     = true;
+				s.decoding = false;
+				return;
+			}
+			s.ready++;
+		}
+	}, LANE_BULK);
+}
+
+bool AnimatedBitmap::advance(std::chrono::steady_clock::time_point now) {
+	if(!mShared) return false;
+	auto& s = *mShared;
+	if(!mStarted) {
+		mStarted = true;
+		mDue     = now;
+	}
+	if(now < mDue) return false;
+
+	size_t available;
+	bool   done;
+	{ auto l = std::lock_guard<std::mutex>(s.mutex);
+		available = s.ready;
+		done      = s.done;
+	}
+
+	// Frames which were due in the meantime are skipped, only what they changed is copied from the newest
+	unsigned       changed[4] = { 0, 0, 0, 0 };
+	Shared::Frame* shown      = nullptr;
+	size_t         count      = 0;
+	while(count < available && mDue <= now) {
+		auto& frame = s.ring[(s.first + count) % s.ring.size()];
+		unite(changed, frame.changed);
+		mDue += frame.delay;
+		shown = &frame;
+		count++;
+	}
+	if(shown && changed[0] != changed[2]) {
+		size_t stride = size_t(mBitmap->width()) * 4;
+		size_t row    = size_t(changed[2] - changed[0]) * 4;
+		for(unsigned y = changed[1]; y < changed[3]; y++) {
+			size_t offset = y * stride + size_t(changed[0]) * 4;
+			memcpy(mBitmap->data() + offset, shown->pixels.get() + offset, row);
+		}
+		mBitmap->markDirty(Rect(changed[0], changed[1], changed[2] - changed[0], changed[3] - changed[1]));
+	}
+
+	if(count > 0) {
+		auto l = std::lock_guard<std::mutex>(s.mutex);
+		s.first    = (s.first + count) % s.ring.size();
+		s.ready   -= count;
+		available  = s.ready;
+		done       = s.done;
+	}
+	if(mDue <= now && available == 0) {
+		// Ended, or the workers are behind: The animation waits for them instead of skipping what they didn't decode
+		mDue = done ? std::chrono::steady_clock::time_point::max() : now + PollInterval;
+	}
+
+	decodeAhead();
+	return shown != nullptr;
+}
+
+size_t AnimatedBitmap::buffered() const {
+	if(!mShared) return 0;
+	auto l = std::lock_guard<std::mutex>(mShared->mutex);
+	return mShared->ready;
+}
+size_t AnimatedBitmap::capacity() const noexcept {
+	return mShared ? mShared->ring.size() : 0;
+}
+
+} // namespace wwidget
@@ -0,0 +1,236 @@
+#include "../include/wwidget/Atlas.hpp"
+
+#include "../include/wwidget/Bitmap.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace wwidget {
+
+void Atlas::Page::reset(unsigned size) {
+	skyline.assign(1, Segment{0, 0, size});
+	dirty = true;
+}
+
+/// Bottom left: The lowest position along the skyline, the leftmost of those
+bool Atlas::Page::fit(unsigned width, unsigned height, unsigned size, unsigned& x, unsigned& y) const {
+	unsigned bestY = UINT_MAX;
+	for(size_t i = 0; i < skyline.size(); i++) {
+		unsigned left = skyline[i].x;
+		if(left + width > size) break;
+
+		unsigned top = 0;
+		for(size_t j = i; j < skyline.size() && skyline[j].x < left + width; j++) {
+			top = std::max(top, skyline[j].y);
+		}
+		if(top + height <= size && top < bestY) {
+			bestY = top;
+			x     = left;
+		}
+	}
+	y = bestY;
+	return bestY != UINT_MAX;
+}
+
+void Atlas::Page::add(unsigned x, unsigned y, unsigned width, unsigned height) {
+	auto iter = std::find_if(skyline.begin(), skyline.end(), [x](Segment const& s) { return s.x == x; });
+	iter = skyline.insert(iter, Segment{x, y + height, width});
+
+	// Cut away what's under the new segment
+	unsigned right = x + width;
+	auto next = iter + 1;
+	while(next != skyline.end() && next->x < right) {
+		unsigned end = next->x + next->width;
+		if(end <= right) {
+			next = skyline.erase(next);
+		}
+		else {
+			next->width = end - right;
+			next->x     = right;
+			break;
+		}
+	}
+
+	// Merge neighbors at the same height
+	for(size_t i = 0; i + 1 < skyline.size();) {
+		if(skyline[i].y == skyline[i + 1].y) {
+			skyline[i].width += skyline[i + 1].width;
+			skyline.erase(skyline.begin() + i + 1);
+		}
+		else ++i;
+	}
+}
+
+Atlas::Atlas(unsigned pageSize, unsigned maxItemSize, size_t maxPages) :
+	mPageSize(pageSize),
+	mMaxItemSize(std::min(maxItemSize, pageSize - 2 * Padding)),
+	mMaxPages(std::max<size_t>(1, maxPages))
+{}
+
+bool Atlas::accepts(Bitmap const& bitmap) const noexcept {
+	return
+		bitmap.format() != Bitmap::INVALID &&
+		bitmap.width()  > 0 && bitmap.width()  <= mMaxItemSize &&
+		bitmap.height() > 0 && bitmap.height() <= mMaxItemSize;
+}
+
+std::optional<AtlasRegion> Atlas::place(std::shared_ptr<Bitmap> const& bitmap) {
+	if(!bitmap || !bitmap->resident() || !accepts(*bitmap)) return std::nullopt;
+
+	auto iter = mEntries.find(bitmap.get());
+	if(iter != mEntries.end()) {
+		auto& entry = iter->second;
+		// A new bitmap at the address of a released one, or new pixels
+		if(entry.bitmap.lock() == bitmap && entry.data == bitmap->data() &&
+		   entry.region.width == bitmap->width() && entry.region.height == bitmap->height())
+		{
+			entry.lastUse   = ++mUses;
+			entry.lastFrame = mFrame;
+			return entry.region;
+		}
+		mEntries.erase(iter);
+	}
+
+	AtlasRegion region;
+	region.width  = bitmap->width();
+	region.height = bitmap->height();
+	if(!allocate(region.width, region.height, region)) {
+		if(mPages.size() < mMaxPages) {
+			Page page;
+			page.bitmap = std::make_shared<Bitmap>();
+			page.bitmap->init(mPageSize, mPageSize, Bitmap::RGBA);
+			memset(page.bitmap->data(), 0, size_t(mPageSize) * mPageSize * 4);
+			page.reset(mPageSize);
+			mPages.push_back(std::move(page));
+		}
+		if(!allocate(region.width, region.height, region) && !reclaim(region.width, region.height, region)) {
+			return std::nullopt;
+		}
+	}
+
+	blit(*bitmap, region);
+	mEntries[bitmap.get()] = Entry{ bitmap, bitmap->data(), region, ++mUses, mFrame };
+	return region;
+}
+
+void Atlas::remove(Bitmap const* bitmap) {
+	mEntries.erase(bitmap);
+}
+
+bool Atlas::allocate(unsigned width, unsigned height, AtlasRegion& region) {
+	for(size_t i = 0; i < mPages.size(); i++) {
+		unsigned x, y;
+		if(mPages[i].fit(width + 2 * Padding, height + 2 * Padding, mPageSize, x, y)) {
+			mPages[i].add(x, y, width + 2 * Padding, height + 2 * Padding);
+			region.page = (unsigned) i;
+			region.x    = x + Padding;
+			region.y    = y + Padding;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Atlas::reclaim(unsigned width, unsigned height, AtlasRegion& region) {
+	// The page whose most recent use is the oldest, leaving out the ones drawn in this frame
+	std::vector<uint64_t> lastUse(mPages.size(), 0);
+	std::vector<bool>     busy(mPages.size(), false);
+	for(auto& [bitmap, entry] : mEntries) {
+		lastUse[entry.region.page] = std::max(lastUse[entry.region.page], entry.lastUse);
+		if(entry.lastFrame == mFrame) busy[entry.region.page] = true;
+	}
+	size_t victim = SIZE_MAX;
+	for(size_t i = 0; i < mPages.size(); i++) {
+		if(!busy[i] && (victim == SIZE_MAX || lastUse[i] < lastUse[victim])) victim = i;
+	}
+	if(victim == SIZE_MAX) return false;
+
+	// Released bitmaps go first, then the least recently used until the rest and the new one fit
+	std::vector<std::pair<Bitmap const*, std::shared_ptr<Bitmap>>> keep;
+	for(auto iter = mEntries.begin(); iter != mEntries.end();) {
+		if(iter->second.region.page != victim) { ++iter; continue; }
+		auto bitmap = iter->second.bitmap.lock();
+		if(bitmap && iter->second.data == bitmap->data()) {
+			keep.emplace_back(iter->first, std::move(bitmap));
+			++iter;
+		}
+		else {
+			iter = mEntries.erase(iter);
+		}
+	}
+	std::sort(keep.begin(), keep.end(), [this](auto& a, auto& b) {
+		return mEntries[a.first].lastUse > mEntries[b.first].lastUse;
+	});
+
+	auto& page = mPages[victim];
+	while(true) {
+		// Tallest first packs tighter. The new bitmap counts as the most recently used.
+		std::vector<size_t> order(keep.size());
+		for(size_t i = 0; i < order.size(); i++) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&keep](size_t a, size_t b) {
+			return keep[a].second->height() > keep[b].second->height();
+		});
+
+		Page trial;
+		std::vector<AtlasRegion> regions(keep.size());
+		trial.reset(mPageSize);
+		auto put = [&](unsigned w, unsigned h, AtlasRegion& r) {
+			unsigned x, y;
+			if(!trial.fit(w + 2 * Padding, h + 2 * Padding, mPageSize, x, y)) return false;
+			trial.add(x, y, w + 2 * Padding, h + 2 * Padding);
+			r.page   = (unsigned) victim;
+			r.x      = x + Padding;
+			r.y      = y + Padding;
+			r.width  = w;
+			r.height = h;
+			return true;
+		};
+		bool fits = put(width, height, region);
+		for(size_t i = 0; fits && i < order.size(); i++) {
+			auto& bitmap = *keep[order[i]].second;
+			fits = put(bitmap.width(), bitmap.height(), regions[order[i]]);
+		}
+
+		if(fits) {
+			page.skyline = std::move(trial.skyline);
+			page.dirty   = true;
+			memset(page.bitmap->data(), 0, size_t(mPageSize) * mPageSize * 4);
+			for(size_t i = 0; i < keep.size(); i++) {
+				mEntries[keep[i].first].region = regions[i];
+				blit(*keep[i].second, regions[i]);
+			}
+			return true;
+		}
+		if(keep.empty()) return false; // Can't happen for bitmaps which are accepted
+		mEntries.erase(keep.back().first);
+		keep.pop_back();
+	}
+}
+
+void Atlas::blit(Bitmap const& bitmap, AtlasRegion const& region) {
+	auto& page = mPages[region.page];
+	uint8_t const* from   = bitmap.rgba(mScratch);
+	uint8_t*       to     = page.bitmap->data();
+	size_t         stride = size_t(mPageSize) * 4;
+	size_t         row    = size_t(region.width) * 4;
+
+	auto line = [&](unsigned y) { return to + y * stride + size_t(region.x) * 4; };
+	for(unsigned y = 0; y < region.height; y++) {
+		uint8_t* dst = line(region.y + y);
+		memcpy(dst, from + y * row, row);
+		// Extrude the left and right edges into the padding
+		for(unsigned p = 1; p <= Padding; p++) {
+			memcpy(dst - p * 4, dst, 4);
+			memcpy(dst + row + (p - 1) * 4, dst + row - 4, 4);
+		}
+	}
+	// And the top and bottom rows, with the corners
+	for(unsigned p = 1; p <= Padding; p++) {
+		memcpy(line(region.y - p) - Padding * 4, line(region.y) - Padding * 4, row + 2 * Padding * 4);
+		memcpy(line(region.y + region.height - 1 + p) - Padding * 4, line(region.y + region.height - 1) - Padding * 4, row + 2 * Padding * 4);
+	}
+	page.dirty = true;
+}
+
+} // namespace wwidget
@@ -2,121 +2,215 @@
 
 #include "../include/wwidget/Canvas.hpp"
 
-#include "../include/wwidget/Bitmap.hpp"
-#include "../include/wwidget/Font.hpp"
+#include "../include/wwidget/FrameArena.hpp"
+#include "../include/wwidget/Graveyard.hpp"
+#include "../include/wwidget/ImageCache.hpp"
+#include "../include/wwidget/Runtime.hpp"
 
 #include "../include/wwidget/async/Threadpool.hpp"
 #include "../include/wwidget/async/Queue.hpp"
 
 #include <GL/gl.h>
 
-#include <unordered_map>
+#include <algorithm>
 
 namespace wwidget {
 
 struct BasicContext::Implementation {
-	struct {
-		std::mutex                                             mutex;
-		std::unordered_map<std::string, std::weak_ptr<Bitmap>> images;
-		std::unordered_map<std::string, std::weak_ptr<Font>>   fonts;
+	std::shared_ptr<Runtime> runtime;
+	size_t                   fontsRegistered = 0; //!< How many of the runtime's fonts the canvas knows
 
-		auto lock() { return std::unique_lock<std::mutex>(mutex); }
-	} cache;
+	/// Tasks taken from a queue which didn't run yet, they go first in the next update
+	struct Backlog {
+		std::vector<unique_task> tasks;
+		size_t                   next = 0;
 
-	Threadpool              threadpool;
-	TaskQueue               updateTasks;
+		size_t size() const noexcept { return tasks.size() - next; }
+	};
+
+	TaskQueue                 updateTasks[PRIORITY_COUNT];
+	Backlog                   backlogs[PRIORITY_COUNT];
+	TaskStats                 taskStats[PRIORITY_COUNT];
+	std::chrono::microseconds taskBudget{4000};
+
+	struct Timer {
+		std::chrono::steady_clock::time_point when;
+		uint64_t                              order; //!< Timers due at the same time run in the order they were added
+		unique_task                           task;
+
+		/// For a heap with the earliest timer on top
+		bool operator<(Timer const& other) const noexcept {
+			return when != other.when ? when > other.when : order > other.order;
+		}
+	};
+	std::vector<Timer>                    timers;
+	uint64_t                              timersAdded = 0;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	std::atomic<bool> frameRequested{true};
+	int               animations = 0;
+
+	FdWatcher fds;
+
+	FrameArena              frameArena;
 
 	std::shared_ptr<Canvas> canvas;
 	Widget*                 rootWidget = nullptr;
 
+	// Declared after the canvas: Destroying widgets can release textures
+	Graveyard                 graveyard;
+	std::chrono::microseconds destructionBudget{1000};
 
 	std::string defaultFont;
 
-	Implementation() :
-		threadpool(std::max(1u, std::thread::hardware_concurrency() - 1))
+	Implementation(std::shared_ptr<Runtime> runtime) :
+		runtime(std::move(runtime))
 	{}
+
+	/// Runs the tasks of a priority until the deadline has passed, but at least minimum tasks
+	size_t runTasks(TaskPriority priority, std::chrono::steady_clock::time_point deadline, size_t minimum) {
+		auto& backlog = backlogs[priority];
+		updateTasks[priority].drain(backlog.tasks);
+
+		size_t n = 0;
+		while(backlog.size() > 0) {
+			// Most tasks are tiny, only look at the clock every few of them
+			if(n >= minimum && (n - minimum) % 16 == 0 && std::chrono::steady_clock::now() >= deadline)
+				break;
+			auto& task = backlog.tasks[backlog.next++];
+			task();
+			task = nullptr;
+			++n;
+		}
+		if(backlog.size() == 0) {
+			backlog.tasks.clear();
+			backlog.next = 0;
+		}
+
+		taskStats[priority].executed += n;
+		return n;
+	}
+	/// Runs the timers which were due when the update started. The ones they add wait for the next update.
+	void runTimers() {
+		std::vector<unique_task> due;
+		while(!timers.empty() && timers.front().when <= now) {
+			std::pop_heap(timers.begin(), timers.end());
+			due.push_back(std::move(timers.back().task));
+			timers.pop_back();
+		}
+		for(auto& task : due) {
+			task();
+		}
+	}
+	/// Input tasks always run, normal ones within the budget, idle ones with what's left of it
+	size_t runTasks(std::chrono::steady_clock::time_point deadline, bool first) {
+		size_t n = runTasks(PRIORITY_INPUT, std::chrono::steady_clock::time_point::max(), 0);
+		// One normal task per update, even if input ate the budget
+		n += runTasks(PRIORITY_NORMAL, deadline, first ? 1 : 0);
+		// Idle tasks are still taken from the queue, so they're counted as waiting
+		bool normalDone = backlogs[PRIORITY_NORMAL].size() == 0;
+		n += runTasks(PRIORITY_IDLE, normalDone ? deadline : std::chrono::steady_clock::time_point::min(), 0);
+		return n;
+	}
 };
 
 BasicContext::BasicContext() :
-	mImpl(new Implementation)
+	BasicContext(Runtime::shared())
+{}
+BasicContext::BasicContext(std::shared_ptr<Runtime> runtime) :
+	mImpl(new Implementation(std::move(runtime)))
 {
 	mImpl->defaultFont = "/usr/share/fonts/TTF/LiberationMono-Regular.ttf"; // TODO: Font path not cross platform;
+	for(auto& queue : mImpl->updateTasks) {
+		queue.wakeupHook([this]() { requestFrame(); });
+	}
 }
 BasicContext::~BasicContext() {
+	// Workers defer their results, make sure they don't anymore before the queue goes away
+	mImpl->runtime->detach(this);
 	delete mImpl;
 }
 
 void BasicContext::cleanCache() {
-	/*
-	for(auto& [url, res] : mCache->images) {
-		if(res.unique())
-			res.reset();
-	}
-	for(auto& [url, res] : mCache->fonts) {
-		if(res.unique())
-			res.reset();
-	}
-	*/
+	// Fonts are registered once for the whole runtime and stay
+	mImpl->runtime->imageCache().trim(0);
 }
 
-void BasicContext::defer(std::function<void()> fn) {
-	mImpl->updateTasks.add(std::move(fn));
+void BasicContext::defer(unique_task fn, TaskPriority priority) {
+	mImpl->updateTasks[priority].add(std::move(fn));
+}
+void BasicContext::deferUntil(std::chrono::steady_clock::time_point when, unique_task fn) {
+	auto& timers = mImpl->timers;
+	timers.push_back(Implementation::Timer{ when, mImpl->timersAdded++, std::move(fn) });
+	std::push_heap(timers.begin(), timers.end());
+}
+std::chrono::steady_clock::time_point BasicContext::now() const noexcept {
+	return mImpl->now;
+}
+std::chrono::steady_clock::time_point BasicContext::nextTimer() const noexcept {
+	return mImpl->timers.empty() ? std::chrono::steady_clock::time_point::max() : mImpl->timers.front().when;
+}
+void BasicContext::wakeup() {
+	mImpl->fds.interrupt();
 }
 
-void BasicContext::loadImage(std::function<void(std::shared_ptr<Bitmap>)> fn, std::string const& url) {
-	// printf("Started loading image %s\n", url.c_str());
+std::shared_ptr<FdWatch> BasicContext::watch(int fd, unique_function<void(int)> fn, int events, Owner* owner) {
+	return mImpl->fds.watch(fd, std::move(fn), events, owner);
+}
+FdWatcher& BasicContext::fdWatcher() noexcept {
+	return mImpl->fds;
+}
 
-	{ // Check cache
-		auto& cache = mImpl->cache;
-		auto _  = cache.lock();
-		if(auto s = cache.images[url].lock()) {
-			// printf("Found %s in cache\n", url.c_str());
-			fn(std::move(s));
-			return;
-		}
+bool BasicContext::needsFrame() const noexcept {
+	if(mImpl->frameRequested.load(std::memory_order_acquire) || mImpl->animations > 0)
+		return true;
+	if(nextTimer() <= std::chrono::steady_clock::now())
+		return true;
+	Widget* root = mImpl->rootWidget;
+	return root && (
+		root->needsRelayout() || root->childNeedsRelayout() ||
+		root->needsRedraw()   || root->childNeedsRedraw());
+}
+void BasicContext::requestFrame() {
+	if(!mImpl->frameRequested.exchange(true, std::memory_order_acq_rel)) {
+		wakeup();
 	}
+}
 
-	// TODO: do this in a proper thread pool
-	// printf("Loading %s in new thread...\n", url.c_str());
-	mImpl->threadpool.add(
-		[this, url = std::string(url), fn = std::move(fn)]() {
-			std::shared_ptr<Bitmap> s;
-
-			try { s = loadImage(url); }
-			catch(std::runtime_error& e) {
-				fprintf(stderr, "%s\n", e.what());
-			}
-
-			defer([fn = std::move(fn), s = std::move(s), url = std::move(url)]() {
-				// printf("Invoking callback for %s\n", url.c_str());
-				fn(std::move(s));
-				// printf("Finished loading %s\n", url.c_str());
-			});
-		}
-	);
+void BasicContext::startAnimation() {
+	mImpl->animations++;
+}
+void BasicContext::stopAnimation() {
+	mImpl->animations--;
 }
 
+std::shared_ptr<ImageRequest> BasicContext::loadImage(unique_function<void(std::shared_ptr<Bitmap>)> fn, std::string const& url, Owner* owner, Widget* viewer) {
+	return mImpl->runtime->loadImage(this, std::move(fn), url, owner, viewer);
+}
 std::shared_ptr<Bitmap> BasicContext::loadImage(std::string const& url) {
-	auto& cache = mImpl->cache;
-	cache.mutex.lock();
-	auto& cacheEntry = cache.images[url];
-	auto  s          = cacheEntry.lock();
-	cache.mutex.unlock();
-
-	if(!s) {
-		s = std::make_shared<Bitmap>();
-		s->load(url);
-		{ auto lock = cache.lock();
-			cacheEntry = s;
-		}
-	}
+	return mImpl->runtime->loadImage(url);
+}
 
-	return s;
+void BasicContext::taskBudget(std::chrono::microseconds budget) noexcept {
+	mImpl->taskBudget = budget;
+}
+TaskStats const& BasicContext::taskStats(TaskPriority priority) const noexcept {
+	return mImpl->taskStats[priority];
+}
+
+void BasicContext::collect(std::unique_ptr<Widget> w) {
+	mImpl->graveyard.collect(std::move(w));
+}
+void BasicContext::collectGarbage() {
+	mImpl->graveyard.clear();
+}
+void BasicContext::destructionBudget(std::chrono::microseconds budget) noexcept {
+	mImpl->destructionBudget = budget;
 }
 
 void BasicContext::execute(Widget* from, std::string_view cmd) {
 	if(cmd == "remove") {
-		from->remove();
+		from->destroy();
 	}
 }
 void BasicContext::execute(Widget* from, std::string_view const* cmds, size_t count) {
@@ -126,22 +220,69 @@ void BasicContext::execute(Widget* from, std::string_view const* cmds, size_t co
 }
 
 bool BasicContext::update() {
-	bool a, b;
+	// Cleared before the tasks run, so whatever arrives during the update requests the next frame
+	mImpl->frameRequested.store(false, std::memory_order_release);
+
+	// Event loops which don't wait with the fd watcher still get the callbacks once per update
+	if(!mImpl->fds.empty()) {
+		mImpl->fds.wait(std::chrono::milliseconds(0));
+	}
+
+	mImpl->now = std::chrono::steady_clock::now();
+	mImpl->runTimers();
+
+	auto deadline = mImpl->now + mImpl->taskBudget;
+
+	bool a, b, relayouted = false;
 	unsigned count = 0;
 	do {
-		a = 0 < mImpl->updateTasks.executeSingleConsumer();
+		a = 0 < mImpl->runTasks(deadline, count == 0);
 		b = rootWidget() ? rootWidget()->updateLayout() : false;
+		relayouted |= b;
 		++count;
 	} while((a || b) && count < 100);
 
-	return count > 1;
+	// What didn't fit into the budget waits for the next update
+	bool postponed = false;
+	for(size_t i = 0; i < PRIORITY_COUNT; i++) {
+		auto& backlog = mImpl->backlogs[i];
+		auto& stats   = mImpl->taskStats[i];
+		stats.waiting = backlog.size();
+		if(stats.waiting > 0) {
+			stats.postponed += stats.waiting;
+			stats.postponedUpdates++;
+			postponed = true;
+
+			backlog.tasks.erase(backlog.tasks.begin(), backlog.tasks.begin() + backlog.next);
+			backlog.next = 0;
+		}
+	}
+
+	// Things might have scrolled into (or out of) view
+	if(relayouted) {
+		mImpl->runtime->reprioritizeImageLoads(this);
+	}
+
+	if(!mImpl->graveyard.empty()) {
+		mImpl->graveyard.sweep(std::chrono::steady_clock::now() + mImpl->destructionBudget);
+	}
+
+	// Don't let an event loop fall asleep on what's left
+	if(postponed || !mImpl->graveyard.empty()) {
+		requestFrame();
+	}
+
+	return count > 1 || postponed || !mImpl->graveyard.empty();
 }
 void BasicContext::draw() {
 	if(mImpl->canvas && rootWidget()) {
+		mImpl->fontsRegistered = mImpl->runtime->registerFonts(canvas(), mImpl->fontsRegistered);
 		canvas().beginFrame(rootWidget()->size(), 1);
 		rootWidget()->draw(*mImpl->canvas);
 		canvas().endFrame();
+		if(canvas().uploadsPending()) requestFrame();
 	}
+	mImpl->frameArena.reset();
 }
 
 void    BasicContext::rootWidget(Widget* w) {
@@ -156,10 +297,22 @@ Widget* BasicContext::rootWidget() {
 }
 
 void BasicContext::canvas(std::shared_ptr<Canvas> c) noexcept {
-	mImpl->canvas = c;
+	mImpl->canvas          = c;
+	mImpl->fontsRegistered = 0;
 }
 Canvas& BasicContext::canvas() const noexcept {
 	return *mImpl->canvas;
 }
 
+FrameArena& BasicContext::frameArena() noexcept {
+	return mImpl->frameArena;
+}
+
+Runtime& BasicContext::runtime() noexcept {
+	return *mImpl->runtime;
+}
+Threadpool& BasicContext::threadpool() noexcept {
+	return mImpl->runtime->threadpool();
+}
+
 } // namespace wwidget
@@ -1,13 +1,32 @@
 #include "../include/wwidget/Bitmap.hpp"
+#include "../include/wwidget/Attributes.hpp"
 #include "../include/wwidget/Error.hpp"
+#include "../include/wwidget/MappedFile.hpp"
+#include "../include/wwidget/Pixels.hpp"
 
 #include "thirdparty/stb_image.h"
 extern "C" {
 	#include <memory.h>
 }
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
 namespace wwidget {
 
+static
+unsigned components(Bitmap::Format fmt) {
+	switch(fmt) {
+		case Bitmap::ALPHA: return 1;
+		case Bitmap::RGB:   return 3;
+		case Bitmap::RGBA:  return 4;
+		default: throw std::runtime_error("Invalid image format");
+	}
+}
+
 Bitmap::Bitmap() :
 	mWidth(0), mHeight(0),
 	mFormat(INVALID),
@@ -26,26 +45,34 @@ void Bitmap::init(
 	mData = std::move(data);
 	mWidth = w;
 	mHeight = h;
+	mSourceWidth = w;
+	mSourceHeight = h;
 	mFormat = fmt;
+	mMips.clear();
+	mWriter.reset();
+	mDirty[0] = mDirty[2] = 0;
+	mReloader = nullptr;
 }
 void Bitmap::init(unsigned w, unsigned h, Format fmt) {
-	unsigned components;
-	switch (fmt) {
-		case ALPHA: components = 1; break;
-		case RGB: components = 3; break;
-		case INVALID: fmt = RGBA; // FALLTHROUGH
-		case RGBA: components = 4; break;
-		default: throw std::runtime_error("Invalid image format");
-	}
-	unsigned num_values = w * h * components;
+	if(fmt == INVALID) fmt = RGBA;
+	size_t num_values = size_t(w) * h * components(fmt);
 	this->init({(uint8_t*)malloc(num_values), &::free}, w, h, fmt);
 	memset(mData.get(), 0, num_values);
 }
 void Bitmap::load(std::string const& url, Format preferredFormat) {
-	int w = 0, h = 0, c = 0;
-
 	// printf("Load Bitmap %s (%p)\n", url.c_str(), this);
 
+	size_t length = 0;
+	auto   file   = mapFile(url, length);
+	decode(file.get(), length, preferredFormat, "'" + url + "'");
+	mReloader = [url, fmt = mFormat](Bitmap& into) { into.load(url, fmt); };
+}
+void Bitmap::load(uint8_t const* data, size_t length, Format preferredFormat) {
+	decode(data, length, preferredFormat, "image from memory");
+}
+void Bitmap::decode(uint8_t const* data, size_t length, Format preferredFormat, std::string const& source) {
+	int w = 0, h = 0, c = 0;
+
 	switch(preferredFormat) {
 		case INVALID: c = 0; break;
 		case ALPHA: c = STBI_grey; break;
@@ -53,14 +80,21 @@ void Bitmap::load(std::string const& url, Format preferredFormat) {
 		case RGBA: c = STBI_rgb_alpha; break;
 	}
 
+	if(length > INT_MAX) {
+		throw std::runtime_error("Failed loading " + source + ": Too big");
+	}
+
 	stbi_convert_iphone_png_to_rgb(true);
-	auto data = std::shared_ptr<uint8_t[]>(
-		stbi_load(url.c_str(), &w, &h, &c, c),
+	int requested = c;
+	auto pixels = std::shared_ptr<uint8_t[]>(
+		stbi_load_from_memory(data, (int) length, &w, &h, &c, requested),
 		&stbi_image_free
 	);
-	if(!data) {
-		throw std::runtime_error("Failed loading '" + url + "': " + stbi_failure_reason());
+	if(!pixels) {
+		throw std::runtime_error("Failed loading " + source + ": " + stbi_failure_reason());
 	}
+	// c is what the file has, the pixels have what we asked for
+	if(requested) c = requested;
 
 	free();
 
@@ -71,48 +105,236 @@ void Bitmap::load(std::string const& url, Format preferredFormat) {
 		case 4: fmt = RGBA; break;
 		default: throw std::runtime_error("File has invalid number of components");
 	}
-	init(data, w, h, fmt);
+	init(pixels, w, h, fmt);
+}
+void Bitmap::map(std::string const& path, size_t offset, unsigned w, unsigned h, Format fmt) {
+	size_t bytes  = size_t(w) * h * components(fmt);
+	size_t length = 0;
+	auto   file   = mapFile(path, length);
+	if(offset > length || length - offset < bytes) {
+		throw std::runtime_error(
+			"Failed mapping '" + path + "': " + std::to_string(length) + " bytes are too few for " +
+			std::to_string(w) + "x" + std::to_string(h) + " pixels at offset " + std::to_string(offset));
+	}
+	// Points into the mapping and keeps it alive
+	init(std::shared_ptr<uint8_t[]>(file, file.get() + offset), w, h, fmt);
+	mReloader = [path, offset, w, h, fmt](Bitmap& into) { into.map(path, offset, w, h, fmt); };
+}
+size_t Bitmap::decodedSize(std::string const& url) noexcept {
+	int w = 0, h = 0, c = 0;
+	if(!stbi_info(url.c_str(), &w, &h, &c)) {
+		return 0;
+	}
+	return size_t(w) * size_t(h) * size_t(c);
 }
 Bitmap Bitmap::toRGBA() {
+	reload();
 	Bitmap result;
+	if(mFormat == RGBA) {
+		result.init(mData, width(), height(), RGBA); // Shares the pixels
+	}
+	else {
+		size_t pixels = size_t(width()) * height();
+		// Every byte gets written, no need to clear it first
+		result.init({(uint8_t*)malloc(pixels * 4), &::free}, width(), height(), RGBA);
+		convertToRGBA(result.data());
+	}
+	return result;
+}
+uint8_t const* Bitmap::rgba(std::vector<uint8_t>& scratch) const {
+	if(!resident()) throw exceptions::InvalidOperation("Bitmap::rgba: The pixels are released, reload() them first");
+	if(mFormat == RGBA) return data();
+
+	scratch.resize(size_t(width()) * height() * 4);
+	convertToRGBA(scratch.data());
+	return scratch.data();
+}
+uint8_t const* Bitmap::rgba(std::vector<uint8_t>& scratch, unsigned x, unsigned y, unsigned w, unsigned h) const {
+	if(!resident()) throw exceptions::InvalidOperation("Bitmap::rgba: The pixels are released, reload() them first");
+	if(mFormat == RGBA) return data();
+
+	scratch.resize(size_t(width()) * height() * 4);
+	uint8_t const* from = data();
+	for(unsigned row = y; row < y + h; row++) {
+		size_t first = size_t(row) * width() + x;
+		switch(mFormat) {
+			case RGB:   pixels::rgbToRgba(from + first * 3, scratch.data() + first * 4, w); break;
+			case ALPHA: pixels::alphaToRgba(from + first, scratch.data() + first * 4, w); break;
+			default: throw std::runtime_error("Invalid format: INVALID");
+		}
+	}
+	return scratch.data();
+}
+void Bitmap::convertToRGBA(uint8_t* to) const {
+	size_t pixels = size_t(width()) * height();
 	switch(mFormat) {
-		case Format::INVALID: {
-			throw std::runtime_error("Invalid format: INVALID");
-		} break;
-		case Format::RGBA: {
-			result = *this;
-		} break;
-		case Format::RGB: {
-			result.init(width(), height(), RGBA);
-			for(size_t i = 0; i < width() * height(); i++) {
-				result.data()[i * 4 + 0] = data()[i * 3 + 0];
-				result.data()[i * 4 + 1] = data()[i * 3 + 1];
-				result.data()[i * 4 + 2] = data()[i * 3 + 2];
-				result.data()[i * 4 + 3] = 255u;
-			}
-		} break;
-		case Format::ALPHA: {
-			result.init(width(), height(), RGBA);
-			for(size_t i = 0; i < width() * height(); i++) {
-				result.data()[i * 4 + 0] = 255u;
-				result.data()[i * 4 + 1] = 255u;
-				result.data()[i * 4 + 2] = 255u;
-				result.data()[i * 4 + 3] = data()[i];
-			}
-		} break;
+		case RGB:   pixels::rgbToRgba(data(), to, pixels); break;
+		case ALPHA: pixels::alphaToRgba(data(), to, pixels); break;
+		case RGBA:  memcpy(to, data(), pixels * 4); break;
+		default: throw std::runtime_error("Invalid format: INVALID");
 	}
+}
+void Bitmap::premultiply() {
+	if(mFormat != RGBA) throw exceptions::InvalidOperation("Bitmap::premultiply needs RGBA");
+	reload();
+	pixels::premultiply(data(), size_t(width()) * height());
+	mRendererProxy.reset();
+	mReloader = nullptr;
+}
+void Bitmap::swapRedBlue() {
+	if(mFormat != RGBA) throw exceptions::InvalidOperation("Bitmap::swapRedBlue needs RGBA");
+	reload();
+	pixels::swapRedBlue(data(), data(), size_t(width()) * height());
+	mRendererProxy.reset();
+	mReloader = nullptr;
+}
+std::shared_ptr<Bitmap> Bitmap::scaledDown(unsigned maxSize) const {
+	if(!resident()) throw exceptions::InvalidOperation("Bitmap::scaledDown: The pixels are released, reload() them first");
+	float    scale = std::min(1.f, maxSize / (float) std::max(width(), height()));
+	unsigned w     = std::max(1u, (unsigned) std::lround(width()  * scale));
+	unsigned h     = std::max(1u, (unsigned) std::lround(height() * scale));
+
+	auto result = std::make_shared<Bitmap>();
+	result->init(w, h, mFormat);
+	pixels::downscale(data(), width(), height(), result->data(), w, h, mFormat);
+	result->mSourceWidth  = mSourceWidth;
+	result->mSourceHeight = mSourceHeight;
 	return result;
 }
-void Bitmap::load(uint8_t const* data, size_t length, Format preferredFormat) {
-	throw exceptions::Unimplemented();
+void Bitmap::generateMips(unsigned smallest) {
+	mMips.clear();
+	Bitmap const* from = this;
+	while(std::max(from->width(), from->height()) / 2 >= std::max(1u, smallest)) {
+		mMips.push_back(from->scaledDown(std::max(from->width(), from->height()) / 2));
+		from = mMips.back().get();
+	}
+}
+std::shared_ptr<Bitmap> Bitmap::level(float width, float height) {
+	auto result = shared_from_this();
+	for(auto& mip : mMips) {
+		if(mip->width() < width || mip->height() < height) break;
+		result = mip;
+	}
+	return result;
 }
 void Bitmap::free() {
 	// if(mData)
 	// 	printf("Free Bitmap %p\n", this);
 	mRendererProxy.reset();
 	mData.reset();
+	mMips.clear();
+	mWriter.reset();
+	mDirty[0] = mDirty[2] = 0;
+	mReloader = nullptr;
 	mWidth = mHeight = 0;
+	mSourceWidth = mSourceHeight = 0;
 	mFormat = INVALID;
 }
 
+bool Bitmap::releasePixels() noexcept {
+	if(!mReloader || !mData) return false;
+	mData.reset();
+	return true;
+}
+void Bitmap::reload() {
+	if(resident()) return;
+
+	Bitmap fresh;
+	mReloader(fresh);
+	if(fresh.width() != mWidth || fresh.height() != mHeight || fresh.format() != mFormat) {
+		throw std::runtime_error("Failed reloading bitmap: The source changed");
+	}
+	mData = std::move(fresh.mData);
+}
+size_t Bitmap::cpuBytes() const noexcept {
+	return mData ? size_t(mWidth) * mHeight * components(mFormat) : 0;
+}
+size_t Bitmap::gpuBytes() const noexcept {
+	return mRendererProxy ? size_t(mWidth) * mHeight * 4 : 0;
+}
+
+struct Bitmap::Writer {
+	std::mutex                 mutex;
+	std::shared_ptr<uint8_t[]> back;
+	unsigned                   written[4] = { 0, 0, 0, 0 }; //!< Finished, but not swapped in yet. Like mDirty.
+};
+
+/// Grows the box x0, y0, x1, y1 by area, clamped to width x height
+static
+void unite(unsigned (&box)[4], Rect const& area, unsigned width, unsigned height) {
+	auto clamp = [](float v, unsigned max) { return (unsigned) std::min<float>(std::max(v, 0.f), (float) max); };
+	unsigned x0 = clamp(std::floor(area.min.x), width),  y0 = clamp(std::floor(area.min.y), height);
+	unsigned x1 = clamp(std::ceil (area.max.x), width),  y1 = clamp(std::ceil (area.max.y), height);
+	if(x0 >= x1 || y0 >= y1) return;
+	if(box[0] == box[2]) {
+		box[0] = x0; box[1] = y0; box[2] = x1; box[3] = y1;
+	}
+	else {
+		box[0] = std::min(box[0], x0); box[1] = std::min(box[1], y0);
+		box[2] = std::max(box[2], x1); box[3] = std::max(box[3], y1);
+	}
+}
+
+void Bitmap::markDirty(Rect const& area) {
+	mLive = true;
+	mReloader = nullptr; // The changes would be lost
+	unite(mDirty, area, mWidth, mHeight);
+}
+void Bitmap::markDirty() {
+	markDirty(Rect(mWidth, mHeight));
+}
+bool Bitmap::takeDirty(unsigned& x, unsigned& y, unsigned& w, unsigned& h) noexcept {
+	if(mDirty[0] == mDirty[2]) return false;
+	x = mDirty[0];
+	y = mDirty[1];
+	w = mDirty[2] - mDirty[0];
+	h = mDirty[3] - mDirty[1];
+	mDirty[0] = mDirty[2] = 0;
+	return true;
+}
+
+void Bitmap::enableDoubleBuffering() {
+	if(mWriter) return;
+	reload();
+	size_t bytes = size_t(mWidth) * mHeight * components(mFormat);
+	auto writer = std::make_shared<Writer>();
+	writer->back = std::shared_ptr<uint8_t[]>((uint8_t*)malloc(std::max<size_t>(bytes, 1)), &::free);
+	if(bytes) memcpy(writer->back.get(), data(), bytes);
+	mWriter = std::move(writer);
+	mMips.clear();
+	mLive = true;
+	mReloader = nullptr;
+}
+uint8_t* Bitmap::beginWrite() {
+	if(!mWriter) throw exceptions::InvalidOperation("Bitmap::beginWrite needs enableDoubleBuffering");
+	mWriter->mutex.lock();
+	return mWriter->back.get();
+}
+void Bitmap::endWrite(Rect const& changed) {
+	unite(mWriter->written, changed, mWidth, mHeight);
+	mWriter->mutex.unlock();
+}
+void Bitmap::endWrite() {
+	endWrite(Rect(mWidth, mHeight));
+}
+bool Bitmap::swapBuffers() {
+	if(!mWriter) return false;
+	auto l = std::unique_lock<std::mutex>(mWriter->mutex, std::try_to_lock);
+	auto& written = mWriter->written;
+	if(!l.owns_lock() || written[0] == written[2]) return false;
+
+	std::swap(mData, mWriter->back);
+	unite(mDirty, Rect(written[0], written[1], written[2] - written[0], written[3] - written[1]), mWidth, mHeight);
+
+	// The old image becomes the back buffer, bring it up to date
+	size_t pixel = components(mFormat);
+	size_t row   = (written[2] - written[0]) * pixel;
+	for(unsigned y = written[1]; y < written[3]; y++) {
+		size_t offset = (size_t(y) * mWidth + written[0]) * pixel;
+		memcpy(mWriter->back.get() + offset, mData.get() + offset, row);
+	}
+	written[0] = written[2] = 0;
+	return true;
+}
+
 } // namespace wwidget
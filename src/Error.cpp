@@ -26,6 +26,10 @@ Unimplemented::Unimplemented() :
 	AnyError("Called an unimplemented function")
 {}
 
+Cancelled::Cancelled() :
+	AnyError("Cancelled")
+{}
+
 InvalidPointer::InvalidPointer(std::string const& argumentName) :
 	AnyError("Called invalid pointer: " + argumentName)
 {}
@@ -0,0 +1,140 @@
+#include "../include/wwidget/FdWatcher.hpp"
+
+#include "../include/wwidget/Error.hpp"
+
+#ifdef __linux__
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+	#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <utility>
+
+namespace wwidget {
+
+void FdWatch::cancel() {
+	if(!mWatcher) return;
+	removeFromOwner();
+	// Might be our own callback which is running, the watcher puts it back if we're still active afterwards
+	mCallback = nullptr;
+	std::exchange(mWatcher, nullptr)->remove(this);
+}
+
+#ifdef __linux__
+
+static
+uint32_t toEpoll(int events) noexcept {
+	return
+		((events & FD_READABLE) ? EPOLLIN  : 0u) |
+		((events & FD_WRITABLE) ? EPOLLOUT : 0u);
+}
+static
+int fromEpoll(uint32_t events) noexcept {
+	return
+		((events & EPOLLIN)              ? FD_READABLE : 0) |
+		((events & EPOLLOUT)             ? FD_WRITABLE : 0) |
+		((events & (EPOLLHUP|EPOLLERR)) ? FD_HANGUP   : 0);
+}
+
+FdWatcher::FdWatcher() :
+	mEpoll(epoll_create1(EPOLL_CLOEXEC)),
+	mInterrupt(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+	if(mEpoll < 0 || mInterrupt < 0) {
+		throw exceptions::InvalidOperation(std::string("FdWatcher: ") + strerror(errno));
+	}
+	epoll_event ev = {};
+	ev.events  = EPOLLIN;
+	ev.data.fd = mInterrupt;
+	epoll_ctl(mEpoll, EPOLL_CTL_ADD, mInterrupt, &ev);
+}
+FdWatcher::~FdWatcher() {
+	// Outstanding handles just become inactive
+	for(auto& [fd, watch] : mWatches) {
+		watch->removeFromOwner();
+		watch->mWatcher  = nullptr;
+		watch->mCallback = nullptr;
+	}
+	close(mInterrupt);
+	close(mEpoll);
+}
+
+std::shared_ptr<FdWatch> FdWatcher::watch(int fd, unique_function<void(int)> fn, int events, Owner* owner) {
+	if(fd == mInterrupt || mWatches.count(fd)) {
+		throw exceptions::InvalidOperation("FdWatcher::watch: fd " + std::to_string(fd) + " is already watched");
+	}
+
+	epoll_event ev = {};
+	ev.events  = toEpoll(events);
+	ev.data.fd = fd;
+	if(epoll_ctl(mEpoll, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		throw exceptions::InvalidOperation("FdWatcher::watch: fd " + std::to_string(fd) + ": " + strerror(errno));
+	}
+
+	auto result = std::make_shared<FdWatch>(this, fd, events, std::move(fn));
+	if(owner) owner->transferOwnership(result.get());
+	mWatches.emplace(fd, result);
+	return result;
+}
+
+void FdWatcher::remove(FdWatch* watch) {
+	// Fails if the fd was closed before, which already took it out of the epoll set
+	epoll_ctl(mEpoll, EPOLL_CTL_DEL, watch->mFd, nullptr);
+	mWatches.erase(watch->mFd);
+}
+
+size_t FdWatcher::wait(std::chrono::milliseconds timeout) {
+	epoll_event events[32];
+	int count = epoll_wait(mEpoll, events, 32, timeout.count() < 0 ? -1 : (int) timeout.count());
+	if(count <= 0) return 0; // Timeout or EINTR
+
+	size_t n = 0;
+	for(int i = 0; i < count; i++) {
+		int fd = events[i].data.fd;
+		if(fd == mInterrupt) {
+			uint64_t value;
+			while(read(mInterrupt, &value, sizeof(value)) > 0) {}
+			continue;
+		}
+
+		// An earlier callback might have cancelled it
+		auto iter = mWatches.find(fd);
+		if(iter == mWatches.end()) continue;
+		auto watch = iter->second;
+
+		auto fn = std::move(watch->mCallback);
+		try { fn(fromEpoll(events[i].events)); }
+		catch(...) {
+			if(watch->mWatcher) watch->mCallback = std::move(fn);
+			throw;
+		}
+		if(watch->mWatcher) watch->mCallback = std::move(fn);
+		++n;
+	}
+	return n;
+}
+
+void FdWatcher::interrupt() noexcept {
+	uint64_t one = 1;
+	[[maybe_unused]] auto written = write(mInterrupt, &one, sizeof(one));
+}
+
+#else // Not linux: Nothing to wait with
+
+FdWatcher::FdWatcher() {}
+FdWatcher::~FdWatcher() {}
+
+std::shared_ptr<FdWatch> FdWatcher::watch(int fd, unique_function<void(int)> fn, int events, Owner* owner) {
+	throw exceptions::Unimplemented();
+}
+void FdWatcher::remove(FdWatch* watch) {}
+
+size_t FdWatcher::wait(std::chrono::milliseconds timeout) { return 0; }
+void   FdWatcher::interrupt() noexcept {}
+
+#endif
+
+} // namespace wwidget
@@ -0,0 +1,94 @@
+#include "../include/wwidget/FrameArena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace wwidget {
+
+static inline
+char* alignUp(char* p, size_t alignment) noexcept {
+	uintptr_t i = (uintptr_t) p;
+	return (char*)((i + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+FrameArena::FrameArena(size_t initialSize) :
+	mBlocks(nullptr),
+	mCursor(nullptr),
+	mEnd(nullptr),
+	mUsed(0),
+	mCapacity(0),
+	mHighWater(0)
+{
+	if(initialSize) addBlock(initialSize);
+}
+FrameArena::~FrameArena() {
+	freeBlocks();
+}
+
+void FrameArena::addBlock(size_t minSize) {
+	// Grow geometrically, so a frame needs few blocks even if it is much larger than the last one
+	size_t size = std::max(minSize, mCapacity);
+
+	Block* block = (Block*) malloc(sizeof(Block) + size);
+	if(!block) throw std::bad_alloc();
+	block->next = mBlocks;
+	block->size = size;
+	mBlocks     = block;
+	mCapacity  += size;
+
+	mCursor = (char*)(block + 1);
+	mEnd    = mCursor + size;
+}
+
+void FrameArena::freeBlocks() noexcept {
+	while(mBlocks) {
+		Block* next = mBlocks->next;
+		free(mBlocks);
+		mBlocks = next;
+	}
+	mCursor   = nullptr;
+	mEnd      = nullptr;
+	mCapacity = 0;
+}
+
+void* FrameArena::do_allocate(size_t bytes, size_t alignment) {
+	char* p = alignUp(mCursor, alignment);
+	if(!mCursor || p + bytes > mEnd) {
+		addBlock(bytes + alignment);
+		p = alignUp(mCursor, alignment);
+	}
+	mCursor = p + bytes;
+	mUsed  += bytes;
+	return p;
+}
+
+void FrameArena::do_deallocate(void* p, size_t bytes, size_t alignment) {
+	// Freed in reset()
+}
+
+bool FrameArena::do_is_equal(std::pmr::memory_resource const& other) const noexcept {
+	return this == &other;
+}
+
+void FrameArena::reset() noexcept {
+	mHighWater = std::max(mHighWater, mUsed);
+	mUsed      = 0;
+
+	if(!mBlocks) return;
+
+	if(mBlocks->next) {
+		// The frame didn't fit into one block: Merge them into one
+		size_t size = mCapacity;
+		freeBlocks();
+		try { addBlock(size); }
+		catch(std::bad_alloc&) { return; } // Try again on the next allocation
+	}
+	else {
+		mCursor = (char*)(mBlocks + 1);
+		mEnd    = mCursor + mBlocks->size;
+	}
+}
+
+} // namespace wwidget
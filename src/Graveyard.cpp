@@ -0,0 +1,82 @@
+#include "../include/wwidget/Graveyard.hpp"
+
+#include "../include/wwidget/Widget.hpp"
+
+#include <cassert>
+
+namespace wwidget {
+
+Graveyard::Graveyard() {}
+Graveyard::~Graveyard() {
+	clear();
+}
+
+void Graveyard::collect(std::unique_ptr<Widget> w) {
+	if(!w) return;
+	assert(!w->parent());
+	mYoung.push_back(w.release());
+	mYoung.back()->owner(OWNER_GC1);
+}
+
+/// Finds a descendant which is owned by its parent. Externally owned descendants (e.g. members) are searched, but can't be taken.
+static
+Widget* findOwnedDescendant(Widget* w) noexcept {
+	for(Widget* c = w->children(); c; c = c->nextSibling()) {
+		if(c->owner() == OWNER_PARENT)
+			return c;
+		if(Widget* result = findOwnedDescendant(c))
+			return result;
+	}
+	return nullptr;
+}
+
+/// Either detaches one owned descendant of the last old widget or, if there are none left, destroys it.
+bool Graveyard::destroyStep() {
+	Widget* w = mOld.back();
+	if(Widget* d = findOwnedDescendant(w)) {
+		mOld.push_back(d->removeQuiet().release());
+		d->owner(OWNER_GC2);
+		return false;
+	}
+	else {
+		mOld.pop_back();
+		delete w; // Only externally owned descendants left, their owners destroy them
+		return true;
+	}
+}
+
+size_t Graveyard::sweep(std::chrono::steady_clock::time_point deadline) {
+	size_t destroyed = 0;
+	for(unsigned step = 0; !mOld.empty(); step++) {
+		if(step % 16 == 0 && std::chrono::steady_clock::now() >= deadline)
+			break;
+		destroyed += destroyStep();
+	}
+
+	for(Widget* w : mYoung) {
+		w->owner(OWNER_GC2);
+		mOld.push_back(w);
+	}
+	mYoung.clear();
+
+	return destroyed;
+}
+
+size_t Graveyard::clear() {
+	size_t destroyed = 0;
+	while(!mYoung.empty() || !mOld.empty()) {
+		for(Widget* w : mYoung) {
+			w->owner(OWNER_GC2);
+			mOld.push_back(w);
+		}
+		mYoung.clear();
+
+		// Destructors can collect more widgets, hence the outer loop
+		while(!mOld.empty()) {
+			destroyed += destroyStep();
+		}
+	}
+	return destroyed;
+}
+
+} // namespace wwidget
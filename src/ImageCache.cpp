@@ -0,0 +1,142 @@
+#include "../include/wwidget/ImageCache.hpp"
+
+#include "../include/wwidget/Bitmap.hpp"
+
+#include <functional>
+
+namespace wwidget {
+
+size_t ImageCache::footprint(Bitmap const& bitmap) noexcept {
+	size_t result = size_t(bitmap.width()) * bitmap.height() * bitmap.format();
+	for(auto& mip : bitmap.mips()) {
+		result += footprint(*mip);
+	}
+	return result;
+}
+
+ImageCache::ImageCache(size_t budget) :
+	mBytes(0),
+	mBudget(budget),
+	mNextEviction(0)
+{}
+
+ImageCache::Shard& ImageCache::shard(std::string const& url) noexcept {
+	return mShards[std::hash<std::string>()(url) % ShardCount];
+}
+
+size_t ImageCache::Shard::evict(size_t bytes) {
+	auto l = std::lock_guard<std::mutex>(mutex);
+	size_t freed = 0;
+	for(auto iter = lru.end(); iter != lru.begin() && freed < bytes;) {
+		--iter;
+		auto entry = entries.find(*iter);
+		// Only the cache holds it
+		if(entry->second.bitmap.use_count() > 1) continue;
+		freed += entry->second.bytes;
+		entries.erase(entry);
+		iter = lru.erase(iter);
+	}
+	return freed;
+}
+
+void ImageCache::evictDownTo(size_t bytes, size_t first) {
+	for(size_t i = 0; i < ShardCount; i++) {
+		size_t current = mBytes;
+		if(current <= bytes) return;
+		mBytes -= mShards[(first + i) % ShardCount].evict(current - bytes);
+	}
+}
+
+std::shared_ptr<Bitmap> ImageCache::find(std::string const& url) {
+	auto& s = shard(url);
+	auto l = std::lock_guard<std::mutex>(s.mutex);
+	auto iter = s.entries.find(url);
+	if(iter == s.entries.end()) return nullptr;
+	s.lru.splice(s.lru.begin(), s.lru, iter->second.lru);
+	return iter->second.bitmap;
+}
+
+std::shared_ptr<Bitmap> ImageCache::insert(std::string const& url, std::shared_ptr<Bitmap> bitmap) {
+	if(!bitmap) return nullptr;
+	size_t bytes = footprint(*bitmap);
+	{ auto& s = shard(url);
+		auto l = std::lock_guard<std::mutex>(s.mutex);
+		auto [iter, inserted] = s.entries.try_emplace(url);
+		auto& entry = iter->second;
+		if(!inserted) {
+			s.lru.splice(s.lru.begin(), s.lru, entry.lru);
+			return entry.bitmap;
+		}
+		s.lru.push_front(url);
+		entry.bitmap = bitmap;
+		entry.bytes  = bytes;
+		entry.lru    = s.lru.begin();
+	}
+	mBytes += bytes;
+
+	if(mBytes > mBudget) {
+		// Spreads evictions over the shards, so the same one isn't emptied again and again
+		evictDownTo(mBudget, mNextEviction++ % ShardCount);
+	}
+	return bitmap;
+}
+
+void ImageCache::erase(std::string const& url) {
+	auto& s = shard(url);
+	auto l = std::lock_guard<std::mutex>(s.mutex);
+	auto iter = s.entries.find(url);
+	if(iter == s.entries.end()) return;
+	mBytes -= iter->second.bytes;
+	s.lru.erase(iter->second.lru);
+	s.entries.erase(iter);
+}
+
+void ImageCache::trim(size_t bytes) {
+	evictDownTo(bytes, 0);
+}
+
+void ImageCache::clear() {
+	for(auto& s : mShards) {
+		auto l = std::lock_guard<std::mutex>(s.mutex);
+		for(auto& [url, entry] : s.entries) {
+			mBytes -= entry.bytes;
+		}
+		s.entries.clear();
+		s.lru.clear();
+	}
+}
+
+void ImageCache::budget(size_t bytes) {
+	mBudget = bytes;
+	trim(bytes);
+}
+
+static
+void addUsage(ImageCache::Usage& usage, Bitmap const& bitmap) {
+	usage.cpu += bitmap.cpuBytes();
+	usage.gpu += bitmap.gpuBytes();
+	for(auto& mip : bitmap.mips()) {
+		addUsage(usage, *mip);
+	}
+}
+ImageCache::Usage ImageCache::usage() {
+	Usage result;
+	for(auto& s : mShards) {
+		auto l = std::lock_guard<std::mutex>(s.mutex);
+		for(auto& [url, entry] : s.entries) {
+			addUsage(result, *entry.bitmap);
+		}
+	}
+	return result;
+}
+
+size_t ImageCache::size() {
+	size_t result = 0;
+	for(auto& s : mShards) {
+		auto l = std::lock_guard<std::mutex>(s.mutex);
+		result += s.entries.size();
+	}
+	return result;
+}
+
+} // namespace wwidget
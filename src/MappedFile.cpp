@@ -0,0 +1,56 @@
+#include "../include/wwidget/MappedFile.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define WWIDGET_MMAP 1
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace wwidget {
+
+std::shared_ptr<uint8_t[]> mapFile(std::string const& path, size_t& length) {
+#ifdef WWIDGET_MMAP
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		throw std::runtime_error("Failed loading '" + path + "': " + strerror(errno));
+	}
+	struct stat info;
+	void* mapping = MAP_FAILED;
+	int   error   = EINVAL; // Empty files can't be mapped
+	if(fstat(fd, &info) == 0 && info.st_size > 0) {
+		length  = (size_t) info.st_size;
+		mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	}
+	if(mapping == MAP_FAILED) error = errno;
+	close(fd); // The mapping keeps the file
+	if(mapping == MAP_FAILED) {
+		throw std::runtime_error("Failed mapping '" + path + "': " + strerror(error));
+	}
+	return std::shared_ptr<uint8_t[]>((uint8_t*) mapping, [length](uint8_t* p) { munmap(p, length); });
+#else
+	FILE* file = fopen(path.c_str(), "rb");
+	if(!file) {
+		throw std::runtime_error("Failed loading '" + path + "': " + strerror(errno));
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	std::shared_ptr<uint8_t[]> result(size > 0 ? (uint8_t*) malloc(size) : nullptr, &::free);
+	length = size > 0 ? fread(result.get(), 1, size, file) : 0;
+	fclose(file);
+	if(!length) {
+		throw std::runtime_error("Failed loading '" + path + "': Empty file");
+	}
+	return result;
+#endif
+}
+
+} // namespace wwidget
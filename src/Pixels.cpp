@@ -0,0 +1,319 @@
+#include "../include/wwidget/Pixels.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define WWIDGET_PIXELS_X86 1
+	#include <immintrin.h>
+#endif
+
+namespace wwidget {
+namespace pixels {
+
+namespace {
+
+struct Kernels {
+	const char* name;
+	void (*rgbToRgba)  (uint8_t const*, uint8_t*, size_t) noexcept;
+	void (*alphaToRgba)(uint8_t const*, uint8_t*, size_t) noexcept;
+	void (*swapRedBlue)(uint8_t const*, uint8_t*, size_t) noexcept;
+	void (*premultiply)(uint8_t*, size_t) noexcept;
+};
+
+// Scalar: The tails of the vectorized versions, and everything on other cpus
+
+/// c * a / 255, rounded
+inline uint8_t mul255(unsigned c, unsigned a) noexcept {
+	unsigned t = c * a + 128;
+	return (uint8_t) ((t + (t >> 8)) >> 8);
+}
+
+void rgbToRgbaScalar(uint8_t const* s, uint8_t* d, size_t n) noexcept {
+	for(size_t i = 0; i < n; i++, s += 3, d += 4) {
+		d[0] = s[0];
+		d[1] = s[1];
+		d[2] = s[2];
+		d[3] = 255u;
+	}
+}
+void alphaToRgbaScalar(uint8_t const* s, uint8_t* d, size_t n) noexcept {
+	for(size_t i = 0; i < n; i++, d += 4) {
+		d[0] = d[1] = d[2] = 255u;
+		d[3] = s[i];
+	}
+}
+void swapRedBlueScalar(uint8_t const* s, uint8_t* d, size_t n) noexcept {
+	for(size_t i = 0; i < n; i++, s += 4, d += 4) {
+		uint8_t r = s[0], g = s[1], b = s[2], a = s[3];
+		d[0] = b; d[1] = g; d[2] = r; d[3] = a;
+	}
+}
+void premultiplyScalar(uint8_t* p, size_t n) noexcept {
+	for(size_t i = 0; i < n; i++, p += 4) {
+		p[0] = mul255(p[0], p[3]);
+		p[1] = mul255(p[1], p[3]);
+		p[2] = mul255(p[2], p[3]);
+	}
+}
+
+#ifdef WWIDGET_PIXELS_X86
+
+// SSE2: Everything but rgbToRgba, which needs a byte shuffle
+
+__attribute__((target("sse2")))
+void alphaToRgbaSSE2(uint8_t const* s, uint8_t* d, size_t n) noexcept {
+	__m128i const ones = _mm_set1_epi8(-1);
+	size_t i = 0;
+	for(; i + 16 <= n; i += 16) {
+		__m128i a  = _mm_loadu_si128((__m128i const*) (s + i));
+		__m128i lo = _mm_unpacklo_epi8(ones, a); // 0xFF, a
+		__m128i hi = _mm_unpackhi_epi8(ones, a);
+		_mm_storeu_si128((__m128i*) (d + i * 4 +  0), _mm_unpacklo_epi16(ones, lo)); // 0xFF, 0xFF, 0xFF, a
+		_mm_storeu_si128((__m128i*) (d + i * 4 + 16), _mm_unpackhi_epi16(ones, lo));
+		_mm_storeu_si128((__m128i*) (d + i * 4 + 32), _mm_unpacklo_epi16(ones, hi));
+		_mm_storeu_si128((__m128i*) (d + i * 4 + 48), _mm_unpackhi_epi16(ones, hi));
+	}
+	alphaToRgbaScalar(s + i, d + i * 4, n - i);
+}
+
+__attribute__((target("sse2")))
+void swapRedBlueSSE2(uint8_t const* s, uint8_t* d, size_t n) noexcept {
+	__m128i const greenAlpha = _mm_set1_epi32((int) 0xFF00FF00);
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) {
+		__m128i v  = _mm_loadu_si128((__m128i const*) (s + i * 4));
+		__m128i ga = _mm_and_si128(v, greenAlpha);
+		__m128i rb = _mm_andnot_si128(greenAlpha, v);
+		rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+		_mm_storeu_si128((__m128i*) (d + i * 4), _mm_or_si128(ga, rb));
+	}
+	swapRedBlueScalar(s + i * 4, d + i * 4, n - i);
+}
+
+/// Two pixels as 16 bit channels
+__attribute__((target("sse2")))
+inline __m128i premultiply16(__m128i x) noexcept {
+	__m128i const colorMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	__m128i const alphaOne  = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0); // Alpha itself is multiplied by 255
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	a = _mm_or_si128(_mm_and_si128(a, colorMask), alphaOne);
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+void premultiplySSE2(uint8_t* p, size_t n) noexcept {
+	__m128i const zero = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((__m128i const*) (p + i * 4));
+		__m128i lo = premultiply16(_mm_unpacklo_epi8(v, zero));
+		__m128i hi = premultiply16(_mm_unpackhi_epi8(v, zero));
+		_mm_storeu_si128((__m128i*) (p + i * 4), _mm_packus_epi16(lo, hi));
+	}
+	premultiplyScalar(p + i * 4, n - i);
+}
+
+// SSSE3: pshufb makes rgbToRgba cheap
+
+__attribute__((target("ssse3")))
+void rgbToRgbaSSSE3(uint8_t const* s, uint8_t* d, size_t n) noexcept {
+	__m128i const spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	__m128i const alpha  = _mm_set1_epi32((int) 0xFF000000);
+	size_t i = 0;
+	// Each load reads 16 bytes but only uses 12, stop before reading past the end
+	for(; i + 6 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((__m128i const*) (s + i * 3));
+		_mm_storeu_si128((__m128i*) (d + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, spread), alpha));
+	}
+	rgbToRgbaScalar(s + i * 3, d + i * 4, n - i);
+}
+
+// AVX2: Twice the width. Shuffles work within 128 bit lanes, so each lane gets four pixels of its own.
+
+__attribute__((target("avx2")))
+void rgbToRgbaAVX2(uint8_t const* s, uint8_t* d, size_t n) noexcept {
+	__m256i const spread = _mm256_setr_epi8(
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	__m256i const alpha  = _mm256_set1_epi32((int) 0xFF000000);
+	size_t i = 0;
+	for(; i + 10 <= n; i += 8) {
+		__m128i lo = _mm_loadu_si128((__m128i const*) (s + i * 3));
+		__m128i hi = _mm_loadu_si128((__m128i const*) (s + i * 3 + 12));
+		__m256i v  = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		_mm256_storeu_si256((__m256i*) (d + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(v, spread), alpha));
+	}
+	rgbToRgbaScalar(s + i * 3, d + i * 4, n - i);
+}
+
+__attribute__((target("avx2")))
+void alphaToRgbaAVX2(uint8_t const* s, uint8_t* d, size_t n) noexcept {
+	__m256i const white = _mm256_set1_epi32(0x00FFFFFF);
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8) {
+		__m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*) (s + i)));
+		_mm256_storeu_si256((__m256i*) (d + i * 4), _mm256_or_si256(_mm256_slli_epi32(a, 24), white));
+	}
+	alphaToRgbaScalar(s + i, d + i * 4, n - i);
+}
+
+__attribute__((target("avx2")))
+void swapRedBlueAVX2(uint8_t const* s, uint8_t* d, size_t n) noexcept {
+	__m256i const swap = _mm256_setr_epi8(
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((__m256i const*) (s + i * 4));
+		_mm256_storeu_si256((__m256i*) (d + i * 4), _mm256_shuffle_epi8(v, swap));
+	}
+	swapRedBlueScalar(s + i * 4, d + i * 4, n - i);
+}
+
+__attribute__((target("avx2")))
+inline __m256i premultiply16(__m256i x) noexcept {
+	__m256i const colorMask = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+	__m256i const alphaOne  = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	a = _mm256_or_si256(_mm256_and_si256(a, colorMask), alphaOne);
+	__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(x, a), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+void premultiplyAVX2(uint8_t* p, size_t n) noexcept {
+	__m256i const zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8) {
+		__m256i v  = _mm256_loadu_si256((__m256i const*) (p + i * 4));
+		// Unpacking and packing both stay within the lanes, so the order comes out right
+		__m256i lo = premultiply16(_mm256_unpacklo_epi8(v, zero));
+		__m256i hi = premultiply16(_mm256_unpackhi_epi8(v, zero));
+		_mm256_storeu_si256((__m256i*) (p + i * 4), _mm256_packus_epi16(lo, hi));
+	}
+	premultiplyScalar(p + i * 4, n - i);
+}
+
+#endif // WWIDGET_PIXELS_X86
+
+Kernels selectKernels() noexcept {
+#ifdef WWIDGET_PIXELS_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return { "avx2", rgbToRgbaAVX2, alphaToRgbaAVX2, swapRedBlueAVX2, premultiplyAVX2 };
+	if(__builtin_cpu_supports("ssse3"))
+		return { "ssse3", rgbToRgbaSSSE3, alphaToRgbaSSE2, swapRedBlueSSE2, premultiplySSE2 };
+	if(__builtin_cpu_supports("sse2"))
+		return { "sse2", rgbToRgbaScalar, alphaToRgbaSSE2, swapRedBlueSSE2, premultiplySSE2 };
+#endif
+	return { "scalar", rgbToRgbaScalar, alphaToRgbaScalar, swapRedBlueScalar, premultiplyScalar };
+}
+
+Kernels const& kernels() noexcept {
+	static Kernels const selected = selectKernels();
+	return selected;
+}
+
+} // namespace
+
+void rgbToRgba(uint8_t const* rgb, uint8_t* rgba, size_t count) noexcept {
+	kernels().rgbToRgba(rgb, rgba, count);
+}
+void alphaToRgba(uint8_t const* alpha, uint8_t* rgba, size_t count) noexcept {
+	kernels().alphaToRgba(alpha, rgba, count);
+}
+void swapRedBlue(uint8_t const* rgba, uint8_t* bgra, size_t count) noexcept {
+	kernels().swapRedBlue(rgba, bgra, count);
+}
+void premultiply(uint8_t* rgba, size_t count) noexcept {
+	kernels().premultiply(rgba, count);
+}
+
+namespace {
+
+/// Which source pixels make up each target pixel, and how much of each
+struct BoxFilter {
+	static constexpr unsigned One = 1 << 14; //!< The weights of a target pixel add up to this
+
+	std::vector<unsigned> first, count;
+	std::vector<uint16_t> weights; //!< count[i] of them for each target pixel, in order
+	std::vector<size_t>   offset;  //!< Of the weights of each target pixel
+
+	BoxFilter(unsigned from, unsigned to) : first(to), count(to), offset(to) {
+		// Everything in units of 1/to source pixels, so the boundaries are integers
+		for(unsigned i = 0; i < to; i++) {
+			uint64_t begin = uint64_t(i) * from, end = uint64_t(i + 1) * from;
+			first[i]  = unsigned(begin / to);
+			count[i]  = unsigned((end + to - 1) / to) - first[i];
+			offset[i] = weights.size();
+
+			unsigned sum = 0;
+			for(unsigned k = 0; k < count[i]; k++) {
+				uint64_t pixelBegin = std::max<uint64_t>(begin, uint64_t(first[i] + k) * to);
+				uint64_t pixelEnd   = std::min<uint64_t>(end,   uint64_t(first[i] + k + 1) * to);
+				unsigned w = unsigned((pixelEnd - pixelBegin) * One / from);
+				weights.push_back((uint16_t) w);
+				sum += w;
+			}
+			weights[offset[i]] += uint16_t(One - sum); // Rounding errors
+		}
+	}
+};
+
+} // namespace
+
+void downscale(
+	uint8_t const* from, unsigned width, unsigned height,
+	uint8_t* to, unsigned toWidth, unsigned toHeight,
+	unsigned channels)
+{
+	toWidth  = std::max(1u, std::min(toWidth,  width));
+	toHeight = std::max(1u, std::min(toHeight, height));
+	if(!width || !height) return;
+
+	BoxFilter xs(width, toWidth), ys(height, toHeight);
+
+	size_t rowSize = size_t(toWidth) * channels;
+	std::vector<uint16_t> row(rowSize);      // A source row filtered horizontally, 6 bits more precise
+	std::vector<uint32_t> sum(rowSize);
+
+	for(unsigned y = 0; y < toHeight; y++) {
+		std::fill(sum.begin(), sum.end(), 0u);
+
+		for(unsigned k = 0; k < ys.count[y]; k++) {
+			uint8_t const* source = from + size_t(ys.first[y] + k) * width * channels;
+
+			for(unsigned x = 0; x < toWidth; x++) {
+				uint16_t const* w = &xs.weights[xs.offset[x]];
+				uint8_t  const* s = source + size_t(xs.first[x]) * channels;
+				for(unsigned c = 0; c < channels; c++) {
+					uint32_t value = 0;
+					for(unsigned i = 0; i < xs.count[x]; i++) {
+						value += w[i] * s[i * channels + c];
+					}
+					row[x * channels + c] = uint16_t((value + (1 << 7)) >> 8);
+				}
+			}
+
+			// Plain loop over contiguous memory: the compiler vectorizes it
+			uint32_t weight = ys.weights[ys.offset[y] + k];
+			for(size_t i = 0; i < rowSize; i++) {
+				sum[i] += weight * row[i];
+			}
+		}
+
+		uint8_t* target = to + size_t(y) * rowSize;
+		for(size_t i = 0; i < rowSize; i++) {
+			target[i] = uint8_t((sum[i] + (1 << 19)) >> 20);
+		}
+	}
+}
+
+const char* implementation() noexcept {
+	return kernels().name;
+}
+
+} // namespace pixels
+} // namespace wwidget
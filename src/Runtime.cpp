@@ -0,0 +1,422 @@
+#include "../include/wwidget/Runtime.hpp"
+
+#include "../include/wwidget/Bitmap.hpp"
+#include "../include/wwidget/Canvas.hpp"
+#include "../include/wwidget/Context.hpp"
+#include "../include/wwidget/ImageCache.hpp"
+#include "../include/wwidget/Thumbnails.hpp"
+
+#include "../include/wwidget/async/Threadpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+namespace wwidget {
+
+static const char ThumbnailScheme[] = "thumbnail:";
+static const char ScaledScheme[]    = "scaled:";
+
+/// <scheme><size>:<path>
+template<size_t N> static
+bool parseSizedUrl(std::string const& url, const char (&scheme)[N], unsigned& size, std::string& path) {
+	if(url.compare(0, N - 1, scheme) != 0) return false;
+	char const* begin = url.c_str() + N - 1;
+	char* end = nullptr;
+	size = (unsigned) strtoul(begin, &end, 10);
+	if(end == begin || *end != ':' || size == 0) return false;
+	path = end + 1;
+	return true;
+}
+
+/// A single request. Everything but the atomics and context is only touched on the ui thread of context.
+struct Runtime::ImageJob final : public ImageRequest, public OwnedObject {
+	enum State { PENDING, DONE, CANCELLED };
+
+	unique_function<void(std::shared_ptr<Bitmap>)> callback;
+	std::atomic<int>                               state;
+	Context*                                       context; //!< Where the result goes. Guarded by the imageJobs mutex, nullptr once detached.
+
+	ImageJob(Context* context, unique_function<void(std::shared_ptr<Bitmap>)> callback, float priority, Widget* viewer) :
+		ImageRequest(priority, viewer),
+		callback(std::move(callback)),
+		state(PENDING),
+		context(context)
+	{}
+
+	bool settle(State s) noexcept {
+		int current = PENDING;
+		return state.compare_exchange_strong(current, s);
+	}
+
+	void cancel() override {
+		if(!settle(CANCELLED)) return;
+		// The decode stays queued until a worker sees that nobody waits for it anymore
+		removeFromOwner();
+		mViewer  = nullptr;
+		callback = nullptr;
+	}
+	void finish(std::shared_ptr<Bitmap> bitmap) {
+		if(!settle(DONE)) return;
+		removeFromOwner();
+		mViewer = nullptr;
+		auto fn = std::move(callback);
+		fn(std::move(bitmap));
+	}
+
+	void becameOrphan() override { cancel(); }
+};
+
+/// Decoding an url once for all requests which arrive before it's done
+struct Runtime::ImageDecode {
+	std::string                            url;
+	std::vector<std::shared_ptr<ImageJob>> jobs;      //!< Guarded by the imageJobs mutex
+	size_t                                 bytes = 0; //!< Estimated size once decoded. Only touched by the worker which took it from the pending list.
+
+	ImageDecode(std::string url) : url(std::move(url)) {}
+
+	/// The most urgent priority of all waiting requests, infinity if nobody waits anymore
+	float priority() const noexcept {
+		float result = std::numeric_limits<float>::infinity();
+		for(auto& job : jobs) {
+			if(job->state == ImageJob::PENDING)
+				result = std::min(result, job->priority());
+		}
+		return result;
+	}
+};
+
+struct Runtime::Implementation {
+	/// Opening a pack reads all of it, so it happens outside of the cache lock. Only once per size though.
+	struct ThumbnailSlot {
+		std::once_flag                  opened;
+		std::unique_ptr<ThumbnailCache> thumbnails;
+	};
+
+	struct {
+		std::mutex                                             mutex;
+		std::vector<std::pair<std::string, std::string>>       fonts; //!< Name and path, only ever appended
+		std::string                                            thumbnailDirectory;
+		std::unordered_map<unsigned, std::unique_ptr<ThumbnailSlot>> thumbnails; //!< By size, opened on first use
+
+		auto lock() { return std::unique_lock<std::mutex>(mutex); }
+	} cache;
+
+	ImageCache        images;
+	std::atomic<bool> releaseAfterUpload{false};
+
+	struct {
+		std::mutex                                                    mutex;
+		std::vector<std::shared_ptr<ImageDecode>>                     pending;
+		std::unordered_map<std::string, std::shared_ptr<ImageDecode>> inFlight; //!< Pending or decoding
+		size_t decodingBytes = 0;
+		size_t peakBytes     = 0;
+		size_t decodeBudget  = 256 << 20;
+		size_t deferred      = 0; //!< Workers which gave up because of the budget
+	} imageJobs;
+
+	Threadpool threadpool;
+
+	Implementation(size_t threads) :
+		threadpool(threads)
+	{}
+
+	ThumbnailCache& thumbnails(unsigned size) {
+		ThumbnailSlot* slot;
+		std::string    directory;
+		{ auto l = cache.lock();
+			auto& result = cache.thumbnails[size];
+			if(!result) result = std::make_unique<ThumbnailSlot>();
+			slot = result.get();
+
+			if(cache.thumbnailDirectory.empty()) {
+				const char* tmp = getenv("TMPDIR");
+				cache.thumbnailDirectory = tmp ? tmp : "/tmp";
+			}
+			directory = cache.thumbnailDirectory;
+		}
+		std::call_once(slot->opened, [&]() {
+			slot->thumbnails = std::make_unique<ThumbnailCache>(directory + "/wwidget-thumbnails-" + std::to_string(size) + ".pack", size);
+		});
+		return *slot->thumbnails;
+	}
+
+	/// How many bytes decoding the url will take
+	size_t decodedSize(std::string const& url) {
+		unsigned    size;
+		std::string path;
+		if(parseSizedUrl(url, ThumbnailScheme, size, path)) {
+			// Known thumbnails are just mapped, otherwise the whole image is decoded for a moment
+			return thumbnails(size).find(path) ? size * size * 4 : Bitmap::decodedSize(path);
+		}
+		if(parseSizedUrl(url, ScaledScheme, size, path)) {
+			// Also decoded fully before it's scaled down
+			return Bitmap::decodedSize(path);
+		}
+		return Bitmap::decodedSize(url);
+	}
+};
+
+Runtime::Runtime() :
+	Runtime(Threadpool::defaultSize())
+{}
+Runtime::Runtime(size_t threads) :
+	mImpl(new Implementation(threads))
+{}
+Runtime::~Runtime() {
+	// Workers use the caches, stop them first. The contexts detached themselves before they let go of the runtime.
+	mImpl->threadpool.stop();
+	delete mImpl;
+}
+
+std::shared_ptr<Runtime> Runtime::shared() {
+	static std::mutex              mutex;
+	static std::weak_ptr<Runtime>  instance;
+
+	auto l = std::lock_guard<std::mutex>(mutex);
+	auto result = instance.lock();
+	if(!result) {
+		result   = std::make_shared<Runtime>();
+		instance = result;
+	}
+	return result;
+}
+
+Threadpool& Runtime::threadpool() noexcept {
+	return mImpl->threadpool;
+}
+ImageCache& Runtime::imageCache() noexcept {
+	return mImpl->images;
+}
+
+std::shared_ptr<Bitmap> Runtime::loadImage(std::string const& url) {
+	auto s = mImpl->images.find(url);
+	if(!s) {
+		unsigned    size;
+		std::string path;
+		if(parseSizedUrl(url, ThumbnailScheme, size, path)) {
+			s = mImpl->thumbnails(size).get(path);
+		}
+		else if(parseSizedUrl(url, ScaledScheme, size, path)) {
+			// Reuses the full image if it's cached. Unless the ui thread might release its pixels meanwhile.
+			s = mImpl->images.find(path);
+			if(!s || s->residency() != Bitmap::KEEP_PIXELS) {
+				s = std::make_shared<Bitmap>();
+				s->load(path);
+			}
+			// Always a new bitmap: The full image might be shared, its users don't expect mips on it
+			s = s->scaledDown(std::min(size, std::max(s->width(), s->height())));
+			s->generateMips();
+			s->reloader([path, size = std::max(s->width(), s->height())](Bitmap& into) {
+				Bitmap full;
+				full.load(path);
+				into = *full.scaledDown(size);
+			});
+		}
+		else {
+			s = std::make_shared<Bitmap>();
+			s->load(url);
+		}
+		if(mImpl->releaseAfterUpload) {
+			s->residency(Bitmap::RELEASE_AFTER_UPLOAD);
+		}
+		s = mImpl->images.insert(url, std::move(s));
+	}
+
+	return s;
+}
+
+std::shared_ptr<ImageRequest> Runtime::loadImage(Context* context, unique_function<void(std::shared_ptr<Bitmap>)> fn, std::string const& url, Owner* owner, Widget* viewer) {
+	if(auto cached = mImpl->images.find(url)) {
+		fn(std::move(cached));
+		return nullptr;
+	}
+
+	if(context && url.compare(0, sizeof(ThumbnailScheme) - 1, ThumbnailScheme) == 0) {
+		auto& cache = mImpl->cache;
+		auto _ = cache.lock();
+		if(cache.thumbnailDirectory.empty()) {
+			cache.thumbnailDirectory = context->getRessource(URL_CACHE_DIR);
+		}
+	}
+
+	auto job = std::make_shared<ImageJob>(context, std::move(fn), viewer ? viewer->viewportDistance() : 0.f, viewer);
+	if(owner) {
+		owner->transferOwnership(job.get());
+	}
+
+	bool newDecode;
+	{ auto& jobs = mImpl->imageJobs;
+		auto l = std::lock_guard<std::mutex>(jobs.mutex);
+		auto& decode = jobs.inFlight[url];
+		newDecode = !decode;
+		if(newDecode) {
+			decode = std::make_shared<ImageDecode>(url);
+			jobs.pending.push_back(decode);
+		}
+		decode->jobs.push_back(job);
+	}
+
+	// One worker task per decode, but it decodes whatever is most important once it runs
+	if(newDecode) {
+		mImpl->threadpool.add([this]() { loadNextImage(); }, LANE_BULK);
+	}
+
+	return job;
+}
+
+void Runtime::loadNextImage() {
+	auto& jobs = mImpl->imageJobs;
+
+	std::shared_ptr<ImageDecode> decode;
+	{ auto l = std::lock_guard<std::mutex>(jobs.mutex);
+		auto& pending = jobs.pending;
+
+		size_t best         = SIZE_MAX; // Not the size, dropping decodes changes it
+		float  bestPriority = 0;
+		for(size_t i = 0; i < pending.size();) {
+			float priority = pending[i]->priority();
+			if(priority == std::numeric_limits<float>::infinity()) {
+				// Everybody cancelled: Drop it
+				jobs.inFlight.erase(pending[i]->url);
+				std::swap(pending[i], pending.back());
+				pending.pop_back();
+				continue;
+			}
+			if(best == SIZE_MAX || priority < bestPriority) {
+				best         = i;
+				bestPriority = priority;
+			}
+			++i;
+		}
+		if(best == SIZE_MAX) return;
+
+		decode = std::move(pending[best]);
+		std::swap(pending[best], pending.back());
+		pending.pop_back();
+	}
+
+	// Admission: Don't decode more than the budget at once, but always allow one decode
+	if(!decode->bytes) {
+		decode->bytes = std::max<size_t>(1, mImpl->decodedSize(decode->url));
+	}
+	{ auto l = std::lock_guard<std::mutex>(jobs.mutex);
+		if(jobs.decodingBytes > 0 && jobs.decodingBytes + decode->bytes > jobs.decodeBudget) {
+			jobs.pending.push_back(std::move(decode));
+			jobs.deferred++;
+			return;
+		}
+		jobs.decodingBytes += decode->bytes;
+		jobs.peakBytes      = std::max(jobs.peakBytes, jobs.decodingBytes);
+	}
+
+	std::shared_ptr<Bitmap> s;
+	try { s = loadImage(decode->url); }
+	catch(std::runtime_error& e) {
+		fprintf(stderr, "%s\n", e.what());
+	}
+
+	size_t retry;
+	{ auto l = std::lock_guard<std::mutex>(jobs.mutex);
+		jobs.decodingBytes -= decode->bytes;
+		retry = jobs.deferred;
+		jobs.deferred = 0;
+
+		// Later requests find the bitmap in the cache
+		auto iter = jobs.inFlight.find(decode->url);
+		if(iter != jobs.inFlight.end() && iter->second == decode) {
+			jobs.inFlight.erase(iter);
+		}
+
+		// One task per waiting context. Deferred while locked, so a context can't detach and go away in between.
+		auto& waiting = decode->jobs;
+		while(!waiting.empty()) {
+			Context* context = waiting.back()->context;
+			auto mine = std::partition(waiting.begin(), waiting.end(), [context](auto& job) { return job->context != context; });
+			std::vector<std::shared_ptr<ImageJob>> finished(std::make_move_iterator(mine), std::make_move_iterator(waiting.end()));
+			waiting.erase(mine, waiting.end());
+
+			if(context) {
+				context->defer([finished = std::move(finished), s]() {
+					for(auto& job : finished) {
+						job->finish(s);
+					}
+				});
+			}
+		}
+	}
+	while(retry--) {
+		mImpl->threadpool.add([this]() { loadNextImage(); }, LANE_BULK);
+	}
+}
+
+void Runtime::reprioritizeImageLoads(Context* context) {
+	auto& jobs = mImpl->imageJobs;
+	auto l = std::lock_guard<std::mutex>(jobs.mutex);
+	for(auto& decode : jobs.pending) {
+		for(auto& job : decode->jobs) {
+			if(job->context != context) continue;
+			if(Widget* viewer = job->viewer()) {
+				job->priority(viewer->viewportDistance());
+			}
+		}
+	}
+}
+
+void Runtime::detach(Context* context) {
+	auto& jobs = mImpl->imageJobs;
+	auto l = std::lock_guard<std::mutex>(jobs.mutex);
+	for(auto& [url, decode] : jobs.inFlight) {
+		for(auto& job : decode->jobs) {
+			if(job->context != context) continue;
+			job->context = nullptr;
+			job->cancel();
+		}
+	}
+}
+
+void Runtime::releasePixelsAfterUpload(bool enable) noexcept {
+	mImpl->releaseAfterUpload = enable;
+}
+
+void Runtime::decodeBudget(size_t bytes) noexcept {
+	auto& jobs = mImpl->imageJobs;
+	auto l = std::lock_guard<std::mutex>(jobs.mutex);
+	jobs.decodeBudget = bytes;
+}
+size_t Runtime::peakDecodeBytes() noexcept {
+	auto& jobs = mImpl->imageJobs;
+	auto l = std::lock_guard<std::mutex>(jobs.mutex);
+	return jobs.peakBytes;
+}
+
+std::string Runtime::thumbnailUrl(std::string const& path, unsigned size) {
+	return ThumbnailScheme + std::to_string(size) + ":" + path;
+}
+std::string Runtime::scaledUrl(std::string const& path, unsigned size) {
+	return ScaledScheme + std::to_string(size) + ":" + path;
+}
+void Runtime::thumbnailDirectory(std::string directory) {
+	auto& cache = mImpl->cache;
+	auto l = cache.lock();
+	cache.thumbnailDirectory = std::move(directory);
+}
+
+void Runtime::registerFont(std::string name, std::string path) {
+	auto& cache = mImpl->cache;
+	auto l = cache.lock();
+	cache.fonts.emplace_back(std::move(name), std::move(path));
+}
+size_t Runtime::registerFonts(Canvas& canvas, size_t first) const {
+	auto& cache = mImpl->cache;
+	auto l = cache.lock();
+	for(size_t i = first; i < cache.fonts.size(); i++) {
+		canvas.registerFont(cache.fonts[i].first.c_str(), cache.fonts[i].second.c_str());
+	}
+	return cache.fonts.size();
+}
+
+} // namespace wwidget
@@ -0,0 +1,239 @@
+#include "../include/wwidget/Selector.hpp"
+
+#include "../include/wwidget/Error.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <strings.h>
+
+namespace wwidget {
+
+// ** Parsing *******************************************************
+
+static inline
+bool isIdentifierChar(char c) noexcept {
+	return std::isalnum((unsigned char)c) || c == '_' || c == '-';
+}
+
+Selector::Selector(std::string_view selector) :
+	mSource(selector)
+{
+	const char* begin = mSource.c_str();
+	const char* s     = begin;
+
+	auto skipSpace = [&]() -> bool {
+		const char* start = s;
+		while(std::isspace((unsigned char)*s)) ++s;
+		return s != start;
+	};
+	auto identifier = [&](const char* what) -> std::string {
+		const char* start = s;
+		while(isIdentifierChar(*s)) ++s;
+		if(s == start) {
+			throw exceptions::ParsingError("Expected " + std::string(what) + " in selector '" + mSource + "'", s, begin);
+		}
+		return std::string(start, s);
+	};
+
+	skipSpace();
+	mAlternatives.emplace_back();
+	bool childOf = false;
+	while(true) {
+		Compound compound;
+		compound.childOf = childOf;
+
+		if(*s == '*') {
+			++s;
+		}
+		else if(isIdentifierChar(*s)) {
+			compound.type = identifier("a type");
+		}
+		else if(*s != '#' && *s != '.') {
+			throw exceptions::ParsingError("Expected a type, '*', '#' or '.' in selector '" + mSource + "'", s, begin);
+		}
+
+		while(*s == '#' || *s == '.') {
+			if(*s++ == '#')
+				compound.name = identifier("a name");
+			else
+				compound.classes.emplace_back(identifier("a class"));
+		}
+		std::sort(compound.classes.begin(), compound.classes.end());
+
+		mAlternatives.back().emplace_back(std::move(compound));
+
+		bool hadSpace = skipSpace();
+		if(*s == '\0') break;
+
+		if(*s == ',') {
+			++s;
+			skipSpace();
+			mAlternatives.emplace_back();
+			childOf = false;
+		}
+		else if(*s == '>') {
+			++s;
+			skipSpace();
+			childOf = true;
+		}
+		else if(hadSpace) {
+			childOf = false;
+		}
+		else {
+			throw exceptions::ParsingError("Unexpected character in selector '" + mSource + "'", s, begin);
+		}
+	}
+}
+Selector::~Selector() {}
+
+// ** Matching *******************************************************
+
+bool Selector::Compound::matches(Widget const* w) const noexcept {
+	if(!type.empty()) {
+		if(typeBit) {
+			if(!(w->type().mask & typeBit)) return false;
+		}
+		else {
+			// Not resolved yet (or the type ran out of bits): Compare against the names of the type and its bases
+			WidgetType const* t = &w->type();
+			while(t && strcasecmp(t->name, type.c_str()) != 0) t = t->base;
+			if(!t) return false;
+			typeBit = t->bit;
+		}
+	}
+
+	if(!name.empty() && name != w->name()) {
+		return false;
+	}
+
+	auto& wclasses = w->classes();
+	for(auto& cls : classes) {
+		auto iter = std::lower_bound(wclasses.begin(), wclasses.end(), cls.c_str());
+		if(iter == wclasses.end() || cls != iter->c_str()) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Selector::matchComplex(Complex const& c, size_t idx, Widget const* w, Widget const* scope) const noexcept {
+	Compound const& compound = c[idx];
+	if(!compound.matches(w)) return false;
+	if(idx == 0) return true;
+
+	if(compound.childOf) {
+		if(w == scope) return false;
+		Widget const* p = w->parent();
+		return p && matchComplex(c, idx - 1, p, scope);
+	}
+	else {
+		for(Widget const* p = w; p != scope && (p = p->parent());) {
+			if(matchComplex(c, idx - 1, p, scope))
+				return true;
+		}
+		return false;
+	}
+}
+
+bool Selector::matches(Widget const* w, Widget const* scope) const noexcept {
+	for(auto& alternative : mAlternatives) {
+		if(matchComplex(alternative, alternative.size() - 1, w, scope))
+			return true;
+	}
+	return false;
+}
+
+TypeMask Selector::candidateTypes() const noexcept {
+	TypeMask result = 0;
+	for(auto& alternative : mAlternatives) {
+		TypeMask bit = alternative.back().typeBit;
+		if(!bit) return 0; // Can't rule anything out
+		result |= bit;
+	}
+	return result;
+}
+
+Widget* Selector::first(Widget* root) const {
+	Widget* result = nullptr;
+	each(root, [&](Widget* w) {
+		result = w;
+		return false;
+	});
+	return result;
+}
+
+std::vector<Widget*> Selector::all(Widget* root) const {
+	std::vector<Widget*> result;
+	each(root, [&](Widget* w) {
+		result.push_back(w);
+	});
+	return result;
+}
+
+// ** LiveSelection *******************************************************
+
+LiveSelection::LiveSelection(Widget* root, Selector selector) :
+	mRoot(root),
+	mSelector(std::move(selector))
+{
+	mSelector.each(mRoot, [this](Widget* w) {
+		mResults.insert(w);
+	});
+	mRoot->addObserver(this);
+}
+LiveSelection::LiveSelection(Widget* root, std::string_view selector) :
+	LiveSelection(root, Selector(selector))
+{}
+LiveSelection::~LiveSelection() {
+	if(mRoot) {
+		mRoot->removeObserver(this);
+	}
+}
+
+LiveSelection& LiveSelection::onEnter(std::function<void(Widget*)> fn) {
+	mOnEnter = std::move(fn);
+	if(mOnEnter) {
+		for(Widget* w : mResults) mOnEnter(w);
+	}
+	return *this;
+}
+LiveSelection& LiveSelection::onLeave(std::function<void(Widget*)> fn) {
+	mOnLeave = std::move(fn);
+	return *this;
+}
+
+void LiveSelection::update(Widget* w) {
+	bool matches = w != mRoot && mSelector.matches(w, mRoot);
+	if(matches) {
+		if(mResults.insert(w).second && mOnEnter) mOnEnter(w);
+	}
+	else {
+		erase(w);
+	}
+}
+void LiveSelection::erase(Widget* w) {
+	if(mResults.erase(w) && mOnLeave) mOnLeave(w);
+}
+
+void LiveSelection::onAdded(Widget* w) {
+	mSelector.eachIn(mRoot, w, [this](Widget* match) {
+		if(mResults.insert(match).second && mOnEnter) mOnEnter(match);
+	});
+}
+void LiveSelection::onRemoved(Widget* w) {
+	if(mResults.empty()) return;
+	erase(w);
+	w->eachDescendendPreOrder([this](Widget* d) { erase(d); });
+}
+void LiveSelection::onChanged(Widget* w) {
+	// The change can affect w and, through the combinators, all of its descendants
+	update(w);
+	w->eachDescendendPreOrder([this](Widget* d) { update(d); });
+}
+void LiveSelection::onObservedDestroyed(Widget* w) {
+	mResults.clear();
+	mRoot = nullptr;
+}
+
+} // namespace wwidget
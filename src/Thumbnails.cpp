@@ -0,0 +1,214 @@
+#include "../include/wwidget/Thumbnails.hpp"
+
+#include "../include/wwidget/Bitmap.hpp"
+#include "../include/wwidget/MappedFile.hpp"
+#include "../include/wwidget/Pixels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#if __has_include(<filesystem>)
+	#include <filesystem>
+	namespace fs { using namespace std::filesystem; }
+#elif __has_include(<experimental/filesystem>)
+	#include <experimental/filesystem>
+	namespace fs { using namespace std::experimental::filesystem; }
+#endif
+
+namespace wwidget {
+
+// The pack: A header, then one record per thumbnail. Native byte order, it's a cache.
+//  Record: RecordHeader, the path, padding to 4 bytes, the pixels, padding to 8 bytes.
+
+static constexpr char     PackMagic[8]  = { 'W', 'W', 'T', 'H', 'U', 'M', 'B', '\n' };
+static constexpr uint32_t PackVersion   = 1;
+static constexpr uint32_t RecordMagic   = 0x54485542;
+
+struct PackHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t size;
+};
+
+struct RecordHeader {
+	uint32_t magic;
+	uint32_t pathLength;
+	uint64_t modified;
+	uint64_t size;
+	uint16_t width, height;
+	uint8_t  format;
+	uint8_t  reserved[3];
+};
+
+static size_t align(size_t n, size_t to) noexcept { return (n + to - 1) / to * to; }
+
+static
+bool fileKey(std::string const& path, uint64_t& modified, uint64_t& size) {
+	std::error_code ec;
+	auto time = fs::last_write_time(path, ec);
+	if(ec) return false;
+	size = fs::file_size(path, ec);
+	if(ec) return false;
+	modified = (uint64_t) time.time_since_epoch().count();
+	return true;
+}
+
+ThumbnailCache::ThumbnailCache(std::string packPath, unsigned size) :
+	mPackPath(std::move(packPath)),
+	mSize(size)
+{
+	open();
+}
+
+void ThumbnailCache::open() {
+	size_t length = 0;
+	try { mMapping = mapFile(mPackPath, length); }
+	catch(std::runtime_error&) { length = 0; } // Not there yet
+
+	PackHeader header;
+	bool valid = length >= sizeof(header);
+	if(valid) {
+		memcpy(&header, mMapping.get(), sizeof(header));
+		valid = memcmp(header.magic, PackMagic, sizeof(PackMagic)) == 0 && header.version == PackVersion && header.size == mSize;
+	}
+	if(!valid) {
+		mMapping = nullptr;
+		std::error_code ec;
+		fs::create_directories(fs::path(mPackPath).parent_path(), ec);
+		if(FILE* f = fopen(mPackPath.c_str(), "wb")) {
+			memcpy(header.magic, PackMagic, sizeof(PackMagic));
+			header.version = PackVersion;
+			header.size    = mSize;
+			fwrite(&header, sizeof(header), 1, f);
+			fclose(f);
+		}
+		return;
+	}
+
+	// Later records for a path replace earlier ones
+	size_t offset = sizeof(header);
+	while(offset + sizeof(RecordHeader) <= length) {
+		RecordHeader record;
+		memcpy(&record, mMapping.get() + offset, sizeof(record));
+
+		size_t pixelsOffset = align(offset + sizeof(record) + record.pathLength, 4);
+		size_t bytes        = size_t(record.width) * record.height * record.format;
+		size_t end          = align(pixelsOffset + bytes, 8);
+		bool   formatOk     = record.format == Bitmap::ALPHA || record.format == Bitmap::RGB || record.format == Bitmap::RGBA;
+		if(record.magic != RecordMagic || !formatOk || pixelsOffset + bytes > length) break;
+
+		std::string path((char const*) mMapping.get() + offset + sizeof(record), record.pathLength);
+		mEntries[std::move(path)] = Entry{ record.modified, record.size, pixelsOffset, record.width, record.height, record.format, true, {} };
+		offset = std::min(end, length);
+	}
+
+	// A record which was cut short, e.g. by a crash. Appending continues after the last complete one.
+	if(offset < length) {
+		std::error_code ec;
+		fs::resize_file(mPackPath, offset, ec);
+	}
+}
+
+std::shared_ptr<Bitmap> ThumbnailCache::bitmap(Entry const& entry) const {
+	auto result = std::make_shared<Bitmap>();
+	if(entry.mapped) {
+		// Points into the mapping and keeps it alive
+		result->init(std::shared_ptr<uint8_t[]>(mMapping, mMapping.get() + entry.offset), entry.width, entry.height, (Bitmap::Format) entry.format);
+		return result;
+	}
+
+	if(auto alive = entry.bitmap.lock()) return alive;
+	if(entry.offset == 0) return nullptr;
+
+	// Appended after the pack was mapped: Read it back
+	FILE* f = fopen(mPackPath.c_str(), "rb");
+	if(!f) return nullptr;
+	result->init(entry.width, entry.height, (Bitmap::Format) entry.format);
+	size_t bytes = size_t(entry.width) * entry.height * entry.format;
+	bool   read  = fseek(f, (long) entry.offset, SEEK_SET) == 0 && fread(result->data(), 1, bytes, f) == bytes;
+	fclose(f);
+	if(!read) return nullptr;
+
+	entry.bitmap = result;
+	return result;
+}
+
+size_t ThumbnailCache::append(std::string const& path, Entry const& entry, uint8_t const* pixels, size_t bytes) {
+	FILE* f = fopen(mPackPath.c_str(), "ab");
+	if(!f) return 0; // Still usable for this run, as long as somebody holds the thumbnail
+	fseek(f, 0, SEEK_END);
+	size_t start = (size_t) ftell(f);
+
+	RecordHeader record = {};
+	record.magic      = RecordMagic;
+	record.pathLength = (uint32_t) path.size();
+	record.modified   = entry.modified;
+	record.size       = entry.size;
+	record.width      = (uint16_t) entry.width;
+	record.height     = (uint16_t) entry.height;
+	record.format     = (uint8_t) entry.format;
+
+	static const char zeros[8] = {};
+	size_t written = sizeof(record) + path.size();
+	fwrite(&record, sizeof(record), 1, f);
+	fwrite(path.data(), 1, path.size(), f);
+	fwrite(zeros, 1, align(written, 4) - written, f);
+	size_t offset = start + align(written, 4);
+	written = align(written, 4) + bytes;
+	bool ok = fwrite(pixels, 1, bytes, f) == bytes;
+	fwrite(zeros, 1, align(written, 8) - written, f);
+	ok = fclose(f) == 0 && ok;
+	return ok ? offset : 0;
+}
+
+std::shared_ptr<Bitmap> ThumbnailCache::find(std::string const& path) const {
+	uint64_t modified, size;
+	if(!fileKey(path, modified, size)) return nullptr;
+
+	auto lock = std::lock_guard<std::mutex>(mMutex);
+	auto iter = mEntries.find(path);
+	if(iter == mEntries.end() || iter->second.modified != modified || iter->second.size != size) {
+		return nullptr;
+	}
+	return bitmap(iter->second);
+}
+
+std::shared_ptr<Bitmap> ThumbnailCache::get(std::string const& path) {
+	if(auto cached = find(path)) return cached;
+
+	uint64_t modified = 0, size = 0;
+	fileKey(path, modified, size);
+
+	Bitmap image;
+	image.load(path);
+
+	float    scale  = std::min(1.f, mSize / (float) std::max(image.width(), image.height()));
+	unsigned width  = std::max(1u, (unsigned) std::lround(image.width()  * scale));
+	unsigned height = std::max(1u, (unsigned) std::lround(image.height() * scale));
+
+	auto thumbnail = std::make_shared<Bitmap>();
+	thumbnail->init(width, height, image.format());
+	pixels::downscale(image.data(), image.width(), image.height(), thumbnail->data(), width, height, image.format());
+
+	Entry entry{ modified, size, 0, width, height, (unsigned) image.format(), false, thumbnail };
+	{ auto lock = std::lock_guard<std::mutex>(mMutex);
+		entry.offset = append(path, entry, thumbnail->data(), size_t(width) * height * image.format());
+		mEntries[path] = std::move(entry);
+	}
+	return thumbnail;
+}
+
+void ThumbnailCache::clear() {
+	auto lock = std::lock_guard<std::mutex>(mMutex);
+	mEntries.clear();
+	mMapping = nullptr; // Bitmaps which still use it keep it
+	std::error_code ec;
+	fs::remove(mPackPath, ec);
+	open();
+}
+
+} // namespace wwidget
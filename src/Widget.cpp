@@ -1,24 +1,54 @@
 #include "../include/wwidget/Widget.hpp"
 
 #include "../include/wwidget/Context.hpp"
+#include "../include/wwidget/FrameArena.hpp"
 
 #include "../include/wwidget/Canvas.hpp"
 
 #include "../include/wwidget/Error.hpp"
 #include "../include/wwidget/AttributeCollector.hpp"
 
-#include "../include/wwidget/async/OwnedTask.hpp"
-
 #include "../include/wwidget/widget/Image.hpp"
 #include "../include/wwidget/widget/Text.hpp"
 
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <cmath>
 #include <cassert> // assert
-#include <sstream>
+#include <atomic>
+#include <unordered_map>
 
 namespace wwidget {
 
+// ** Type information *******************************************************
+
+WidgetType WidgetType::Register(const char* name, WidgetType const* base) noexcept {
+	static std::atomic<unsigned> nextBit = 0;
+
+	WidgetType result;
+	result.name = name;
+	result.base = base;
+	unsigned bit = nextBit++;
+	result.bit  = (bit < sizeof(TypeMask) * 8) ? (TypeMask(1) << bit) : 0;
+	result.mask = result.bit | (base ? base->mask : 0);
+	return result;
+}
+
+static
+std::unordered_map<Widget const*, std::vector<TreeObserver*>>& observerTable() {
+	static std::unordered_map<Widget const*, std::vector<TreeObserver*>> table;
+	return table;
+}
+
+WidgetType const& Widget::StaticType() noexcept {
+	static WidgetType const type = WidgetType::Register("Widget", nullptr);
+	return type;
+}
+WidgetType const& Widget::type() const noexcept {
+	return StaticType();
+}
+
 Widget::Widget() noexcept :
 	mPadding{0, 0, 0, 0},
 	mSize(20),
@@ -28,7 +58,9 @@ Widget::Widget() noexcept :
 	mPrevSibling(nullptr),
 	mChildren(nullptr),
 
-	mContext(nullptr)
+	mContext(nullptr),
+
+	mDescendantTypes(0)
 {
 	mFlags.owner = OWNER_EXTERNAL;
 	mFlags.childNeedsRelayout = false;
@@ -38,9 +70,17 @@ Widget::Widget() noexcept :
 	mFlags.needsRedraw = true;
 	mFlags.childNeedsRedraw = true;
 	mFlags.recalcPrefSize = true;
+	mFlags.descendantTypesDirty = false;
+	mFlags.observed = false;
 }
 
 Widget::~Widget() {
+	if(mFlags.observed) {
+		auto iter = observerTable().find(this);
+		auto observers = std::move(iter->second);
+		observerTable().erase(iter);
+		for(auto* o : observers) o->onObservedDestroyed(this);
+	}
 	remove().release();
 	clearChildrenQuietly();
 }
@@ -54,6 +94,10 @@ Widget::Widget(Widget&& other) noexcept :
 }
 Widget& Widget::operator=(Widget&& other) noexcept {
 	remove();
+	// This takes the place of other, with its name and classes
+	if(other.mParent) {
+		other.mParent->notifyObservers(&TreeObserver::onRemoved, &other);
+	}
 
 	mName          = std::move(other.mName);
 	mClasses       = std::move(other.mClasses);
@@ -83,7 +127,13 @@ Widget& Widget::operator=(Widget&& other) noexcept {
 		}
 	}
 	mContext = other.mContext; other.mContext = nullptr;
-	mFlags   = other.mFlags;
+	{
+		bool observed = mFlags.observed; // Observers are bound to the address
+		mFlags = other.mFlags;
+		mFlags.observed = observed;
+	}
+	mFlags.descendantTypesDirty = false;
+	descendantTypesChanged();
 	// other.mFlags.owner = false;
 	other.mFlags.childNeedsRelayout = false;
 	other.mFlags.needsRelayout = true;
@@ -92,7 +142,10 @@ Widget& Widget::operator=(Widget&& other) noexcept {
 	other.mFlags.needsRedraw = true;
 	other.mFlags.childNeedsRedraw = true;
 	other.mFlags.recalcPrefSize = true;
+	other.mFlags.descendantTypesDirty = false;
+	other.mDescendantTypes = 0;
 
+	notifyObservers(&TreeObserver::onChanged, this);
 	return *this;
 }
 
@@ -106,13 +159,21 @@ Widget::Widget(Widget const& other) noexcept :
 Widget& Widget::operator=(Widget const& other) noexcept {
 	mName    = other.mName; // TODO: Should the copy constructor copy the name?
 	mClasses = other.mClasses;
-	mFlags   = other.mFlags;
+	{
+		bool observed = mFlags.observed; // Observers are bound to the address
+		mFlags = other.mFlags;
+		mFlags.observed = observed;
+	}
+	mFlags.descendantTypesDirty = false;
+	descendantTypesChanged();
+	notifyObservers(&TreeObserver::onChanged, this);
 	return *this;
 }
 
 // ** Tree operations *******************************************************
 
 void Widget::notifyChildAdded(Widget* newChild) {
+	descendantTypesChanged();
 	newChild->context(context());
 	newChild->onAddTo(this);
 	onAdd(newChild);
@@ -125,6 +186,8 @@ void Widget::notifyChildAdded(Widget* newChild) {
 			p = p->parent();
 		}
 	}
+
+	notifyObservers(&TreeObserver::onAdded, newChild);
 }
 
 void Widget::notifyChildRemoved(Widget* noLongerChild) {
@@ -132,6 +195,54 @@ void Widget::notifyChildRemoved(Widget* noLongerChild) {
 	onRemove(noLongerChild);
 }
 
+void Widget::descendantTypesChanged() noexcept {
+	// A dirty widget implies dirty parents, so we can stop at the first one
+	for(Widget* w = this; w && !w->mFlags.descendantTypesDirty; w = w->parent()) {
+		w->mFlags.descendantTypesDirty = true;
+	}
+}
+
+void Widget::notifyObservers(void (TreeObserver::*fn)(Widget*), Widget* subject) {
+	for(Widget* w = this; w; w = w->parent()) {
+		if(!w->mFlags.observed) continue;
+		// Observers can remove themselves or others from their callbacks, which changes the table
+		auto& table = observerTable()[w];
+		FrameVector<TreeObserver*> observers(table.begin(), table.end(), frameMemory());
+		for(auto* o : observers) {
+			if(!w->mFlags.observed) break;
+			auto& current = observerTable()[w];
+			if(std::find(current.begin(), current.end(), o) == current.end()) continue;
+			(o->*fn)(subject);
+		}
+	}
+}
+
+void Widget::addObserver(TreeObserver* o) {
+	observerTable()[this].push_back(o);
+	mFlags.observed = true;
+}
+void Widget::removeObserver(TreeObserver* o) {
+	if(!mFlags.observed) return;
+	auto iter      = observerTable().find(this);
+	auto& observers = iter->second;
+	observers.erase(std::remove(observers.begin(), observers.end(), o), observers.end());
+	if(observers.empty()) {
+		observerTable().erase(iter);
+		mFlags.observed = false;
+	}
+}
+
+TypeMask Widget::descendantTypes() noexcept {
+	if(mFlags.descendantTypesDirty) {
+		mFlags.descendantTypesDirty = false;
+		mDescendantTypes = 0;
+		for(Widget* c = mChildren; c; c = c->mNextSibling) {
+			mDescendantTypes |= c->type().mask | c->descendantTypes();
+		}
+	}
+	return mDescendantTypes;
+}
+
 void Widget::add(Widget* w) {
 	if(!w) {
 		throw exceptions::InvalidPointer("w");
@@ -252,6 +363,8 @@ std::unique_ptr<Widget> Widget::remove() {
 std::unique_ptr<Widget> Widget::removeQuiet() {
 	removeFocus();
 	if(mParent) {
+		mParent->notifyObservers(&TreeObserver::onRemoved, this);
+		mParent->descendantTypesChanged();
 		if(!mPrevSibling) {
 			assert(mParent->children() == this);
 			mParent->mChildren = mNextSibling;
@@ -278,6 +391,14 @@ std::unique_ptr<Widget> Widget::removeQuiet() {
 	return acquireOwnership();
 }
 
+void Widget::destroy() {
+	Context* ctx = context();
+	auto self    = remove();
+	if(self && ctx) {
+		ctx->collect(std::move(self));
+	}
+}
+
 std::unique_ptr<Widget> Widget::acquireOwnership() noexcept {
 	if(mFlags.owner == OWNER_EXTERNAL)
 		return nullptr;
@@ -330,7 +451,7 @@ Widget* Widget::findRoot() const noexcept {
 
 void Widget::clearChildren() {
 	while(mChildren) {
-		mChildren->remove();
+		mChildren->destroy();
 	}
 }
 void Widget::clearChildrenQuietly() {
@@ -503,7 +624,7 @@ void Widget::onDraw(Canvas& graphics) {}
 bool Widget::setAttribute(std::string_view s, Attribute const& value) {
 	switch(fnv1a(s)) {
 	case fnv1a("name"):
-		mName.reset(value.toString());
+		name(value.toString());
 		return true;
 	case fnv1a("class"):
 		classes(value.toString());
@@ -554,9 +675,9 @@ void Widget::getAttributes(wwidget::AttributeCollectorInterface& collector) {
 
 	if(collector.startSection("debug")) {
 		{
-			std::stringstream ss;
-			ss << this;
-			collector("ptr", ss.str(), "");
+			char ptr[32];
+			int  n = snprintf(ptr, sizeof(ptr), "%p", (void*) this);
+			collector("ptr", std::string_view(ptr, std::max(n, 0)), "");
 		}
 		if(mFlags.owner != OWNER_EXTERNAL) {
 			switch(owner()) {
@@ -586,7 +707,7 @@ void Widget::getAttributes(wwidget::AttributeCollectorInterface& collector) {
 
 	collector("name", mName, "");
 	{
-		std::string result;
+		FrameString result(frameMemory());
 		size_t len = 0;
 		for(auto& c : mClasses) len += c.length();
 		result.reserve(len);
@@ -757,6 +878,7 @@ void Widget::paddingChanged() {
 
 void Widget::requestRedraw() {
 	if(!mFlags.needsRedraw) {
+		mFlags.needsRedraw = true;
 		for(Widget* p = parent(); p && !p->mFlags.childNeedsRedraw; p = p->parent()) {
 			if(p->mFlags.childNeedsRedraw)
 				break;
@@ -856,7 +978,7 @@ Widget* Widget::text(std::string const& s) {
 	}
 	else if(!s.empty()) {
 		auto* l = add<Text>();
-		l->content(s)->align(AlignCenter)->classes(".generated");
+		l->content(s)->align(AlignCenter)->classes("generated");
 	}
 	return this;
 }
@@ -874,7 +996,7 @@ Widget* Widget::image(std::string const& s) {
 			l->image(s);
 	}
 	else if(!s.empty()) {
-		add<Image>(s)->align(AlignCenter)->classes(".generated");
+		add<Image>(s)->align(AlignCenter)->classes("generated");
 	}
 	return this;
 }
@@ -900,12 +1022,19 @@ PreferredSize const& Widget::preferredSize() {
 	return mPreferredSize;
 }
 
+Widget& Widget::name(std::string const& n) noexcept {
+	mName.reset(n.data(), n.length());
+	notifyObservers(&TreeObserver::onChanged, this);
+	return *this;
+}
+
 Widget* Widget::classes(
 	std::string const& s) noexcept
 {
 	auto iter = std::lower_bound(mClasses.begin(), mClasses.end(), s.c_str());
 	if(iter == mClasses.end() || *iter != s.c_str()) {
 		mClasses.emplace(iter, s.data(), s.length());
+		notifyObservers(&TreeObserver::onChanged, this);
 	}
 	return this;
 }
@@ -937,6 +1066,23 @@ Widget* Widget::offset(float x, float y) {
 Widget* Widget::offsetx(float x) { return offset(x, offsety()); }
 Widget* Widget::offsety(float y) { return offset(offsetx(), y); }
 
+float Widget::viewportDistance() const noexcept {
+	// Each ancestor clips its children to its own bounds
+	Offset min = {0, 0};
+	Offset max = {width(), height()};
+	float  distance = 0;
+	for(Widget const* w = this; w->parent(); w = w->parent()) {
+		min.x += w->offsetx(); min.y += w->offsety();
+		max.x += w->offsetx(); max.y += w->offsety();
+
+		Widget const* p = w->parent();
+		float dx = std::max({0.f, -max.x, min.x - p->width()});
+		float dy = std::max({0.f, -max.y, min.y - p->height()});
+		distance = std::max({distance, dx, dy});
+	}
+	return distance;
+}
+
 Offset Widget::absoluteOffset(Widget const* relativeToParent) {
 	Offset off = offset();
 	for(Widget* p = parent(); p != relativeToParent; p = p->parent()) {
@@ -967,6 +1113,7 @@ Widget* Widget::padding(float all_around) {
 // ** Set-functions *******************************************************
 Widget* Widget::set(Name&& nam) {
 	mName = std::move(nam);
+	notifyObservers(&TreeObserver::onChanged, this);
 	return this;
 }
 Widget* Widget::set(Class&& cls) {
@@ -1023,10 +1170,10 @@ Widget* Widget::context(Context* app) {
 	return this;
 }
 
-void Widget::defer(std::function<void()> fn) {
+void Widget::defer(unique_task fn, TaskPriority priority) {
 	auto* a = context();
 	if(a) {
-		a->defer(std::move(fn));
+		a->defer(std::move(fn), priority);
 	}
 	else {
 		// HACK: This could brake if fn() removes the widget which calls defer etc.
@@ -1034,25 +1181,32 @@ void Widget::defer(std::function<void()> fn) {
 		fn();
 	}
 }
+std::pmr::memory_resource* Widget::frameMemory() const noexcept {
+	if(auto* a = context())
+		return &a->frameArena();
+	return std::pmr::new_delete_resource();
+}
 // void Widget::deferDraw(std::function<void()> fn) {
 // 	auto* a = context();
 // 	assert(a);
 // 	a->deferDraw(std::move(fn));
 // }
 
-void Widget::loadImage(Owner* taskOwner, std::function<void(std::shared_ptr<Bitmap>)> fn, std::string const& url) {
+std::shared_ptr<ImageRequest> Widget::loadImage(Owner* taskOwner, unique_function<void(std::shared_ptr<Bitmap>)> fn, std::string const& url) {
 	auto* a = context();
-	if(!a)
+	if(!a) {
 		fn(nullptr);
-	else
-		a->loadImage(makeOwnedTask(taskOwner, std::move(fn)), url);
+		return nullptr;
+	}
+	return a->loadImage(std::move(fn), url, taskOwner, this);
 }
-void Widget::loadImage(Owner* taskOwner, std::shared_ptr<Bitmap>& to, std::string const& url) {
+std::shared_ptr<ImageRequest> Widget::loadImage(Owner* taskOwner, std::shared_ptr<Bitmap>& to, std::string const& url) {
 	auto* a = context();
-	if(!a)
+	if(!a) {
 		to = nullptr;
-	else
-		a->loadImage(makeOwnedTask(taskOwner, [&](auto p) { to = std::move(p); }), url);
+		return nullptr;
+	}
+	return a->loadImage([&to](auto p) { to = std::move(p); }, url, taskOwner, this);
 }
 std::shared_ptr<Bitmap> Widget::loadImage(std::string const& url) {
 	auto* a = context();
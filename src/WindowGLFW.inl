@@ -1,4 +1,5 @@
 #include "../include/wwidget/Window.hpp"
+#include "../include/wwidget/Runtime.hpp"
 
 #include "../include/wwidget/CanvasNVG.cpp"
 
@@ -49,6 +50,17 @@ static PFNGLDELETEBUFFERSPROC            glDeleteBuffers;
 #include <stdexcept>
 #include <iostream>
 
+// With X11 the connection to the display can be waited for with epoll, together with the fds the user watches.
+// Declared by hand, Xlib's headers define macros which clash with ours. Define WWIDGET_NO_X11 if glfw is built without it.
+#if defined(__linux__) && !defined(WWIDGET_NO_X11)
+	#define WWIDGET_GLFW_DISPLAY_FD 1
+extern "C" {
+	struct _XDisplay;
+	_XDisplay* glfwGetX11Display(void);
+	int        XConnectionNumber(_XDisplay*);
+}
+#endif
+
 #define mWindow ((GLFWwindow*&) mWindowPtr)
 
 namespace wwidget {
@@ -172,7 +184,8 @@ void myGlfwCharInput(GLFWwindow* win, unsigned int codepoint, int mods) {
 
 Window::Window() :
 	mWindowPtr(nullptr),
-	mFlags(0)
+	mFlags(0),
+	mFrameInterval(std::chrono::seconds(1) / 60)
 {
 	BasicContext::rootWidget(this);
 }
@@ -184,7 +197,10 @@ Window::Window(const char* title, unsigned width, unsigned height, uint32_t flag
 }
 
 Window::~Window() {
+	// Workers defer their results, which wakes the window. Stop that before it goes away, not only in ~BasicContext.
+	runtime().detach(this);
 	clearChildren();
+	collectGarbage(); // While the gl context still exists
 	close();
 }
 
@@ -215,6 +231,9 @@ void Window::open(const char* title, unsigned width, unsigned height, uint32_t f
 		glfwWindowHint(GLFW_BLUE_BITS, vidmode->blueBits);
 		glfwWindowHint(GLFW_ALPHA_BITS, 0);
 		glfwWindowHint(GLFW_REFRESH_RATE, vidmode->refreshRate);
+		if(vidmode->refreshRate > 0) {
+			mFrameInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / vidmode->refreshRate;
+		}
 
 		glfwWindowHint(GLFW_ACCUM_RED_BITS, 0);
 		glfwWindowHint(GLFW_ACCUM_GREEN_BITS, 0);
@@ -292,10 +311,27 @@ void Window::open(const char* title, unsigned width, unsigned height, uint32_t f
 	// TODO: don't ignore FlagAnaglyph3d
 	canvas(std::make_shared<CanvasNVG>(nvgCreateGL3((flags & FlagAntialias) ? NVG_ANTIALIAS : 0), nvgDeleteGL3));
 
+#ifdef WWIDGET_GLFW_DISPLAY_FD
+	if(_XDisplay* display = glfwGetX11Display()) {
+		// Nothing to do in the callback: waitEvents() lets glfw read the events
+		mDisplayWatch = watch(XConnectionNumber(display), [](int) {});
+	}
+#endif
+
 	++gNumWindows;
+
+	auto l = std::lock_guard<std::mutex>(mWakeMutex);
+	mPostWakeup = !mDisplayWatch;
 }
 
 void Window::close() {
+	{ auto l = std::lock_guard<std::mutex>(mWakeMutex);
+		mPostWakeup = false;
+	}
+	if(mDisplayWatch) {
+		mDisplayWatch->cancel();
+		mDisplayWatch = nullptr;
+	}
 	if(mWindow) {
 		glfwDestroyWindow(mWindow);
 		--gNumWindows;
@@ -312,8 +348,8 @@ void Window::requestClose() {
 }
 
 bool Window::update() {
-	if(mFlags & FlagUpdateOnEvent)
-		glfwWaitEvents();
+	if((mFlags & FlagUpdateOnEvent) && !needsFrame())
+		waitIdle();
 	else
 		glfwPollEvents();
 
@@ -322,8 +358,74 @@ bool Window::update() {
 	return !glfwWindowShouldClose(mWindow);
 }
 
+void Window::wakeup() {
+	// Threadsafe, and cheap enough: It's only called for the first task after an update.
+	// The eventfd lives as long as the context, glfw only as long as the window is open.
+	BasicContext::wakeup();
+	auto l = std::lock_guard<std::mutex>(mWakeMutex);
+	if(mPostWakeup) {
+		glfwPostEmptyEvent();
+	}
+}
+
+void Window::waitEvents(std::chrono::steady_clock::duration timeout) {
+	using namespace std::chrono;
+	bool forever = timeout == steady_clock::duration::max();
+
+	if(mDisplayWatch) {
+		// Xlib might have queued events already, which epoll can't see. Empty the queue first, handling the input might be enough.
+		glfwPollEvents();
+		if(forever && needsFrame()) return;
+		fdWatcher().wait(forever ? milliseconds(-1) : ceil<milliseconds>(timeout));
+		glfwPollEvents();
+	}
+	else if(!fdWatcher().empty()) {
+		// glfw can't wait for our fds, update() looks at them. 4ms keeps the latency below a frame.
+		glfwWaitEventsTimeout(duration<double>(std::min<steady_clock::duration>(timeout, milliseconds(4))).count());
+	}
+	else if(forever) {
+		glfwWaitEvents();
+	}
+	else {
+		glfwWaitEventsTimeout(duration<double>(timeout).count());
+	}
+}
+
+void Window::waitIdle() {
+	using namespace std::chrono;
+	auto timer = nextTimer();
+	if(timer == steady_clock::time_point::max())
+		waitEvents(steady_clock::duration::max());
+	else
+		waitEvents(std::max(timer - steady_clock::now(), steady_clock::duration::zero()));
+}
+
+void Window::paceFrame() {
+	// With vsync, swapping the buffers waits for the monitor
+	if(mFlags & FlagNoVsync) {
+		auto next = mLastFrame + mFrameInterval;
+		auto now  = std::chrono::steady_clock::now();
+		if(now < next) {
+			// Still handle input and fds while waiting
+			waitEvents(next - now);
+		}
+	}
+	mLastFrame = std::chrono::steady_clock::now();
+}
+
 void Window::keepOpen() {
-	while(update()) {
+	while(!glfwWindowShouldClose(mWindow)) {
+		// Returns on input, a watched fd or wakeup()
+		if(needsFrame())
+			glfwPollEvents();
+		else
+			waitIdle();
+
+		if(glfwWindowShouldClose(mWindow))
+			break;
+
+		paceFrame();
+		BasicContext::update();
 		draw();
 	}
 }
@@ -2,26 +2,103 @@
 
 namespace wwidget {
 
-TaskQueue::TaskQueue() {
+static
+size_t roundUpToPowerOfTwo(size_t n) noexcept {
+	size_t result = 2;
+	while(result < n) result *= 2;
+	return result;
+}
 
+TaskQueue::TaskQueue(size_t capacity) :
+	mSlots(new Slot[roundUpToPowerOfTwo(capacity)]),
+	mMask(roundUpToPowerOfTwo(capacity) - 1),
+	mEnqueue(0),
+	mDequeue(0),
+	mOverflowing(false),
+	mSignaled(false)
+{
+	for(size_t i = 0; i <= mMask; i++) {
+		mSlots[i].sequence.store(i, std::memory_order_relaxed);
+	}
 }
 TaskQueue::~TaskQueue() {
 
 }
 
-void TaskQueue::add(std::function<void()> fn) {
-	mMutex.lock();
-	mTasks.emplace_back(std::move(fn));
-	mMutex.unlock();
+// Bounded queue from Dmitry Vyukov. A slot's sequence is its position when it's free and position + 1 when it's filled.
+bool TaskQueue::tryPush(unique_task& fn) noexcept {
+	size_t pos = mEnqueue.load(std::memory_order_relaxed);
+	while(true) {
+		Slot&     slot = mSlots[pos & mMask];
+		size_t    seq  = slot.sequence.load(std::memory_order_acquire);
+		ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+		if(diff == 0) {
+			if(mEnqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				slot.task = std::move(fn);
+				slot.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if(diff < 0) {
+			return false; // Full
+		}
+		else {
+			pos = mEnqueue.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void TaskQueue::add(unique_task fn) {
+	if(!fn) return;
+
+	// Once something overflowed, everything has to, until it's drained. Otherwise tasks could overtake each other.
+	if(mOverflowing.load(std::memory_order_acquire) || !tryPush(fn)) {
+		auto l = std::lock_guard<std::mutex>(mOverflowMutex);
+		mOverflow.emplace_back(std::move(fn));
+		mOverflowing.store(true, std::memory_order_release);
+	}
+
+	if(!mSignaled.exchange(true, std::memory_order_acq_rel) && mWakeup) {
+		mWakeup();
+	}
+}
+
+void TaskQueue::wakeupHook(unique_task fn) {
+	mWakeup = std::move(fn);
+}
+
+size_t TaskQueue::drain(std::vector<unique_task>& batch) {
+	// Reset before looking at the queue, so a task which arrives during the drain signals again
+	mSignaled.store(false, std::memory_order_seq_cst);
+
+	size_t n = 0;
+	while(true) {
+		Slot& slot = mSlots[mDequeue & mMask];
+		if(slot.sequence.load(std::memory_order_acquire) != mDequeue + 1)
+			break;
+		batch.emplace_back(std::move(slot.task));
+		slot.sequence.store(mDequeue + mMask + 1, std::memory_order_release);
+		++mDequeue;
+		++n;
+	}
+
+	// Overflowed tasks are newer than everything in the ring. A slot which was taken but isn't filled yet
+	//  can hold an older task of a thread whose next tasks overflowed, so they wait until the ring is empty.
+	if(mOverflowing.load(std::memory_order_acquire) && mEnqueue.load(std::memory_order_acquire) == mDequeue) {
+		auto l = std::lock_guard<std::mutex>(mOverflowMutex);
+		n += mOverflow.size();
+		for(auto& task : mOverflow) batch.emplace_back(std::move(task));
+		mOverflow.clear();
+		mOverflowing.store(false, std::memory_order_release);
+	}
+
+	return n;
 }
 
 size_t TaskQueue::executeSingleConsumer() {
 	size_t n = 0;
-	std::deque<std::function<void()>> tasks;
-	while(!mTasks.empty()) {
-		mMutex.lock();
-		tasks.swap(mTasks);
-		mMutex.unlock();
+	auto& tasks = mExecuting;
+	while(drain(tasks) > 0) {
 		n += tasks.size();
 		for(auto& task : tasks) task();
 		tasks.clear();
@@ -1,70 +1,343 @@
 #include "../../include/wwidget/async/Threadpool.hpp"
 
+#include "../../include/wwidget/async/ChaseLevDeque.hpp"
+
+#include <algorithm>
+
 namespace wwidget {
 
+struct Threadpool::Node {
+	unique_task task;
+	Node*       next     = nullptr;
+	bool        external = false; //!< Added from outside the pool, goes back to mSpares after it ran
+
+	/// Deletes the list starting at node
+	static void deleteAll(Node* node) noexcept {
+		while(node) {
+			auto* next = node->next;
+			delete node;
+			node = next;
+		}
+	}
+};
+
+struct Threadpool::Worker {
+	Threadpool*                      pool;
+	size_t                           index;
+	bool                             latencyOnly;
+	uint32_t                         random;
+	ChaseLevDeque<Node*>             lanes[LANE_COUNT];
+	std::thread                      thread;
+	Node*                            spare          = nullptr; //!< Free nodes for tasks this worker adds
+	size_t                           spareCount     = 0;
+	Node*                            returning      = nullptr; //!< Free nodes of external tasks, given back to mSpares in batches
+	size_t                           returningCount = 0;
+
+	~Worker() {
+		Node::deleteAll(spare);
+		Node::deleteAll(returning);
+	}
+};
+
+thread_local Threadpool::Worker* Threadpool::tCurrentWorker = nullptr;
+
+// How many tasks a worker takes from the injection queue at once
+static constexpr size_t InjectionBatch = 16;
+// How many free nodes a worker keeps for itself
+static constexpr size_t WorkerSpares   = 256;
+// How many free nodes are kept for tasks from outside the pool
+static constexpr size_t SharedSpares   = 1024;
+// How many free nodes a worker collects before it gives them back to the shared spares
+static constexpr size_t ReturnBatch    = 16;
+
 Threadpool::Threadpool() :
-	mRunning(false)
+	mRunning(false),
+	mPending{},
+	mSleeping{}
 {}
-Threadpool::Threadpool(size_t size) :
+Threadpool::Threadpool(size_t size, size_t latencyWorkers) :
 	Threadpool()
 {
-	start(size);
+	start(size, latencyWorkers);
 }
 Threadpool::~Threadpool() {
 	stop();
+	for(auto& injector : mInjectors) {
+		Node::deleteAll(injector.head);
+	}
+	Node::deleteAll(mSpares.nodes);
 }
 
-void Threadpool::start(size_t size) {
+size_t Threadpool::defaultSize() noexcept {
+	return std::max(1u, std::thread::hardware_concurrency()) - (std::thread::hardware_concurrency() > 1);
+}
+
+void Threadpool::start(size_t size, size_t latencyWorkers) {
 	stop();
 
+	size           = std::max<size_t>(size, 1);
+	latencyWorkers = std::min(latencyWorkers, size - 1);
+
 	mRunning = true;
-	mThreads.reserve(size);
-	while(mThreads.size() < size) {
-		mThreads.emplace_back([this]() {
-			while(auto task = await_pop()) {
-				task();
-			}
-		});
+	mWorkers.reserve(size);
+	for(size_t i = 0; i < size; i++) {
+		auto w = std::make_unique<Worker>();
+		w->pool        = this;
+		w->index       = i;
+		w->latencyOnly = i < latencyWorkers;
+		w->random      = uint32_t(i * 2654435761u + 1);
+		mWorkers.emplace_back(std::move(w));
+	}
+	// Start them after all deques exist, they steal from each other
+	for(auto& w : mWorkers) {
+		w->thread = std::thread([this, w = w.get()]() { run(*w); });
 	}
 }
 void Threadpool::stop() {
-	mRunning = false;
-	mWaiting.notify_all();
-	for(auto& thread : mThreads)
-		thread.join();
-	mThreads.clear();
+	{ auto l = std::lock_guard<std::mutex>(mSleepMutex);
+		mRunning = false;
+	}
+	mWake[0].notify_all();
+	mWake[1].notify_all();
+	for(auto& w : mWorkers) {
+		w->thread.join();
+		returnSpares(*w);
+	}
+
+	// Keep what didn't run for the next start. Workers took it from the front of the injection queue, so put it back there.
+	for(size_t lane = 0; lane < LANE_COUNT; lane++) {
+		Node*  first = nullptr;
+		Node*  last  = nullptr;
+		size_t count = 0;
+		Node*  node;
+		for(auto& w : mWorkers) {
+			while(w->lanes[lane].steal(node)) {
+				node->next = nullptr;
+				(last ? last->next : first) = node;
+				last = node;
+				count++;
+			}
+		}
+		if(!first) continue;
+
+		auto& injector = mInjectors[lane];
+		auto l = std::lock_guard<std::mutex>(injector.mutex);
+		last->next    = injector.head;
+		injector.head = first;
+		if(!injector.tail) injector.tail = last;
+		injector.count += count;
+	}
+	mWorkers.clear();
 }
-void Threadpool::add(std::function<void()>&& fn) {
-	auto l = std::lock_guard<std::mutex>(mMutex);
-	mTasks.emplace_back(fn);
-	mWaiting.notify_one();
+
+void Threadpool::add(unique_task fn, TaskLane lane) {
+	if(!fn) return;
+
+	Worker* w = tCurrentWorker && tCurrentWorker->pool == this ? tCurrentWorker : nullptr;
+	Node* node = acquire(w);
+	node->task = std::move(fn);
+
+	// Counted before it's visible, so it's never taken before it's counted
+	mPending[lane]++;
+
+	if(w) {
+		w->lanes[lane].push(node);
+	}
+	else {
+		auto& injector = mInjectors[lane];
+		auto l = std::lock_guard<std::mutex>(injector.mutex);
+		(injector.tail ? injector.tail->next : injector.head) = node;
+		injector.tail = node;
+		injector.count++;
+	}
+	wake(lane);
 }
 
-std::function<void()> Threadpool::await_pop() {
-	auto l = std::unique_lock<std::mutex>(mMutex);
+unique_task Threadpool::try_pop() {
+	Worker* w = tCurrentWorker && tCurrentWorker->pool == this ? tCurrentWorker : nullptr;
+	for(size_t lane = 0; lane < LANE_COUNT; lane++) {
+		if(Node* node = find(w, (TaskLane)lane)) {
+			unique_task result = std::move(node->task);
+			release(w, node);
+			return result;
+		}
+	}
+	return nullptr;
+}
 
-	std::function<void()> result;
-	if(mTasks.empty()) {
-		mWaiting.wait(l, [this]() {
-			return !running() || !mTasks.empty();
-		});
+Threadpool::Node* Threadpool::acquire(Worker* w) {
+	Node* node = nullptr;
+	if(w) {
+		if((node = w->spare)) {
+			w->spare = node->next;
+			w->spareCount--;
+		}
+	}
+	else {
+		auto l = std::lock_guard<std::mutex>(mSpares.mutex);
+		if((node = mSpares.nodes)) {
+			mSpares.nodes = node->next;
+			mSpares.count--;
+		}
+	}
+	if(!node) node = new Node;
+	node->next     = nullptr;
+	node->external = !w;
+	return node;
+}
 
-		if(!running()) return nullptr;
+void Threadpool::release(Worker* w, Node* node) {
+	// Whatever the task captured goes now, not when the node is reused
+	node->task = nullptr;
+
+	if(!w) {
+		auto l = std::lock_guard<std::mutex>(mSpares.mutex);
+		if(mSpares.count < SharedSpares) {
+			node->next    = mSpares.nodes;
+			mSpares.nodes = node;
+			mSpares.count++;
+		}
+		else {
+			delete node;
+		}
+	}
+	else if(node->external) {
+		node->next   = w->returning;
+		w->returning = node;
+		if(++w->returningCount >= ReturnBatch) returnSpares(*w);
+	}
+	else if(w->spareCount < WorkerSpares) {
+		node->next = w->spare;
+		w->spare   = node;
+		w->spareCount++;
+	}
+	else {
+		delete node;
+	}
+}
+
+void Threadpool::returnSpares(Worker& w) {
+	if(!w.returning) return;
+
+	auto l = std::lock_guard<std::mutex>(mSpares.mutex);
+	while(Node* node = w.returning) {
+		w.returning = node->next;
+		if(mSpares.count < SharedSpares) {
+			node->next    = mSpares.nodes;
+			mSpares.nodes = node;
+			mSpares.count++;
+		}
+		else {
+			delete node;
+		}
+	}
+	w.returningCount = 0;
+}
+
+bool Threadpool::isWorkerFor(TaskLane lane) const noexcept {
+	Worker* w = tCurrentWorker;
+	return w && w->pool == this && (lane == LANE_LATENCY || !w->latencyOnly);
+}
+
+void Threadpool::wake(TaskLane lane) {
+	// Prefer latency workers for latency tasks, they don't have anything else to do
+	int group = (lane == LANE_LATENCY && mSleeping[0] > 0) ? 0 : 1;
+	if(mSleeping[group] > 0) {
+		auto l = std::lock_guard<std::mutex>(mSleepMutex);
+		mWake[group].notify_one();
+	}
+}
+
+bool Threadpool::hasWork(bool latencyOnly) const noexcept {
+	return mPending[LANE_LATENCY] > 0 || (!latencyOnly && mPending[LANE_BULK] > 0);
+}
+
+Threadpool::Node* Threadpool::find(Worker* w, TaskLane lane) {
+	Node* node = nullptr;
+	if(!(w && w->lanes[lane].pop(node))) {
+		node = findInjected(w, lane);
+		if(!node) node = steal(w, lane);
 	}
+	if(node) mPending[lane]--;
+	return node;
+}
+
+Threadpool::Node* Threadpool::findInjected(Worker* w, TaskLane lane) {
+	auto& injector = mInjectors[lane];
+	auto l = std::lock_guard<std::mutex>(injector.mutex);
+	auto pop = [&]() {
+		Node* node    = injector.head;
+		injector.head = node->next;
+		if(!injector.head) injector.tail = nullptr;
+		injector.count--;
+		node->next = nullptr;
+		return node;
+	};
+	if(!injector.head) return nullptr;
 
-	result = mTasks.front();
-	mTasks.pop_front();
+	Node* node = pop();
 
-	return result;
+	if(w) {
+		// Take a fair share more, so the others can steal it without touching the lock
+		size_t n = std::min(InjectionBatch, injector.count / mWorkers.size());
+		for(size_t i = 0; i < n; i++) {
+			w->lanes[lane].push(pop());
+		}
+	}
+	return node;
 }
-std::function<void()> Threadpool::try_pop() {
-	auto l = std::unique_lock<std::mutex>(mMutex);
-	std::function<void()> result;
-	if(!mTasks.empty()) {
-		result = mTasks.front();
-		mTasks.pop_front();
+
+Threadpool::Node* Threadpool::steal(Worker* w, TaskLane lane) {
+	size_t n = mWorkers.size();
+	if(n == 0) return nullptr;
+
+	// Start at a random victim, so thieves don't all pile up on the same one
+	size_t start = 0;
+	if(w) {
+		w->random ^= w->random << 13;
+		w->random ^= w->random >> 17;
+		w->random ^= w->random << 5;
+		start = w->random % n;
+	}
+
+	Node* node = nullptr;
+	for(size_t i = 0; i < n; i++) {
+		Worker* victim = mWorkers[(start + i) % n].get();
+		if(victim != w && victim->lanes[lane].steal(node))
+			return node;
 	}
-	return result;
+	return nullptr;
+}
+
+void Threadpool::run(Worker& w) {
+	tCurrentWorker = &w;
+	int group = w.latencyOnly ? 0 : 1;
+
+	while(mRunning) {
+		Node* node = find(&w, LANE_LATENCY);
+		if(!node && !w.latencyOnly) {
+			node = find(&w, LANE_BULK);
+		}
+
+		if(node) {
+			node->task();
+			release(&w, node);
+			continue;
+		}
+
+		// Whoever adds from outside gets the nodes back before this worker dozes off
+		returnSpares(w);
+
+		// A steal can fail while there still is work, only sleep once there's really nothing left
+		auto l = std::unique_lock<std::mutex>(mSleepMutex);
+		mSleeping[group]++;
+		mWake[group].wait(l, [&]() {
+			return !mRunning || hasWork(w.latencyOnly);
+		});
+		mSleeping[group]--;
+	}
+
+	tCurrentWorker = nullptr;
 }
 
-} // namespace wwidget
\ No newline at end of file
+} // namespace wwidget
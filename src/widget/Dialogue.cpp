@@ -34,10 +34,10 @@ Dialogue* Dialogue::option(std::string const& name, std::function<void()> callba
 	auto* b = add<Button>();
 	b->text(name);
 	if(callback) {
-		b->onClick([=](Button*) { remove(); callback(); });
+		b->onClick([this, callback](Button*) { remove(); callback(); });
 	}
 	else {
-		b->onClick([=](Button*) { remove(); });
+		b->onClick([this](Button*) { remove(); });
 	}
 	return this;
 }
@@ -6,6 +6,7 @@
 #include "../../include/wwidget/widget/ContextMenu.hpp"
 
 #include "../../include/wwidget/Canvas.hpp"
+#include "../../include/wwidget/Runtime.hpp"
 #include "../../include/wwidget/UnicodeConstants.hpp"
 
 #include <limits>
@@ -83,9 +84,10 @@ public:
 				extension == ".pgm" ||
 				extension == ".pnm"
 			) {
+				// A small version from the thumbnail cache, not the whole image
 				Image* img = mContent.add<Image>();
 				img->maxSize({64});
-				img->source(p)
+				img->source(Runtime::thumbnailUrl(p.string(), 64))
 				   ->align(AlignCenter);
 			}
 			else {
@@ -212,7 +214,7 @@ FileBrowser* FileBrowser::path(std::string const& path_s) {
 	}
 	mFilePane.scrollOffset(0);
 
-	mTextField.content(path);
+	mTextField.content(path.string());
 
 	return this;
 }
@@ -96,7 +96,7 @@ Form& Form::parse(const char* text) {
 		throw exceptions::ParsingError(e.what(), e.where<char>(), text);
 	}
 
-	auto buildRecursive = [=](auto& buildRecursive, Widget* to, xml_node<>* to_data) -> void {
+	auto buildRecursive = [this, text](auto& buildRecursive, Widget* to, xml_node<>* to_data) -> void {
 		for(xml_attribute<>* attrib = to_data->first_attribute(); attrib; attrib = attrib->next_attribute()) {
 			bool success = to->setAttribute(
 				std::string_view(attrib->name(), attrib->name_size()),
@@ -1,17 +1,28 @@
 #include "../../include/wwidget/widget/Image.hpp"
 
+#include "../../include/wwidget/AnimatedBitmap.hpp"
 #include "../../include/wwidget/Canvas.hpp"
 #include "../../include/wwidget/Bitmap.hpp"
+#include "../../include/wwidget/Context.hpp"
+#include "../../include/wwidget/Runtime.hpp"
 
 #include "../../include/wwidget/AttributeCollector.hpp"
 
+#include "../../include/wwidget/async/OwnedTask.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+
 namespace wwidget {
 
 Image::Image() :
 	Widget(),
 	mStretch(false),
 	mTint(Color::white()),
-	mMaxSize(Size::infinite())
+	mMaxSize(Size::infinite()),
+	mResolution(0)
 {}
 
 Image::Image(std::string source) :
@@ -33,10 +44,14 @@ Image::Image(Image&& other) noexcept :
 	mSource(std::move(other.mSource)),
 	mStretch(other.mStretch),
 	mTint(std::move(other.mTint)),
-	mImage(std::move(other.mImage))
+	mImage(std::move(other.mImage)),
+	mMaxSize(other.mMaxSize),
+	mResolution(other.mResolution),
+	mAnimation(std::move(other.mAnimation))
 {
 	other.mTint = Color::white();
 	other.mStretch = false;
+	animate(); // The timer of other only knows other
 }
 Image& Image::operator=(Image&& other) noexcept {
 	Widget::operator=(std::move(other));
@@ -44,19 +59,104 @@ Image& Image::operator=(Image&& other) noexcept {
 	mTint = other.mTint;
 	other.mTint = Color::white();
 	mImage = std::move(other.mImage);
+	mMaxSize = other.mMaxSize;
+	mResolution = other.mResolution;
+	mAnimationTasks.clearOwnerships();
+	mAnimation = std::move(other.mAnimation);
+	animate();
 	return *this;
 }
 
 void Image::load(std::string path, bool force_synchronous) {
+	mLoadingTasks.clearOwnerships(); // Cancels the last load
+	stopAnimation();
 	mSource = path;
+	if(loadAnimation(path)) return;
+	// Without a size yet, only the full image tells how big it wants to be
+	mResolution = neededResolution();
+	auto url = mResolution ? Runtime::scaledUrl(path, mResolution) : path;
 	if(force_synchronous) {
-		image(loadImage(path), std::move(path));
+		image(loadImage(url), std::move(path));
 	}
 	else {
 		loadImage(&mLoadingTasks, [this, path = std::move(path)](std::shared_ptr<Bitmap> img) {
 			if(img) image(std::move(img), std::move(path));
-		}, mSource);
+		}, url);
+	}
+}
+
+/// The resolution to load for the current size: The next power of two, so small resizes don't cause loads.
+/// 0 if the size isn't known yet.
+unsigned Image::neededResolution() const noexcept {
+	float side = std::max(width(), height());
+	if(side <= 0) {
+		if(!std::isfinite(mMaxSize.x) || !std::isfinite(mMaxSize.y)) return 0;
+		side = std::max(mMaxSize.x, mMaxSize.y);
 	}
+	unsigned result = 16;
+	while(result < side && result < (1u << 30)) result *= 2;
+	return result;
+}
+void Image::updateResolution() {
+	if(!mImage || mAnimation || mSource.empty() || !context()) return;
+	unsigned needed  = neededResolution();
+	unsigned full    = std::max(mImage->sourceWidth(), mImage->sourceHeight());
+	unsigned current = std::max(mImage->width(), mImage->height());
+	if(!needed) return;
+	if(needed >= full) needed = 0;
+
+	// Grows right away, but only shrinks when it halves the memory at least
+	bool grow   = current < full && (!needed || needed > current);
+	bool shrink = needed && needed * 2 <= current;
+	if(grow || shrink) loadResolution(needed);
+}
+void Image::loadResolution(unsigned resolution) {
+	if(resolution == mResolution && mLoadingTasks.hasOwnerships()) return; // Already on the way
+	mLoadingTasks.clearOwnerships();
+	mResolution = resolution;
+	// Keeps showing the current image until the new one is there
+	loadImage(&mLoadingTasks, [this](std::shared_ptr<Bitmap> img) {
+		if(img) image(std::move(img), mSource);
+	}, resolution ? Runtime::scaledUrl(mSource, resolution) : mSource);
+}
+/// GIFs are played frame by frame, without going through the image cache. Returns whether path is one.
+bool Image::loadAnimation(std::string const& path) {
+	if(!context() || path.size() < 4) return false;
+	std::string extension = path.substr(path.size() - 4);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char) std::tolower(c); });
+	if(extension != ".gif") return false;
+
+	auto animation = std::make_shared<AnimatedBitmap>();
+	try {
+		animation->open(path, context()->runtime().threadpool());
+	}
+	catch(std::exception&) {
+		return false; // Maybe the decoder for stills knows better, or at least reports why it failed
+	}
+	mAnimation = std::move(animation);
+	image(mAnimation->bitmap(), path);
+	animate();
+	return true;
+}
+void Image::stopAnimation() {
+	mAnimationTasks.clearOwnerships();
+	mAnimation.reset();
+}
+/// Shows the frames which are due and sleeps until the next one. Only this image is redrawn.
+void Image::animate() {
+	if(!mAnimation || !context()) return;
+	if(mAnimation->advance(context()->now())) {
+		requestRedraw();
+	}
+	auto due = mAnimation->due();
+	if(due != std::chrono::steady_clock::time_point::max()) {
+		context()->deferUntil(due, makeOwnedTask(&mAnimationTasks, [this]() { animate(); }));
+	}
+}
+
+void Image::onResized() {
+	Widget::onResized();
+	updateResolution();
 }
 
 void Image::reload(bool force_synchronous) {
@@ -64,22 +164,28 @@ void Image::reload(bool force_synchronous) {
 }
 
 void Image::onContextChanged() {
+	stopAnimation();
 	mImage.reset();
 	if(!source().empty() && context())
 		reload(false);
 }
 Image* Image::image(std::nullptr_t) {
+	mLoadingTasks.clearOwnerships();
+	stopAnimation();
 	mSource.clear();
 	mImage.reset();
+	mResolution = 0;
 	return this;
 }
 Image* Image::image(std::shared_ptr<Bitmap> image, std::string source) {
 	mSource = std::move(source);
 	mImage  = std::move(image);
 	if(mImage) {
-		if(mImage->width() != width() || mImage->height() != height()) {
+		if(mImage->sourceWidth() != width() || mImage->sourceHeight() != height()) {
 			preferredSizeChanged();
 		}
+		requestRedraw();
+		updateResolution();
 	}
 	return this;
 }
@@ -109,8 +215,8 @@ Image* Image::maxSize(Size size) {
 PreferredSize Image::onCalcPreferredSize() {
 	PreferredSize result = Widget::onCalcPreferredSize();
 	if(mImage) {
-		result.pref.x = std::min(mMaxSize.x, (float)mImage->width());
-		result.pref.y = std::min(mMaxSize.y, (float)mImage->height());
+		result.pref.x = std::min(mMaxSize.x, (float)mImage->sourceWidth());
+		result.pref.y = std::min(mMaxSize.y, (float)mImage->sourceHeight());
 	}
 	result.sanitize();
 	return result;
@@ -140,14 +246,14 @@ void Image::onDraw(Canvas& c) {
 			float h  = width() / ratio;
 			float hd = height() - h;
 			Rect target {0, hd * .5f, this->width(), h};
-			c.fillTexture(target, mImage, mTint)
+			c.fillTexture(target, mImage->level(target.width(), target.height()), mTint)
 			 .rect(target)
 			 .fill();
 		}
 		else {
 			float wd = width() - w;
 			Rect target{wd * .5f, 0, w, height()};
-			c.fillTexture(target, mImage, mTint)
+			c.fillTexture(target, mImage->level(target.width(), target.height()), mTint)
 			 .rect(target)
 			 .fill();
 		}
@@ -48,9 +48,9 @@ Text& Text::operator=(Text&& other) noexcept {
 	return *this;
 }
 
-Text* Text::content(std::string s) {
+Text* Text::content(std::string_view s) {
 	if(mText != s) {
-		mText = std::move(s);
+		mText.assign(s); // Reuses the capacity of mText
 		preferredSizeChanged();
 		requestRedraw();
 	}
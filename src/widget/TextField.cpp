@@ -1,5 +1,6 @@
 #include "../../include/wwidget/widget/TextField.hpp"
 #include "../../include/wwidget/Canvas.hpp"
+#include "../../include/wwidget/FrameArena.hpp"
 
 namespace wwidget {
 
@@ -21,10 +22,10 @@ void TextField::on(KeyEvent const& k) {
 		k.handled = true;
 
 		if(k.state != Event::UP) {
-			std::string c = content();
+			std::string_view c = content();
 			while(!c.empty()) {
-				bool wasContinuationByte = (c[c.size() - 1] & 0xC0) == 0x80;
-				c.pop_back();
+				bool wasContinuationByte = (c.back() & 0xC0) == 0x80;
+				c.remove_suffix(1);
 				if(!wasContinuationByte)
 					break;
 			}
@@ -43,7 +44,9 @@ void TextField::on(KeyEvent const& k) {
 }
 
 void TextField::on(wwidget::TextInput const& t) {
-	content(content() + t.utf8);
+	FrameString c(content(), frameMemory());
+	c += t.utf8;
+	content(c);
 
 	t.handled = true;
 }
@@ -55,7 +58,7 @@ void TextField::onDraw(Canvas& c) {
 	 .stroke();
 }
 
-TextField* TextField::content(std::string c) {
+TextField* TextField::content(std::string_view c) {
 	Text::content(c);
 	if(mOnUpdate) {
 		defer(mOnUpdate);